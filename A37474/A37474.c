@@ -5,6 +5,7 @@
 
 #include "A37474.h"
 #include "A37474_CONFIG.h"
+#include "TCPmodbus\Profiler.h"
 
 _FOSC(EC & CSW_FSCM_OFF); 
 _FWDT(WDT_ON & WDTPSA_512 & WDTPSB_8);  // 8 Second watchdog timer
@@ -20,6 +21,15 @@ void ETMCanSpoofAFCHighSpeedDataLog();
 unsigned int next_pulse_count = 0;
 unsigned int spoof_counter = 0;
 
+unsigned int pulse_log_count = 0;               // counts every grid pulse, including dropped ones
+unsigned int pulse_log_index = 0;               // next entry in the buffer being filled
+unsigned int pulse_log_select = SEND_BUFFER_A;  // buffer being filled
+
+volatile unsigned long timestamp_base = 0;      // Timestamp of the last Timer2 period match, see TimestampGet()
+#ifndef __CONTROL_TASK_IN_ISR
+volatile unsigned int tick_released = 0;        // _T2Interrupt() saw a period match, the main loop runs the tick
+#endif
+
 
 
 
@@ -36,8 +46,10 @@ unsigned int CheckPreTopFault(void);
 void DoA37474(void);
 /*
   DoA37474 is called every time the processor cycles through it's control loop
-  If _T2IF is set (indicates 10mS has passed) it executes everything that happens on 10mS time scale
+  If _T2Interrupt() released the tick (10mS has passed) it executes everything that happens on 10mS time scale
 */
+void DoControlTask(void); // Everything that happens on the 10mS tick, runs in _T2Interrupt() with __CONTROL_TASK_IN_ISR
+void DoControlTaskBackground(void); // The part of the 10mS tick that uses the I2C bus or the network, always runs from the main loop
 void UpdateFaults(void); // Update the fault bits based on analog/digital parameters
 void UpdateLEDandStatusOutuputs(void);  // Updates the LED and status outputs based on the system state
 
@@ -164,6 +176,8 @@ int main(void) {
 
 
 void DoStateMachine(void) {
+  unsigned int ipl_save;
+
   switch (global_data_A37474.control_state) {
 
     
@@ -199,8 +213,10 @@ void DoStateMachine(void) {
     break;
     
   case STATE_RESET_FPGA:
+    CONTROL_TASK_LOCK(ipl_save);
     ResetFPGA();
     ResetAllFaultInfo();
+    CONTROL_TASK_UNLOCK(ipl_save);
     global_data_A37474.control_state = STATE_HEATER_DISABLED;
     break;
     
@@ -551,12 +567,16 @@ void InitializeA37474(void) {
 
   // ---------- Configure Timers ----------------- //
 
-  // Initialize TMR2
+  // Initialize TMR2, _T2IE is set once everything else is initialized
   PR2   = A37474_PR2_VALUE;
   TMR2  = 0;
   _T2IF = 0;
 //  _T2IP = 5;
+#ifdef __CONTROL_TASK_IN_ISR
+  _T2IP = A37474_CONTROL_TASK_IPL;
+#else
   _T2IP = 2;
+#endif
   T2CON = A37474_T2CON_VALUE;
   
       // Initialize TMR3
@@ -566,7 +586,15 @@ void InitializeA37474(void) {
 //  _T3IP = 5;
   _T3IP = 2;
   T3CON = A37474_T3CON_VALUE;
+
+  ProfileReset();
   
+  // Initialize IC5 to log every grid pulse
+  IC5CON = A37474_IC5CON_VALUE;
+  _IC5IF = 0;
+  _IC5IP = 5;
+  _IC5IE = 1;
+
 
   //Configure EEPROM
   ETMEEPromUseExternal();
@@ -656,6 +684,7 @@ void InitializeA37474(void) {
 
 #endif
   TCPmodbus_init(&ip_config);
+  global_data_A37474.ethernet_spi_fault = TCPmodbusGetSPIFault();
 
   
 
@@ -874,7 +903,10 @@ void InitializeA37474(void) {
   //Reset faults/warnings and inputs
   ResetAllFaultInfo();
   
-  
+  ResetControlTickStats();
+  // Start the 10mS tick, and the timestamp with it
+  _T2IF = 0;
+  _T2IE = 1;
   
 }
 
@@ -898,6 +930,7 @@ void SetCustomIP(void) {
   TCPmodbus_task(1);  //close socket
 
   TCPmodbus_init(&ip_config);
+  global_data_A37474.ethernet_spi_fault = TCPmodbusGetSPIFault();
 }
 
 
@@ -1115,11 +1148,19 @@ unsigned int CheckPreHVFault(void) {
 
 
 void DoA37474(void) {
+  unsigned int ipl_save;
+
+  ProfileLoop();
 
   TCPmodbus_task(0);
     
 #ifdef __CAN_ENABLED
+  ProfileEnter(PROFILE_CAN_SLAVE);
+  // The tick writes log_data and the debug registers this sends
+  CONTROL_TASK_LOCK(ipl_save);
   ETMCanSlaveDoCan();
+  CONTROL_TASK_UNLOCK(ipl_save);
+  ProfileExit(PROFILE_CAN_SLAVE);
 #endif
 
 #ifndef __CAN_REQUIRED
@@ -1127,7 +1168,11 @@ void DoA37474(void) {
 #endif
   
 #ifdef __MODE_MODBUS_MONITOR
+  ProfileEnter(PROFILE_MODBUS_SLAVE);
+  CONTROL_TASK_LOCK(ipl_save);
   ETMModbusSlaveDoModbus();
+  CONTROL_TASK_UNLOCK(ipl_save);
+  ProfileExit(PROFILE_MODBUS_SLAVE);
 #endif
 
   ETMDigitalUpdateInput(&global_data_A37474.interlock_relay_closed, PIN_INTERLOCK_RELAY_STATUS);
@@ -1172,13 +1217,51 @@ void DoA37474(void) {
   
 //--------- Following happens every 10ms ------------//  
 
-  if (_T2IF) {
+#ifdef __CONTROL_TASK_IN_ISR
+  // The tick runs in _T2Interrupt(), only the part that needs the main loop is left here
+  if (global_data_A37474.tick_background_sequence != global_data_A37474.tick_sequence) {
+    DoControlTaskBackground();
+  }
+#else
+  if (tick_released) {
     // Run once every 10ms
-    _T2IF = 0;
+    tick_released = 0;
+    DoControlTask();
+    DoControlTaskBackground();
+  }
+#endif
+}
+
 
-    unsigned int timer_report;
-    unsigned int read_mux;
-    unsigned char mux_port_byte;
+void DoControlTask(void) {
+  unsigned long tick_start;
+  unsigned long tick_latency;
+  unsigned long tick_period;
+  unsigned int timer_report;
+  unsigned int log_index;
+  unsigned int fault_register_previous;
+  unsigned long timestamp;
+
+  // Tick timing, TMR2 (1:8) has been counting since the period match that released this tick
+  tick_latency = (unsigned long)TMR2 * TIMESTAMP_COUNTS_PER_TMR2;
+  tick_start = TimestampGet();
+  tick_period = tick_start - global_data_A37474.tick_start_timestamp;
+  global_data_A37474.tick_start_timestamp = tick_start;
+  if (global_data_A37474.tick_count) {
+    if (tick_period < global_data_A37474.tick_period_min) {
+      global_data_A37474.tick_period_min = tick_period;
+    }
+    if (tick_period > global_data_A37474.tick_period_max) {
+      global_data_A37474.tick_period_max = tick_period;
+    }
+    if (tick_period > (A37474_TICK_PERIOD + (A37474_TICK_PERIOD >> 1))) {
+      global_data_A37474.tick_overruns++;
+  }
+}
+  if (tick_latency > global_data_A37474.tick_latency_max) {
+    global_data_A37474.tick_latency_max = tick_latency;
+      }
+  global_data_A37474.tick_count++;
   
     if (PIN_CUSTOMER_HV_ON == ILL_PIN_CUSTOMER_HV_ON_ENABLE_HV) {
       global_data_A37474.request_hv_enable = 1;
@@ -1265,14 +1348,6 @@ void DoA37474(void) {
 #endif
     
     
-    read_mux = MCP23008ReadSingleByte(&U12_MCP23008, MCP23008_REGISTER_GPIO);
-    mux_port_byte = read_mux & 0x00FF;
-    if (mux_port_byte != CONFIG_SELECT_PIN_BYTE) {
-      read_mux |= MCP23008WriteSingleByte(&U12_MCP23008, MCP23008_REGISTER_OLAT, CONFIG_SELECT_PIN_BYTE);
-      global_data_A37474.mux_fault++;
-    }
-
-    
     // Update to counter used to flash the LEDs at startup and time transmits to DACs
     if (global_data_A37474.power_supply_startup_remaining) {
       global_data_A37474.power_supply_startup_remaining--;
@@ -1302,10 +1377,14 @@ void DoA37474(void) {
     }
 
     // Update Data from the FPGA
+    ProfileEnter(PROFILE_FPGA_READ);
     FPGAReadData();
+    ProfileExit(PROFILE_FPGA_READ);
 
     // Read all the data from the external ADC
+    ProfileEnter(PROFILE_ADC_RESULTS);
     UpdateADCResults();
+    ProfileExit(PROFILE_ADC_RESULTS);
 
     // Start the next acquisition from the external ADC
     ADCStartAcquisition();
@@ -1427,6 +1506,26 @@ void DoA37474(void) {
 #endif
 
     ETMCanSlaveSetDebugRegister(7, global_data_A37474.dac_write_failure_count);
+    ETMCanSlaveSetDebugRegister(8, global_data_A37474.ethernet_spi_fault);
+
+    // The record belongs to the main loop while the background part sends it
+    if (!global_data_A37474.telemetry_record_busy) {
+      for (log_index = 0; log_index < TELEMETRY_LOG_WORDS; log_index++) {
+        telemetry_record.log_data[log_index] = slave_board_data.log_data[log_index];
+      }
+      telemetry_record.state_message = global_data_A37474.state_message;
+      telemetry_record.control_state = global_data_A37474.control_state;
+      telemetry_record.fault_register = _FAULT_REGISTER;
+      telemetry_record.warning_register = _WARNING_REGISTER;
+      telemetry_record.fpga_raw_high = global_data_A37474.fpga_raw_data >> 16;
+      telemetry_record.fpga_raw_low = global_data_A37474.fpga_raw_data;
+      timestamp = TimestampGet();
+      telemetry_record.timestamp_high = timestamp >> 16;
+      telemetry_record.timestamp_low = timestamp;
+      for (log_index = 0; log_index < TELEMETRY_ADC_WORDS; log_index++) {
+        telemetry_record.adc_raw[log_index] = global_data_A37474.adc_raw_data[log_index];
+      }
+    }
 
 
 #ifdef __CAN_REFERENCE
@@ -1572,11 +1671,41 @@ void DoA37474(void) {
     }
   
     // Update Faults
+    fault_register_previous = _FAULT_REGISTER;
+    ProfileEnter(PROFILE_UPDATE_FAULTS);
     UpdateFaults();
+    ProfileExit(PROFILE_UPDATE_FAULTS);
+    if (_FAULT_REGISTER & ~fault_register_previous) {
+      global_data_A37474.fault_latch_timestamp = TimestampGet();
+    }
     
     // Mange LED and Status Outputs
     UpdateLEDandStatusOutuputs();
+
+  global_data_A37474.tick_sequence++;
+}
+
+
+void DoControlTaskBackground(void) {
+  unsigned int read_mux;
+  unsigned char mux_port_byte;
+  unsigned int sequence;
+
+  // A tick that ends while this runs moves tick_sequence on, so the main loop calls this again for it
+  sequence = global_data_A37474.tick_sequence;
+
+  read_mux = MCP23008ReadSingleByte(&U12_MCP23008, MCP23008_REGISTER_GPIO);
+  mux_port_byte = read_mux & 0x00FF;
+  if (mux_port_byte != CONFIG_SELECT_PIN_BYTE) {
+    read_mux |= MCP23008WriteSingleByte(&U12_MCP23008, MCP23008_REGISTER_OLAT, CONFIG_SELECT_PIN_BYTE);
+    global_data_A37474.mux_fault++;
   }
+
+  global_data_A37474.telemetry_record_busy = 1;
+  TCPmodbus_10ms_task();
+  global_data_A37474.telemetry_record_busy = 0;
+
+  global_data_A37474.tick_background_sequence = sequence;
 }
 
 
@@ -1885,9 +2014,13 @@ void DisableHeater(void) {
      Set the heater ref to zero
      Clear the heater enable control voltage
    */
+  unsigned int ipl_save;
+
+  CONTROL_TASK_LOCK(ipl_save);
   global_data_A37474.analog_output_heater_voltage.enabled = 0;
   global_data_A37474.dac_digital_heater_enable = DAC_DIGITAL_OFF;
   DACWriteChannel(LTC265X_WRITE_AND_UPDATE_DAC_E, global_data_A37474.dac_digital_heater_enable);
+  CONTROL_TASK_UNLOCK(ipl_save);
 }
 
 
@@ -1921,31 +2054,46 @@ void DisableHighVoltage(void) {
     Clear the HVPS enable control voltage
     Clear the grid top enable control voltage
   */
+  unsigned int ipl_save;
+
+  CONTROL_TASK_LOCK(ipl_save);
   global_data_A37474.analog_output_top_voltage.enabled = 0;
   global_data_A37474.analog_output_high_voltage.enabled = 0;
   global_data_A37474.dac_digital_top_enable = DAC_DIGITAL_OFF;
   global_data_A37474.dac_digital_hv_enable = DAC_DIGITAL_OFF;
   DACWriteChannel(LTC265X_WRITE_AND_UPDATE_DAC_F, global_data_A37474.dac_digital_top_enable);
   DACWriteChannel(LTC265X_WRITE_AND_UPDATE_DAC_D, global_data_A37474.dac_digital_hv_enable);
+  CONTROL_TASK_UNLOCK(ipl_save);
   PIN_CPU_ILOCK_ENABLE = !OLL_ENABLE;
 }
 
 
 void EnableBeam(void) {
+  unsigned int ipl_save;
+
+  CONTROL_TASK_LOCK(ipl_save);
   global_data_A37474.dac_digital_trigger_enable = DAC_DIGITAL_ON;
   DACWriteChannel(LTC265X_WRITE_AND_UPDATE_DAC_G, global_data_A37474.dac_digital_trigger_enable);
+  CONTROL_TASK_UNLOCK(ipl_save);
   PIN_CPU_PULSE_ENABLE = OLL_ENABLE;
 }
 
 
 void DisableBeam(void) {
+  unsigned int ipl_save;
+
+  CONTROL_TASK_LOCK(ipl_save);
   global_data_A37474.dac_digital_trigger_enable = DAC_DIGITAL_OFF;
   DACWriteChannel(LTC265X_WRITE_AND_UPDATE_DAC_G, global_data_A37474.dac_digital_trigger_enable);
+  CONTROL_TASK_UNLOCK(ipl_save);
   PIN_CPU_PULSE_ENABLE = !OLL_ENABLE;
 }
 
 
 void ResetFPGA(void) {
+  unsigned int ipl_save;
+
+  CONTROL_TASK_LOCK(ipl_save);
   PIN_CS_FPGA = OLL_PIN_CS_FPGA_SELECTED;
   PIN_CS_DAC  = OLL_PIN_CS_DAC_SELECTED;
   PIN_CS_ADC  = OLL_PIN_CS_ADC_SELECTED;
@@ -1957,6 +2105,7 @@ void ResetFPGA(void) {
   PIN_CS_ADC  = !OLL_PIN_CS_ADC_SELECTED;
   //CS_LATCH_REGISTER &= ~OLL_CS_PINS_SELECTED;
   __delay32(DELAY_FPGA_CABLE_DELAY);
+  CONTROL_TASK_UNLOCK(ipl_save);
 }
 
 
@@ -2023,6 +2172,7 @@ void UpdateADCResults(void) {
     read_data[n]   = SPICharInverted(0);
     read_data[n] <<= 8;
     read_data[n]  += SPICharInverted(0);
+    global_data_A37474.adc_raw_data[n] = read_data[n];
   }
   
 
@@ -2140,6 +2290,7 @@ void DACWriteChannel(unsigned int command_word, unsigned int data_word) {
   unsigned int loop_counter;
   unsigned int spi_char;
 
+  ProfileEnter(PROFILE_DAC_WRITE);
   transmission_complete = 0;
   loop_counter = 0;
   while (transmission_complete == 0) {
@@ -2196,6 +2347,7 @@ void DACWriteChannel(unsigned int command_word, unsigned int data_word) {
     if ((command_word_check == command_word) && (data_word_check == data_word)) {
       transmission_complete = 1;
       global_data_A37474.dac_write_failure = 0;
+      global_data_A37474.dac_write_timestamp = TimestampGet();
     } else {
       global_data_A37474.dac_write_error_count++;
     }
@@ -2207,6 +2359,7 @@ void DACWriteChannel(unsigned int command_word, unsigned int data_word) {
       _STATUS_DAC_WRITE_FAILURE = 1;
     }
   }
+  ProfileExit(PROFILE_DAC_WRITE);
 }
 
 
@@ -2257,6 +2410,8 @@ void FPGAReadData(void) {
   PIN_CS_FPGA = !OLL_PIN_CS_FPGA_SELECTED;
   __delay32(DELAY_FPGA_CABLE_DELAY);
 
+  global_data_A37474.fpga_raw_data = bits;
+
   // error check the data and update digital inputs  
   fpga_bits = *(TYPE_FPGA_DATA*)&bits;
   
@@ -2437,6 +2592,27 @@ unsigned char SPICharInverted(unsigned char transmit_byte) {
 }
 
 
+unsigned long TimestampGet(void) {
+  unsigned long base;
+  unsigned int count;
+  unsigned int wrapped;
+  /*
+    _T2IF still set means TMR2 has wrapped but _T2Interrupt() has not added the period yet,
+    because this runs above its IPL or it is held off.  Retry if the wrap or the interrupt
+    came between the reads
+  */
+  do {
+    base = timestamp_base;
+    wrapped = _T2IF;
+    count = TMR2;
+  } while ((wrapped != _T2IF) || (base != timestamp_base));
+  if (wrapped) {
+    base += TIMESTAMP_T2_PERIOD;
+  }
+  return (base + (unsigned long)count * TIMESTAMP_COUNTS_PER_TMR2);
+}
+
+
 void ETMDigitalInitializeInput(TYPE_DIGITAL_INPUT* input, unsigned int initial_value, unsigned int filter_time) {
   if (filter_time > 0x7000) {
     filter_time = 0x7000;
@@ -2482,6 +2658,36 @@ void ETMDigitalUpdateInput(TYPE_DIGITAL_INPUT* input, unsigned int current_value
 }
 
 
+void __attribute__((interrupt, no_auto_psv)) _T2Interrupt(void) {
+  /*
+    Advances the timestamp base, an interrupt between the two writes would see it counted twice
+    With __CONTROL_TASK_IN_ISR runs the 10mS tick at A37474_CONTROL_TASK_IPL, below every other
+    interrupt.  The main loop only runs DoControlTaskBackground() once this has finished
+  */
+  unsigned int ipl_save;
+
+  SET_AND_SAVE_CPU_IPL(ipl_save, 7);
+  timestamp_base += TIMESTAMP_T2_PERIOD;
+  _T2IF = 0;
+  RESTORE_CPU_IPL(ipl_save);
+
+#ifdef __CONTROL_TASK_IN_ISR
+  DoControlTask();
+#else
+  tick_released = 1;
+#endif
+}
+
+
+void ResetControlTickStats(void) {
+  global_data_A37474.tick_count = 0;
+  global_data_A37474.tick_period_min = 0xFFFFFFFF;
+  global_data_A37474.tick_period_max = 0;
+  global_data_A37474.tick_latency_max = 0;
+  global_data_A37474.tick_overruns = 0;
+}
+
+
 void __attribute__((interrupt, no_auto_psv)) _ADCInterrupt(void) {
   _ADIF = 0;
   
@@ -2520,6 +2726,43 @@ void __attribute__((interrupt, no_auto_psv)) _ADCInterrupt(void) {
 }
 
 
+void __attribute__((interrupt, no_auto_psv)) _IC5Interrupt(void) {
+  ETMPulseLogEntry* entry;
+  unsigned int capture;
+
+  _IC5IF = 0;
+
+  // More than one capture is waiting if this interrupt was held off
+  while (IC5CONbits.ICBNE) {
+    capture = IC5BUF;
+    pulse_log_count++;
+
+    if (!PulseDataBufferFree(pulse_log_select)) {
+      // The buffer has not been streamed yet
+      pulse_log_overrun++;
+      continue;
+    }
+
+    if (pulse_log_select == SEND_BUFFER_A) {
+      entry = &pulse_log_buffer_a[pulse_log_index];
+    } else {
+      entry = &pulse_log_buffer_b[pulse_log_index];
+    }
+    entry->pulse_count = pulse_log_count;
+    entry->time_10ms   = global_data_A37474.run_time_counter;
+    entry->capture     = capture;
+    entry->gun_i_peak  = global_data_A37474.input_gun_i_peak.reading_scaled_and_calibrated;
+
+    pulse_log_index++;
+    if (pulse_log_index >= PULSE_LOG_ENTRIES) {
+      SendPulseData(pulse_log_select);
+      pulse_log_index = 0;
+      pulse_log_select ^= 1;
+    }
+  }
+}
+
+
 //void ETMAnalogClearFaultCounters(AnalogInput* ptr_analog_input) {
 //  ptr_analog_input->absolute_under_counter = 0;
 //  ptr_analog_input->absolute_over_counter = 0;
@@ -2699,6 +2942,8 @@ void ETMModbusInit(void) {
 
 
 void ETMModbusSlaveDoModbus(void) {
+  unsigned long latency;
+
   if (!modbus_transmission_needed) {
     if (LookForMessage()) {
       //Execute command with following functions
@@ -2713,6 +2958,10 @@ void ETMModbusSlaveDoModbus(void) {
       if (!U1STAbits.UTXBF) {
         U1TXREG = BufferByte64ReadByte(&uart1_output_buffer);
       }
+      latency = TIMESTAMP_TO_US(TimestampGet() - global_data_A37474.rtu_request_timestamp);
+      if (latency > global_data_A37474.rtu_response_latency_max) {
+        global_data_A37474.rtu_response_latency_max = latency;
+      }
     }
   } else if ((U1STAbits.TRMT == 1) && (!BufferByte64BytesInBuffer(&uart1_output_buffer))) {
     PIN_RS485_ENABLE = 0;
@@ -3161,6 +3410,7 @@ void __attribute__((interrupt, no_auto_psv)) _U1RXInterrupt(void) {
   while (U1STAbits.URXDA) {
     BufferByte64WriteByte(&uart1_input_buffer, U1RXREG);
   }
+  global_data_A37474.rtu_request_timestamp = TimestampGet();
   
 }
 
@@ -15,6 +15,7 @@
 #include <libpic30.h>
 #include <adc12.h>
 #include <timer.h>
+#include <incap.h>
 #include <spi.h>
 #include <uart.h>
 #include "ETM.h"
@@ -39,7 +40,9 @@
   SPI1   - Used for communicating with Converter Logic Board
   SPI2   - Used for communicating with on board DAC
 
-  Timer2 - Used for 10msTicToc 
+  Timer2 - Used for 10msTicToc and, with the period count kept by _T2Interrupt(), as the TimestampGet() timebase
+  Timer3 - Used for the 1S state machine delays
+  IC5    - Time stamps the grid pulse (on Timer2) for the pulse log
 
   ADC Module - AN3,AN4,AN5,AN6,AN7,VREF+,VREF-,AN13,AN14,AN15
 
@@ -260,6 +263,36 @@ F  1 1 0 0 0 0 0 1 1 1 0 0 1 1 1 1
 #define A37474_PR3_VALUE_US    1000000   // 1s
 #define A37474_PR3_VALUE       ((FCY_CLK/1000000)*A37474_PR3_VALUE_US/256)
 
+/*
+  --- Timestamp ---
+  32 bit free running timestamp in TCY (100nS) counts, wraps after ~429S
+  _T2Interrupt() adds one Timer2 period to the base at every period match and TimestampGet()
+  adds TMR2, so the resolution is the Timer2 prescale, 800nS.  Timer4/5 belong to ETM CAN.
+*/
+#define TIMESTAMP_COUNTS_PER_TMR2  8   // T2_PS_1_8
+#define TIMESTAMP_T2_PERIOD      ((unsigned long)(A37474_PR2_VALUE + 1)*TIMESTAMP_COUNTS_PER_TMR2)
+#define TIMESTAMP_COUNTS_PER_US  (FCY_CLK/1000000)
+#define TIMESTAMP_TO_US(counts)  ((counts)/TIMESTAMP_COUNTS_PER_US)
+
+/*
+  --- 10mS Control Tick ---
+  With __CONTROL_TASK_IN_ISR the tick runs in the Timer2 interrupt at A37474_CONTROL_TASK_IPL,
+  below every other interrupt, and preempts the network and serial services in the main loop.
+  Main loop code that uses the converter logic SPI bus, or changes state the tick reads as a
+  group, holds the tick off with CONTROL_TASK_LOCK() / CONTROL_TASK_UNLOCK() from A37474_CONFIG.h.
+  So do the readers of what the tick writes: ETMCanSlaveDoCan() (log_data and the debug
+  registers), ETMModbusSlaveDoModbus() and the TCP-CAN command and subscription handlers.
+  These nest.
+*/
+#define A37474_CONTROL_TASK_IPL  1
+#define A37474_TICK_PERIOD       TIMESTAMP_T2_PERIOD  // in timestamp counts
+
+/*
+  --- IC5 Setup ---
+  Captures TMR2 on every rising edge of the grid pulse
+*/
+#define A37474_IC5CON_VALUE    (IC_IDLE_CON & IC_TIMER2_SRC & IC_INT_1CAPTURE & IC_EVERY_RISE_EDGE)
+
  
 // ---- Hard Coded Delays ---- //
 #define DELAY_FPGA_CABLE_DELAY 10
@@ -310,6 +343,7 @@ typedef struct {
   unsigned int request_beam_enable;             // This indicates that beam_enable has been requested (either from CAN module or from discrete inputs depending upon configuration)
   unsigned int reset_active;                    // This indicates that reset has been requested (either from CAN module or from discrete inputs depending upon configuration)
   unsigned int ethernet_reset_cmd;
+  unsigned int ethernet_spi_fault;              // TCPmodbusGetSPIFault() after the last TCPmodbus_init(), debug register 8
   
   unsigned int heater_start_up_attempts;        // This counts the number of times the heater has started up without successfully completing it's ramp up.
 
@@ -361,6 +395,25 @@ typedef struct {
   unsigned int dac_write_failure_count;         // This counts the total number of unsessful dac transmissions (After N write errors it gives us)
   unsigned int dac_write_failure;               // This indicates that the previous attempt to write to the dac failed
 
+  // Event timestamps from TimestampGet(), latencies are in uS
+  unsigned long fault_latch_timestamp;          // Last time a fault bit was set
+  unsigned long dac_write_timestamp;            // Last time a DAC write was read back correctly
+  unsigned long rtu_request_timestamp;          // Last byte received on the serial modbus port
+  unsigned long rtu_response_latency_max;       // Longest time from request to the first response byte
+  unsigned long tcp_request_timestamp;          // Arrival of the last command on the ethernet port
+  unsigned long tcp_response_latency_max;       // Longest time from command arrival to its response being queued
+
+  // 10mS tick timing in timestamp counts, see DoControlTask()
+  unsigned long tick_count;                     // Ticks since the timing was last reset
+  unsigned long tick_start_timestamp;           // Start of the last tick
+  unsigned long tick_period_min;                // Shortest and longest time between the start of two ticks
+  unsigned long tick_period_max;
+  unsigned long tick_latency_max;               // Longest time from the Timer2 period match to the start of a tick
+  unsigned int  tick_overruns;                  // Ticks that started more than 1.5 periods after the one before
+  unsigned int  tick_sequence;                  // Incremented at the end of every tick
+  unsigned int  tick_background_sequence;       // tick_sequence that DoControlTaskBackground() last ran for
+  unsigned int  telemetry_record_busy;          // DoControlTaskBackground() is sending telemetry_record, the tick must not refill it
+
   unsigned int heater_voltage_current_limited;  // This counter is used to track how long the heater is opperating in current limited mode. 
   unsigned int previous_state_pin_customer_hv_on;  // This stores the previous state of customer HV on input.  An On -> Off transion of this pin is used to generate a reset in discrete control mode
 
@@ -424,6 +477,9 @@ typedef struct {
   TYPE_DIGITAL_INPUT adc_digital_grid_flt;
   AnalogInput  input_dac_monitor;
 
+  unsigned int  adc_raw_data[17];       // last MAX1230 read, error checked or not
+  unsigned long fpga_raw_data;          // last 32 bits read from the FPGA
+
   TYPE_DIGITAL_INPUT interlock_relay_closed;
   
   // These are the anlog input from the PICs internal DAC
@@ -436,6 +492,17 @@ typedef struct {
 
 extern TYPE_GLOBAL_DATA_A37474 global_data_A37474;
 
+unsigned long TimestampGet(void);
+/*
+  Returns the Timer2 based timestamp, TIMESTAMP_COUNTS_PER_US counts per uS
+  Safe from any interrupt level, (later - earlier) is correct across the 32 bit wrap
+*/
+
+void ResetControlTickStats(void);
+/*
+  Clears the 10mS tick timing, hold the tick off with CONTROL_TASK_LOCK() first
+*/
+
 
 
 
@@ -21,6 +21,7 @@
 #define __MODE_ETHERNET_INTERFACE
 #define __MODE_MODBUS_MONITOR
 #define __OPTION_ENABLE_CAN
+//#define __OPTION_CONTROL_TASK_IN_ISR
 #define OLL_PIN_CPU_HV_ENABLE_HV_ENABLED        1
 #define HEATER_RAMP_TIME                        21000        // 3.5min
 #define RAMP_TIME_INTERVAL                      30           // 300ms
@@ -43,6 +44,7 @@
 #define __MODE_ETHERNET_INTERFACE
 #define __MODE_MODBUS_MONITOR
 #define __OPTION_ENABLE_CAN
+//#define __OPTION_CONTROL_TASK_IN_ISR
 #define OLL_PIN_CPU_HV_ENABLE_HV_ENABLED        1
 #define HEATER_RAMP_TIME                        42000        // 7min
 #define RAMP_TIME_INTERVAL                      60           // 600ms
@@ -86,6 +88,10 @@
     This is only valid for __MODE_DISCRETE_INTERFACE
     This allows the CAN port to be used for test and debugging while operating in one of these modes
 
+  __OPTION_CONTROL_TASK_IN_ISR
+    The 10ms control tick runs in the Timer2 interrupt instead of when the main loop sees it released.
+    Its start no longer waits for the network, CAN and serial services to finish a pass
+
  */
 
 
@@ -138,6 +144,15 @@
 #define __CAN_ENABLED
 #endif
 
+#ifdef __OPTION_CONTROL_TASK_IN_ISR
+#define __CONTROL_TASK_IN_ISR
+#define CONTROL_TASK_LOCK(save)    SET_AND_SAVE_CPU_IPL(save, A37474_CONTROL_TASK_IPL)
+#define CONTROL_TASK_UNLOCK(save)  RESTORE_CPU_IPL(save)
+#else
+#define CONTROL_TASK_LOCK(save)    ((save) = 0)
+#define CONTROL_TASK_UNLOCK(save)  ((void)(save))
+#endif
+
 
 
 // -------------- Interface board Configuration ---------------------
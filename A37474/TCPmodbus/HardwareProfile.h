@@ -86,6 +86,15 @@
 #define ENC_RST_TRIS		    (TRISCbits.TRISC1)
 #define ENC_RST_IO		        (LATCbits.LATC1)
 
+// ENC28J60 INT output (active low) on RA15/INT4.  Comment out to poll 
+// EPKTCNT on every StackTask() instead.
+#define ENC_INT_TRIS		(TRISAbits.TRISA15)
+#define ENC_INT_IF			(_INT4IF)
+#define ENC_INT_IE			(_INT4IE)
+#define ENC_INT_IP			(_INT4IP)
+#define ENC_INT_EDGE		(_INT4EP)
+#define ENC_INT_VECTOR		_INT4Interrupt
+
 // SPI SCK, SDI, SDO pins are automatically controlled by the 
 // PIC24/dsPIC SPI module 
 #define ENC_SPI_IF			(IFS0bits.SPI2IF)
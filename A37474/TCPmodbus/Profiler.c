@@ -0,0 +1,136 @@
+/*********************************************************************
+ *
+ *  Cycle budget profiler
+ *
+ *********************************************************************
+ * FileName:        Profiler.c
+ * Dependencies:    TimestampGet() in A37474.c
+ *
+ * Times the main loop subsystems with the TimestampGet() timestamp, see
+ * Profiler.h for the probes.  The results are read through the
+ * SDO_IDX_PROF_xxx indexes in TcpServerCanFormat.c.
+ *
+ ********************************************************************/
+#define __PROFILER_C
+
+#include "..\A37474.h"
+#include "Profiler.h"
+
+
+#define PROFILE_HIST_BASE      ((unsigned long)PROFILE_HIST_BASE_US * TIMESTAMP_COUNTS_PER_US)
+#define PROFILE_LOOP_WINDOW    (1000000ul * TIMESTAMP_COUNTS_PER_US)   // 1s
+
+
+static PROFILE_PROBE profile_probe[PROFILE_PROBES];
+
+static unsigned long profile_loop_start;       // timestamp the current loop window began
+static unsigned long profile_loop_count;       // passes in the current window
+static unsigned long profile_loops_per_second;
+
+
+//////////////////////////////////////////////////////////////////////////
+// ProfileEnter
+//
+void ProfileEnter(unsigned char probe)
+{
+  profile_probe[probe].start = TimestampGet();
+}
+
+//////////////////////////////////////////////////////////////////////////
+// ProfileExit
+// fold the time since ProfileEnter() into the probe
+//
+void ProfileExit(unsigned char probe)
+{
+  PROFILE_PROBE* p = &profile_probe[probe];
+  unsigned long elapsed;
+  unsigned long limit;
+  unsigned char bin;
+  unsigned char n;
+
+  elapsed = TimestampGet() - p->start;
+
+  if (elapsed < p->min) {
+    p->min = elapsed;
+  }
+  if (elapsed > p->max) {
+    p->max = elapsed;
+  }
+
+  if (p->sum & 0x80000000) {
+    p->sum >>= 1;
+    p->count >>= 1;
+  }
+  p->sum += elapsed;
+  p->count++;
+
+  bin = 0;
+  limit = PROFILE_HIST_BASE;
+  while ((bin < (PROFILE_HIST_BINS - 1)) && (elapsed >= limit)) {
+    bin++;
+    limit <<= 1;
+  }
+  if (p->hist[bin] == 0xFFFF) {
+    for (n = 0; n < PROFILE_HIST_BINS; n++) {
+      p->hist[n] >>= 1;
+    }
+  }
+  p->hist[bin]++;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// ProfileLoop
+// latch the pass count once a second, a stalled loop stretches the window
+//
+void ProfileLoop(void)
+{
+  unsigned long now;
+
+  profile_loop_count++;
+  now = TimestampGet();
+  if ((now - profile_loop_start) >= PROFILE_LOOP_WINDOW) {
+    profile_loops_per_second = profile_loop_count;
+    profile_loop_count = 0;
+    profile_loop_start = now;
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////
+// ProfileReset
+// start is kept, the reset can come from inside a probe
+//
+void ProfileReset(void)
+{
+  unsigned char probe;
+  unsigned char bin;
+
+  for (probe = 0; probe < PROFILE_PROBES; probe++) {
+    profile_probe[probe].min = 0xFFFFFFFF;
+    profile_probe[probe].max = 0;
+    profile_probe[probe].sum = 0;
+    profile_probe[probe].count = 0;
+    for (bin = 0; bin < PROFILE_HIST_BINS; bin++) {
+      profile_probe[probe].hist[bin] = 0;
+    }
+  }
+
+  profile_loop_start = TimestampGet();
+  profile_loop_count = 0;
+  profile_loops_per_second = 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// ProfileGetProbe
+//
+const PROFILE_PROBE* ProfileGetProbe(unsigned char probe)
+{
+  return &profile_probe[probe];
+}
+
+//////////////////////////////////////////////////////////////////////////
+// ProfileGetLoopsPerSecond
+//
+unsigned long ProfileGetLoopsPerSecond(void)
+{
+  return profile_loops_per_second;
+}
@@ -0,0 +1,72 @@
+#ifndef __PROFILER_H
+#define __PROFILER_H
+
+/*
+  Cycle budget profiler
+
+  Each probe is timed with TimestampGet() from ProfileEnter() to ProfileExit()
+  and keeps the min, max and mean time plus a histogram.  Times are in
+  timestamp counts (TIMESTAMP_COUNTS_PER_US per uS, 100nS at FCY_CLK 10MHz) with
+  an 800nS resolution.
+
+  Histogram bin n counts times below (PROFILE_HIST_BASE_US << n) uS, the
+  last bin counts everything longer.  When a bin or the mean would overflow
+  all bins, or the mean's sum and count, are halved, so they keep their
+  shape but are not absolute call counts.
+
+  ProfileLoop() is called once per main loop pass, the passes are counted
+  over each second of timestamps.
+*/
+
+#define PROFILE_STACK_TASK            0   // StackTask()
+#define PROFILE_TCP_SERVER            1   // GenericTCPServer(), includes DoTcpCanCommand()
+#define PROFILE_TCP_CAN_COMMAND       2   // DoTcpCanCommand()
+#define PROFILE_MODBUS_SLAVE          3   // ETMModbusSlaveDoModbus()
+#define PROFILE_CAN_SLAVE             4   // ETMCanSlaveDoCan()
+#define PROFILE_FPGA_READ             5   // FPGAReadData()
+#define PROFILE_ADC_RESULTS           6   // UpdateADCResults()
+#define PROFILE_DAC_WRITE             7   // DACWriteChannel()
+#define PROFILE_UPDATE_FAULTS         8   // UpdateFaults()
+#define PROFILE_PROBES                9
+
+#define PROFILE_HIST_BINS             8
+#define PROFILE_HIST_BASE_US          16   /* bins: <16, <32 ... <1024uS, longer */
+
+typedef struct {
+  unsigned long start;                  // timestamp of the last ProfileEnter()
+  unsigned long min;
+  unsigned long max;
+  unsigned long sum;                    // sum / count is the mean
+  unsigned long count;
+  unsigned int  hist[PROFILE_HIST_BINS];
+} PROFILE_PROBE;
+
+
+void ProfileEnter(unsigned char probe);
+void ProfileExit(unsigned char probe);
+/*
+  Bracket the code timed by probe, the probes may nest but a probe must not
+  be entered again before it exits
+*/
+
+void ProfileLoop(void);
+/*
+  Call once per main loop pass
+*/
+
+void ProfileReset(void);
+/*
+  Clears every probe and the loop rate
+*/
+
+const PROFILE_PROBE* ProfileGetProbe(unsigned char probe);
+/*
+  Returns the probe, min is 0xFFFFFFFF until the first exit
+*/
+
+unsigned long ProfileGetLoopsPerSecond(void);
+/*
+  Main loop passes counted in the last full second
+*/
+
+#endif
@@ -76,7 +76,26 @@
 #endif
 
 #ifdef STACK_CLIENT_MODE
-static NODE_INFO Cache;						// Cache for one ARP response
+// One resolved remote node, or the gateway for off-subnet addresses
+typedef struct
+{
+	NODE_INFO	Node;				// IPAddr 0xFFFFFFFF when unused
+	DWORD		dwLearned;			// TickGet() when last confirmed by the network
+	DWORD		dwUsed;				// TickGet() when last looked up
+} ARP_CACHE_ENTRY;
+
+static ARP_CACHE_ENTRY Cache[ARP_CACHE_ENTRIES];
+
+// Gratuitous ARP announcements of our own address, see ARPTask()
+#define ARP_ANNOUNCE_COUNT		(2u)
+#define ARP_ANNOUNCE_INTERVAL	((DWORD)TICK_SECOND)
+#define ARP_LINK_POLL_INTERVAL	((DWORD)(TICK_SECOND/4))
+
+static IP_ADDR AnnouncedIP;			// Address the announcements are for
+static BYTE AnnounceCount;			// Announcements still to send
+static DWORD dwAnnounceTime;		// Time of the last announcement
+static DWORD dwLinkPollTime;		// Time MACIsLinked() was last checked
+static BOOL bLinked;				// Link state at that time
 #endif
 
 #ifdef STACK_USE_ZEROCONF_LINK_LOCAL
@@ -106,6 +125,10 @@ typedef struct __attribute__((aligned(2), packed))
   ***************************************************************************/
 
 static BOOL ARPPut(ARP_PACKET* packet);
+#ifdef STACK_CLIENT_MODE
+static ARP_CACHE_ENTRY* ARPCacheFind(DWORD IPAddr);
+static void ARPCacheUpdate(IP_ADDR* IPAddr, MAC_ADDR* MACAddr, BOOL bAdd);
+#endif
 
 
 /****************************************************************************
@@ -289,14 +312,16 @@ BOOL ARPSendPkt(DWORD SrcIPAddr, DWORD DestIPAddr, BYTE op_req )
 		// "Resolve" the IP to MAC address mapping for
 		// IP multicast address range from 224.0.0.0 to 239.255.255.255
 	
-		Cache.MACAddr.v[0] = 0x01;
-		Cache.MACAddr.v[1] = 0x00;
-		Cache.MACAddr.v[2] = 0x5E;
-		Cache.MACAddr.v[3] = 0x7f & DestAddr->v[1];
-		Cache.MACAddr.v[4] = DestAddr->v[2];
-		Cache.MACAddr.v[5] = DestAddr->v[3];
+		MAC_ADDR MulticastMAC;
+
+		MulticastMAC.v[0] = 0x01;
+		MulticastMAC.v[1] = 0x00;
+		MulticastMAC.v[2] = 0x5E;
+		MulticastMAC.v[3] = 0x7f & DestAddr->v[1];
+		MulticastMAC.v[4] = DestAddr->v[2];
+		MulticastMAC.v[5] = DestAddr->v[3];
 	
-		Cache.IPAddr.Val = DestAddr->Val;
+		ARPCacheUpdate((IP_ADDR*)DestAddr, &MulticastMAC, TRUE);
 	
 		return TRUE;
 	}
@@ -374,7 +399,8 @@ static BOOL ARPPut(ARP_PACKET* packet)
 	
   Description:
   	Initializes the ARP module.  Call this function once at boot to 
-  	invalidate the cached lookup.
+  	invalidate the cached lookups.  Our address is announced again by 
+  	ARPTask().
 
   Precondition:
 	None
@@ -392,14 +418,217 @@ static BOOL ARPPut(ARP_PACKET* packet)
 #ifdef STACK_CLIENT_MODE
 void ARPInit(void)
 {
-    Cache.MACAddr.v[0] = 0xff;
-    Cache.MACAddr.v[1] = 0xff;
-    Cache.MACAddr.v[2] = 0xff;
-    Cache.MACAddr.v[3] = 0xff;
-    Cache.MACAddr.v[4] = 0xff;
-    Cache.MACAddr.v[5] = 0xff;
-
-	Cache.IPAddr.Val = 0xfffffffful;
+	BYTE i;
+
+	for(i = 0; i < ARP_CACHE_ENTRIES; i++)
+	{
+		memset((void*)&Cache[i].Node.MACAddr, 0xFF, sizeof(Cache[i].Node.MACAddr));
+		Cache[i].Node.IPAddr.Val = 0xfffffffful;
+	}
+
+	AnnouncedIP.Val = 0;
+	AnnounceCount = 0;
+	bLinked = FALSE;
+	dwLinkPollTime = TickGet() - ARP_LINK_POLL_INTERVAL;
+}
+
+/*****************************************************************************
+  Function:
+	void ARPTask(void)
+
+  Summary:
+	Announces our IP address with gratuitous ARP.
+	
+  Description:
+  	Broadcasts ARP_ANNOUNCE_COUNT ARP requests for our own IP address, 
+  	ARP_ANNOUNCE_INTERVAL apart, after the link comes up or 
+  	AppConfig.MyIPAddr changes, so peers replace any stale cache entry for 
+  	our address at once instead of when it times out.
+
+  Precondition:
+	ARPInit() is already called.
+
+  Parameters:
+	None
+
+  Returns:
+  	None
+  
+  Remarks:
+  	Called from StackTask().  Never waits for the MAC.
+  ***************************************************************************/
+void ARPTask(void)
+{
+	ARP_PACKET packet;
+	BOOL bLink;
+
+	if(TickGet() - dwLinkPollTime >= ARP_LINK_POLL_INTERVAL)
+	{
+		dwLinkPollTime = TickGet();
+		bLink = MACIsLinked();
+		if(bLink && !bLinked)
+		{
+			AnnounceCount = ARP_ANNOUNCE_COUNT;
+			dwAnnounceTime = TickGet() - ARP_ANNOUNCE_INTERVAL;
+		}
+		bLinked = bLink;
+	}
+
+	if(AppConfig.MyIPAddr.Val != AnnouncedIP.Val)
+	{
+		AnnouncedIP.Val = AppConfig.MyIPAddr.Val;
+		AnnounceCount = ARP_ANNOUNCE_COUNT;
+		dwAnnounceTime = TickGet() - ARP_ANNOUNCE_INTERVAL;
+	}
+
+	if(!AnnounceCount || !bLinked || AnnouncedIP.Val == 0u)
+		return;
+	if(TickGet() - dwAnnounceTime < ARP_ANNOUNCE_INTERVAL)
+		return;
+	if(!MACIsTxReady())
+		return;
+
+	dwAnnounceTime = TickGet();
+	AnnounceCount--;
+
+	packet.Operation = ARP_OPERATION_REQ;
+	memset((void*)&packet.TargetMACAddr, 0xFF, sizeof(packet.TargetMACAddr));
+	packet.TargetIPAddr = AnnouncedIP;
+#ifdef STACK_USE_ZEROCONF_LINK_LOCAL
+	packet.SenderIPAddr = AnnouncedIP;
+#endif
+	ARPPut(&packet);
+}
+
+/*****************************************************************************
+  Function:
+	static ARP_CACHE_ENTRY* ARPCacheFind(DWORD IPAddr)
+
+  Summary:
+	Looks up an IP address in the ARP cache.
+	
+  Description:
+  	Returns the cache entry for IPAddr if it was confirmed within 
+  	ARP_CACHE_TIMEOUT.
+
+  Precondition:
+	None
+
+  Parameters:
+	IPAddr - IP address to look up, network byte order
+
+  Returns:
+  	The entry, or NULL if IPAddr is not cached or has expired.
+  ***************************************************************************/
+static ARP_CACHE_ENTRY* ARPCacheFind(DWORD IPAddr)
+{
+	BYTE i;
+
+	for(i = 0; i < ARP_CACHE_ENTRIES; i++)
+	{
+		if(Cache[i].Node.IPAddr.Val == IPAddr)
+		{
+			if(TickGet() - Cache[i].dwLearned >= ARP_CACHE_TIMEOUT)
+				return NULL;
+			return &Cache[i];
+		}
+	}
+
+	return NULL;
+}
+
+/*****************************************************************************
+  Function:
+	static void ARPCacheUpdate(IP_ADDR* IPAddr, MAC_ADDR* MACAddr, BOOL bAdd)
+
+  Summary:
+	Records an IP to MAC address mapping seen on the network.
+	
+  Description:
+  	Refreshes the entry for IPAddr if there is one.  Otherwise, if bAdd is 
+  	set, stores the mapping in an unused entry or in place of the least 
+  	recently used one.
+
+  Precondition:
+	None
+
+  Parameters:
+	IPAddr - IP address, network byte order
+	MACAddr - MAC address IPAddr was seen at
+	bAdd - TRUE to add IPAddr if it is not cached yet
+
+  Returns:
+  	None
+  ***************************************************************************/
+static void ARPCacheUpdate(IP_ADDR* IPAddr, MAC_ADDR* MACAddr, BOOL bAdd)
+{
+	ARP_CACHE_ENTRY *Entry;
+	DWORD dwNow;
+	BYTE i;
+
+	dwNow = TickGet();
+	Entry = NULL;
+	for(i = 0; i < ARP_CACHE_ENTRIES; i++)
+	{
+		if(Cache[i].Node.IPAddr.Val == IPAddr->Val)
+		{
+			Entry = &Cache[i];
+			break;
+		}
+	}
+
+	if(Entry == NULL)
+	{
+		if(!bAdd)
+			return;
+
+		Entry = &Cache[0];
+		for(i = 0; i < ARP_CACHE_ENTRIES; i++)
+		{
+			if(Cache[i].Node.IPAddr.Val == 0xfffffffful)
+			{
+				Entry = &Cache[i];
+				break;
+			}
+			if(dwNow - Cache[i].dwUsed > dwNow - Entry->dwUsed)
+				Entry = &Cache[i];
+		}
+		Entry->Node.IPAddr.Val = IPAddr->Val;
+		Entry->dwUsed = dwNow;
+	}
+
+	memcpy((void*)&Entry->Node.MACAddr, (void*)MACAddr, sizeof(Entry->Node.MACAddr));
+	Entry->dwLearned = dwNow;
+}
+
+/*****************************************************************************
+  Function:
+	void ARPRefresh(NODE_INFO* remote)
+
+  Summary:
+	Refreshes the ARP cache from a received IP packet.
+	
+  Description:
+  	An IP packet from a cached neighbor confirms its MAC address, so its 
+  	entry does not expire while the neighbor keeps talking to us.  Nodes 
+  	that are not cached yet are not added.
+
+  Precondition:
+	None
+
+  Parameters:
+	remote - Source IP address and source MAC address of the packet
+
+  Returns:
+  	None
+  
+  Remarks:
+  	Packets from other subnets carry the gateway's MAC address with the 
+  	remote IP address, which is never a cache key, so they are ignored.
+  ***************************************************************************/
+void ARPRefresh(NODE_INFO* remote)
+{
+	ARPCacheUpdate(&remote->IPAddr, &remote->MACAddr, FALSE);
 }
 #endif
 
@@ -471,6 +700,14 @@ BOOL ARPProcess(void)
 
 			// Handle incoming ARP responses
 #ifdef STACK_CLIENT_MODE
+			// Always refresh a known sender.  Add it if this is a response or 
+			// a request for us, since we are about to talk to it.
+			if(packet.SenderIPAddr.Val != 0u && packet.SenderIPAddr.Val != AppConfig.MyIPAddr.Val)
+			{
+				ARPCacheUpdate(&packet.SenderIPAddr, &packet.SenderMACAddr, 
+					(packet.Operation == ARP_OPERATION_RESP) || (packet.TargetIPAddr.Val == AppConfig.MyIPAddr.Val));
+			}
+
 			if(packet.Operation == ARP_OPERATION_RESP)
 			{
 /*                #if defined(STACK_USE_AUTO_IP)
@@ -478,8 +715,6 @@ BOOL ARPProcess(void)
                     if (AutoIPConfigIsInProgress(i))
                         AutoIPConflict(i);
                 #endif*/
-				Cache.MACAddr = packet.SenderMACAddr;
-				Cache.IPAddr = packet.SenderIPAddr;
 				
 				//putsUART("ARPProcess: SM_ARP_IDLE: ARP_OPERATION_RESP  \r\n"); 
 				return TRUE;
@@ -566,7 +801,8 @@ BOOL ARPProcess(void)
 	
   Description:
   	This function transmits and ARP request to determine the hardware
-  	address of a given IP address.
+  	address of a given IP address.  Nothing is sent if the address (or the 
+  	gateway, for an address on another subnet) is already cached.
 
   Precondition:
 	None
@@ -597,20 +833,27 @@ void ARPResolve(IP_ADDR* IPAddr)
 		// "Resolve" the IP to MAC address mapping for
 		// IP multicast address range from 224.0.0.0 to 239.255.255.255
 
-		Cache.MACAddr.v[0] = 0x01;
-		Cache.MACAddr.v[1] = 0x00;
-		Cache.MACAddr.v[2] = 0x5E;
-		Cache.MACAddr.v[3] = 0x7f & IPAddr->v[1];
-		Cache.MACAddr.v[4] = IPAddr->v[2];
-		Cache.MACAddr.v[5] = IPAddr->v[3];
+		MAC_ADDR MulticastMAC;
+
+		MulticastMAC.v[0] = 0x01;
+		MulticastMAC.v[1] = 0x00;
+		MulticastMAC.v[2] = 0x5E;
+		MulticastMAC.v[3] = 0x7f & IPAddr->v[1];
+		MulticastMAC.v[4] = IPAddr->v[2];
+		MulticastMAC.v[5] = IPAddr->v[3];
 
-		Cache.IPAddr.Val = IPAddr->Val;
+		ARPCacheUpdate(IPAddr, &MulticastMAC, TRUE);
 
 		return;
 	}
 #endif
 #endif
 
+    // ARP query either the IP address directly (on our subnet), or do an ARP query for our Gateway if off of our subnet
+	packet.TargetIPAddr			= ((AppConfig.MyIPAddr.Val ^ IPAddr->Val) & AppConfig.MyMask.Val) ? AppConfig.MyGateway : *IPAddr;
+	if(ARPCacheFind(IPAddr->Val) || ARPCacheFind(packet.TargetIPAddr.Val))
+		return;
+
 	packet.Operation            = ARP_OPERATION_REQ;
 	packet.TargetMACAddr.v[0]   = 0xff;
 	packet.TargetMACAddr.v[1]   = 0xff;
@@ -620,9 +863,6 @@ void ARPResolve(IP_ADDR* IPAddr)
 	packet.TargetMACAddr.v[5]   = 0xff;
 
 	//putsUART("ARPResolve() \r\n"); 
-
-    // ARP query either the IP address directly (on our subnet), or do an ARP query for our Gateway if off of our subnet
-	packet.TargetIPAddr			= ((AppConfig.MyIPAddr.Val ^ IPAddr->Val) & AppConfig.MyMask.Val) ? AppConfig.MyGateway : *IPAddr;
 #ifdef STACK_USE_ZEROCONF_LINK_LOCAL
 	packet.SenderIPAddr			= AppConfig.MyIPAddr;
 #endif
@@ -672,10 +912,16 @@ void ARPResolve(IP_ADDR* IPAddr)
 #ifdef STACK_CLIENT_MODE
 BOOL ARPIsResolved(IP_ADDR* IPAddr, MAC_ADDR* MACAddr)
 {
-    if((Cache.IPAddr.Val == IPAddr->Val) || 
-	  ((Cache.IPAddr.Val == AppConfig.MyGateway.Val) && ((AppConfig.MyIPAddr.Val ^ IPAddr->Val) & AppConfig.MyMask.Val)))
+	ARP_CACHE_ENTRY *Entry;
+
+	Entry = ARPCacheFind(IPAddr->Val);
+	if(Entry == NULL && ((AppConfig.MyIPAddr.Val ^ IPAddr->Val) & AppConfig.MyMask.Val))
+		Entry = ARPCacheFind(AppConfig.MyGateway.Val);
+
+    if(Entry)
     {
-        *MACAddr = Cache.MACAddr;		
+        *MACAddr = Entry->Node.MACAddr;
+		Entry->dwUsed = TickGet();
 		//putsUART("ARPIsResolved  \r\n"); 
         return TRUE;
     }
@@ -132,6 +132,14 @@ typedef struct  __attribute__((aligned(2), packed))
     }
 
     #define SPI_ON_BIT          (ENC_SPISTATbits.SPIEN)
+
+    #if defined(__dsPIC30F__)
+        // SPI2 may be shared, so the ENC28J60 SCK prescale is reloaded 
+        // whenever another device left a different one
+        #define ENC_SPI_PROFILES
+        #define ENC_SPICON_PRESCALE (0x1Fu)     // SPRE<2:0>:PPRE<1:0>
+        #define ENCSelect()         {if((ENC_SPICON & ENC_SPICON_PRESCALE) != SPIPrescale) LoadSPIPrescale(); ENC_CS_IO = 0;}
+    #endif
 #elif defined( __PIC32MX__ )
     #define ClearSPIDoneFlag()
     static inline __attribute__((__always_inline__)) void WaitForDataByte( void )
@@ -144,6 +152,10 @@ typedef struct  __attribute__((aligned(2), packed))
     #error Determine SPI flag mechanism
 #endif
 
+#if !defined(ENCSelect)
+    #define ENCSelect()         {ENC_CS_IO = 0;}
+#endif
+
 
 // Prototypes of functions intended for MAC layer use only.
 static void BankSel(WORD Register);
@@ -161,6 +173,91 @@ static WORD_VAL NextPacketLocation;
 static WORD_VAL CurrentPacketLocation;
 static BOOL WasDiscarded;
 static BYTE ENCRevID;
+static BYTE CurrentBank;    // ECON1.BSEL bits as last written by BankSel()
+
+#if defined(ENC_INT_IF)
+// With the INT pin connected, EPKTCNT is only read after the pin fired or 
+// while packets are still flowing.  The pin is edge triggered and stays 
+// low until every enabled EIR flag is clear, so EIR.LINKIF is cleared 
+// whenever the pin fired and whenever the receive path goes idle.  A slow 
+// poll covers the PKTIF silicon errata (the flag can miss a packet).
+#define ENC_INT_POLL_INTERVAL   (TICK_SECOND/20)
+static volatile BOOL IntPending;    // INT pin fired since the last check
+static BOOL RxIdle;                 // Last EPKTCNT read was 0
+static BOOL LinkState;              // PHSTAT2.LSTAT at the last link change
+static DWORD LastRxPoll;            // Time EPKTCNT was last read
+static DWORD LastLinkPoll;          // Time MACIsLinked() last checked LINKIF
+static void ServiceLinkChange(void);
+#endif
+
+// TX checksums of at least this many bytes are computed by the DMA engine.
+// Below it, programming the DMA over SPI costs more than reading the bytes.
+#if !defined(ENC_DMA_CHECKSUM_MIN_LEN)
+    #define ENC_DMA_CHECKSUM_MIN_LEN    (64u)
+#endif
+
+// Estimated PIC instruction cycles of the software checksum per byte (SPI 
+// read at FCY plus the add) and of one DMA checksum (register setup and 
+// polling), used for MACChecksumCyclesSaved
+#define ENC_SW_CHECKSUM_CYCLES_PER_BYTE (20u)
+#define ENC_DMA_CHECKSUM_CYCLES         (600u)
+
+DWORD MACChecksumOffloads;      // TX checksums computed by the DMA engine
+DWORD MACChecksumCyclesSaved;   // Estimated PIC cycles saved by them
+
+// ARP request fields checked by the pattern match filter, as offsets from 
+// the start of the Ethernet frame
+#define ENC_PM_ARP_OPER     (20u)   // Operation, 0x0001 = request
+#define ENC_PM_ARP_TPA      (38u)   // Target protocol (IP) address
+
+// A corrupt receive header is recovered by skipping the frame when its 
+// next packet pointer can be trusted and by resetting the RX buffer 
+// otherwise.  More than ENC_RX_RESYNC_LIMIT RX buffer resets in a row, 
+// each within ENC_RX_RESYNC_WINDOW of the last, re-initialize the chip.
+#define ENC_RX_RESYNC_WINDOW    (TICK_SECOND)
+#define ENC_RX_RESYNC_LIMIT     (3u)
+
+static MAC_RX_ERROR_STATS RXErrorStats;
+static DWORD LastResync;            // Time of the last RX buffer reset
+static BYTE ResyncBurst;            // RX buffer resets in a row
+static void RecoverRx(BOOL NextPointerValid);
+static void ResyncRxRing(void);
+
+// A runtime re-initialization gives up after ENC_RESET_ATTEMPTS resets 
+// (about 2ms each) and is retried every ENC_REINIT_RETRY while the 
+// ENC28J60 does not answer.
+#define ENC_RESET_ATTEMPTS      (10u)
+#define ENC_REINIT_RETRY        (TICK_SECOND)
+
+static BOOL MACFailed;              // The last re-initialization found no ENC28J60
+static DWORD LastReinit;            // Time of the last re-initialization
+static BOOL ResetENC(void);
+static void ConfigureENC(void);
+static void ReinitENC(void);
+
+#if defined(ENC_SPI_PROFILES)
+// SPI link self-test, see SPITest()
+#define ENC_SPI_TEST_LEN        (64u)   // Bytes written and read back per pass
+#define ENC_SPI_TEST_PASSES     (4u)
+
+// MAC and MII register access is unreliable below 8MHz SCK (silicon 
+// errata), so slower profiles are never tested or selected
+#define ENC_SPI_MIN_CLOCK       (8000000ul)
+
+// ENC_SPICON prescale bits for each profile, slowest first
+static ROM BYTE SPIPrescales[MAC_SPI_PROFILES] = {0x03, 0x13, 0x1B, 0x1F};
+static ROM BYTE SPIDividers[MAC_SPI_PROFILES] = {8, 4, 2, 1};
+#define SPIProfileUsable(p)     (GetInstructionClock()/SPIDividers[p] >= ENC_SPI_MIN_CLOCK)
+
+static BYTE SPIPrescale;            // Prescale bits loaded by ENCSelect()
+static MAC_SPI_TEST_RESULT SPITestResult;
+static void LoadSPIPrescale(void);
+static BOOL SPITest(void);
+#endif
+
+static BYTE RXFilterProfile;        // Profile last set by MACSetRXFilter()
+static IP_ADDR RXFilterIP;          // IP address loaded in the pattern filter
+static MAC_RX_FILTER_STATS RXFilterStats;
 
 
 //NOTE: All code in this module expects Bank 0 to be currently selected.  If code ever changes the bank, it must restore it to Bank 0 before returning.
@@ -184,8 +281,6 @@ static BYTE ENCRevID;
  *****************************************************************************/
 void MACInit(void)
 {
-    BYTE i;
-
     // Set up the SPI module on the PIC for communications with the ENC28J60
     ENC_CS_IO = 1;
     ENC_CS_TRIS = 0;        // Make the Chip Select pin an output
@@ -219,7 +314,9 @@ void MACInit(void)
     #else   // dsPIC30F
 	//ENC_SPICON = 0x1F;     // sec 2:1(10M), should be 0x1f or 1:1 sec, 1:1 primary prescale, 1:1 secondary prescale (20MHz)
 	// DPARKER EDIT HERE
-	ENC_SPICON = 0b11111;	 // sec 1:1(10M), primary 1:1.
+	// Fastest profile until SPITest() has picked the rate
+	SPIPrescale = SPIPrescales[MAC_SPI_PROFILES-1];
+	ENC_SPICON = SPIPrescale;
     #endif
 //    ENC_SPICON2 = 0;
     ENC_SPICONbits.CKE = 1;
@@ -233,17 +330,82 @@ void MACInit(void)
     ENC_SPICONbits.ON = 1;
 #endif
 
-    // RESET the entire ENC28J60, clearing all registers
-    // Also wait for CLKRDY to become set.
-    // Bit 3 in ESTAT is an unimplemented bit.  If it reads out as '1' that
-    // means the part is in RESET or there is something wrong with the SPI
-    // connection.  This loop makes sure that we can communicate with the
-    // ENC28J60 before proceeding.
-    do
+    // RESET the entire ENC28J60, clearing all registers.  At power up there 
+    // is nothing to do without the ENC28J60, so keep trying until it 
+    // answers.
+    while(!ResetENC());
+
+#if defined(ENC_SPI_PROFILES)
+    // A corrupted command during a failed test may have written any 
+    // register, so start over from reset.  If no usable profile passed, 
+    // SPITest() has recorded the fault and left the fastest one selected.
+    if(!SPITest())
+    {
+        while(!ResetENC());
+    }
+#endif
+
+    memset((void*)&RXFilterStats, 0x00, sizeof(RXFilterStats));
+    ConfigureENC();
+}//end MACInit
+
+
+/******************************************************************************
+ * Function:        static BOOL ResetENC(void)
+ *
+ * PreCondition:    SPI bus must be initialized (done in MACInit()).
+ *
+ * Input:           None
+ *
+ * Output:          TRUE: The ENC28J60 is out of reset with CLKRDY set
+ *                  FALSE: It did not answer after ENC_RESET_ATTEMPTS resets
+ *
+ * Side Effects:    All ENC28J60 registers are reset, Bank 0 is selected
+ *
+ * Overview:        Sends system resets until ESTAT shows the oscillator 
+ *                  ready.  Bit 3 in ESTAT is an unimplemented bit.  If it 
+ *                  reads out as '1' that means the part is in RESET or there 
+ *                  is something wrong with the SPI connection.
+ *
+ * Note:            Each attempt takes about 2ms.
+ *****************************************************************************/
+static BOOL ResetENC(void)
+{
+    BYTE i, Attempt;
+
+    for(Attempt = 0; Attempt < ENC_RESET_ATTEMPTS; Attempt++)
     {
         SendSystemReset();
         i = ReadETHReg(ESTAT).Val;
-    } while((i & 0x08) || (~i & ESTAT_CLKRDY));
+        if(!(i & 0x08) && (i & ESTAT_CLKRDY))
+        {
+            CurrentBank = 0;        // The reset cleared ECON1
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+
+/******************************************************************************
+ * Function:        static void ConfigureENC(void)
+ *
+ * PreCondition:    ResetENC() returned TRUE
+ *
+ * Input:           None
+ *
+ * Output:          None
+ *
+ * Side Effects:    None
+ *
+ * Overview:        Writes every ENC28J60 register MACInit() sets up and 
+ *                  enables reception.  The SPI clock is not changed.
+ *
+ * Note:            None
+ *****************************************************************************/
+static void ConfigureENC(void)
+{
+    BYTE i;
 
     // Start up in Bank 0 and configure the receive buffer boundary pointers
     // and the buffer write protect pointer (receive buffer read pointer)
@@ -271,13 +433,8 @@ void MACInit(void)
 
 
     // Enter Bank 1 and configure Receive Filters
-    // (No need to reconfigure - Unicast OR Broadcast with CRC checking is
-    // acceptable)
     // Write ERXFCON_CRCEN only to ERXFCON to enter promiscuous mode
-
-    // Promiscious mode example:
-    //BankSel(ERXFCON);
-    //WriteReg((BYTE)ERXFCON, ERXFCON_CRCEN);
+    MACSetRXFilter(MAC_RX_FILTER_DEFAULT);
 
     // Enter Bank 2 and configure the MAC
     BankSel(MACON1);
@@ -370,9 +527,359 @@ void MACInit(void)
 
     BankSel(ERDPTL);        // Return to default Bank 0
 
+#if defined(ENC_INT_IF)
+    // Drive the INT pin on received packets and link changes
+    WritePHYReg(PHIE, PHIE_PGEIE | PHIE_PLNKIE);
+    ReadPHYReg(PHIR);
+    BFSReg(EIE, EIE_INTIE | EIE_PKTIE | EIE_LINKIE);
+    LinkState = ReadPHYReg(PHSTAT2).PHSTAT2bits.LSTAT;
+    RxIdle = FALSE;
+
+    ENC_INT_TRIS = 1;
+    ENC_INT_EDGE = 1;       // Falling edge
+    ENC_INT_IP = 1;         // Only sets a flag
+    ENC_INT_IF = 0;
+    ENC_INT_IE = 1;
+#endif
+
     // Enable packet reception
     BFSReg(ECON1, ECON1_RXEN);
-}//end MACInit
+    MACFailed = FALSE;
+}
+
+#if defined(ENC_INT_IF)
+/******************************************************************************
+ * Function:        void ENC_INT_VECTOR(void)
+ *
+ * PreCondition:    MACInit() enabled the interrupt
+ *
+ * Input:           None
+ *
+ * Output:          None
+ *
+ * Side Effects:    None
+ *
+ * Overview:        INT pin falling edge.  SPI may be in use by the main
+ *                  loop, so the ENC28J60 is serviced in MACGetHeader().
+ *
+ * Note:            None
+ *****************************************************************************/
+void _ISR __attribute__((__no_auto_psv__)) ENC_INT_VECTOR(void)
+{
+    IntPending = TRUE;
+    ENC_INT_IF = 0;
+}
+
+/******************************************************************************
+ * Function:        static void ServiceLinkChange(void)
+ *
+ * PreCondition:    Bank 0 selected
+ *
+ * Input:           None
+ *
+ * Output:          None
+ *
+ * Side Effects:    None
+ *
+ * Overview:        Clears EIR.LINKIF, so the INT pin can go high again, and
+ *                  updates the link state returned by MACIsLinked().
+ *
+ * Note:            None
+ *****************************************************************************/
+static void ServiceLinkChange(void)
+{
+    if(!ReadETHReg(EIR).EIRbits.LINKIF)
+        return;
+
+    // Reading PHIR clears PLNKIF and with it LINKIF
+    ReadPHYReg(PHIR);
+    LinkState = ReadPHYReg(PHSTAT2).PHSTAT2bits.LSTAT;
+}
+#endif
+
+
+
+/******************************************************************************
+ * Function:        void MACSetRXFilter(BYTE Profile)
+ *
+ * PreCondition:    SPI interface must be initialized (done in MACInit()).
+ *
+ * Input:           Profile: OR of the MAC_RX_FILTER_* bits
+ *
+ * Output:          None
+ *
+ * Side Effects:    Packet reception is paused while the filters are 
+ *                  rewritten.
+ *
+ * Overview:        Programs ERXFCON (OR mode, CRC checked).  
+ *                  MAC_RX_FILTER_ARP_BCAST uses the pattern match filter 
+ *                  to accept broadcast frames whose EtherType, ARP 
+ *                  operation and target IP address say they are an ARP 
+ *                  request for AppConfig.MyIPAddr.
+ *
+ * Note:            MACGetHeader() reloads the pattern when 
+ *                  AppConfig.MyIPAddr changes.
+ *****************************************************************************/
+void MACSetRXFilter(BYTE Profile)
+{
+    BYTE Pattern[14];
+    BYTE Filters;
+    BOOL RxEnabled;
+    WORD_VAL Checksum;
+
+    RxEnabled = ReadETHReg(ECON1).ECON1bits.RXEN;
+    BFCReg(ECON1, ECON1_RXEN);
+
+    RXFilterProfile = Profile;
+    RXFilterIP.Val = AppConfig.MyIPAddr.Val;
+
+    Filters = ERXFCON_CRCEN;
+    if(Profile & MAC_RX_FILTER_UNICAST)
+        Filters |= ERXFCON_UCEN;
+    if(Profile & MAC_RX_FILTER_BCAST)
+        Filters |= ERXFCON_BCEN;
+    if(Profile & MAC_RX_FILTER_MCAST_HASH)
+        Filters |= ERXFCON_HTEN;
+
+    BankSel(EPMM0);
+    if(Profile & MAC_RX_FILTER_ARP_BCAST)
+    {
+        // The selected bytes in order: broadcast destination, ARP 
+        // EtherType, request operation and our IP address.  The filter 
+        // compares their checksum against EPMCS.
+        memset((void*)Pattern, 0xFF, 6);
+        Pattern[6] = 0x08;
+        Pattern[7] = ETHER_ARP;
+        Pattern[8] = 0x00;
+        Pattern[9] = 0x01;
+        memcpy((void*)&Pattern[10], (void*)&RXFilterIP, sizeof(RXFilterIP));
+        Checksum.Val = CalcIPChecksum(Pattern, sizeof(Pattern));
+
+        // Bytes 0-5, 12-13, ENC_PM_ARP_OPER and ENC_PM_ARP_TPA of the 
+        // 64 byte window starting at the destination address
+        WriteReg((BYTE)EPMM0, 0x3F);
+        WriteReg((BYTE)EPMM1, 0x30);
+        WriteReg((BYTE)EPMM2, 0x30);
+        WriteReg((BYTE)EPMM3, 0x00);
+        WriteReg((BYTE)EPMM4, 0xC0);
+        WriteReg((BYTE)EPMM5, 0x03);
+        WriteReg((BYTE)EPMM6, 0x00);
+        WriteReg((BYTE)EPMM7, 0x00);
+        WriteReg((BYTE)EPMCSL, Checksum.v[1]);
+        WriteReg((BYTE)EPMCSH, Checksum.v[0]);
+        WriteReg((BYTE)EPMOL, 0x00);
+        WriteReg((BYTE)EPMOH, 0x00);
+        Filters |= ERXFCON_PMEN;
+    }
+    WriteReg((BYTE)ERXFCON, Filters);
+    BankSel(ERDPTL);
+
+    if(RxEnabled)
+        BFSReg(ECON1, ECON1_RXEN);
+}
+
+
+#if defined(ENC_SPI_PROFILES)
+/******************************************************************************
+ * Function:        static BOOL SPITest(void)
+ *
+ * PreCondition:    ENC28J60 out of reset, Bank 0 selected, reception 
+ *                  disabled
+ *
+ * Input:           None
+ *
+ * Output:          TRUE: Every usable profile passed
+ *                  FALSE: A profile failed; the SPI is left at the fastest 
+ *                         usable one below it, or if there is none at the 
+ *                         fastest profile with bFault set
+ *
+ * Side Effects:    The start of the RX buffer is overwritten
+ *
+ * Overview:        Writes patterns to the ENC28J60 buffer memory and reads 
+ *                  them back at each SPI clock profile of at least 
+ *                  ENC_SPI_MIN_CLOCK, slowest first, and selects the fastest 
+ *                  profile with no errors.  Stops at the first failing 
+ *                  profile.
+ *
+ * Note:            There is no slower fallback: the ENC28J60 MAC and MII 
+ *                  registers can't be written reliably below 8MHz.
+ *****************************************************************************/
+static BOOL SPITest(void)
+{
+    BYTE Pattern[ENC_SPI_TEST_LEN];
+    BYTE Readback[ENC_SPI_TEST_LEN];
+    BYTE Profile, Pass, i;
+    WORD Errors;
+    BOOL Passed;
+
+    memset((void*)&SPITestResult, 0x00, sizeof(SPITestResult));
+    Passed = FALSE;
+    for(Profile = 0; Profile < MAC_SPI_PROFILES; Profile++)
+    {
+        if(!SPIProfileUsable(Profile))
+            continue;
+
+        SPIPrescale = SPIPrescales[Profile];
+        Errors = 0;
+        for(Pass = 0; Pass < ENC_SPI_TEST_PASSES; Pass++)
+        {
+            // Alternating bits, shifted by a different step each pass
+            for(i = 0; i < sizeof(Pattern); i++)
+                Pattern[i] = (BYTE)(i*(Pass*2u+1u)) ^ ((i & 1u) ? 0x55 : 0xAA);
+
+            WriteReg(EWRPTL, LOW(RXSTART));
+            WriteReg(EWRPTH, HIGH(RXSTART));
+            MACPutArray(Pattern, sizeof(Pattern));
+            WriteReg(ERDPTL, LOW(RXSTART));
+            WriteReg(ERDPTH, HIGH(RXSTART));
+            MACGetArray(Readback, sizeof(Readback));
+
+            for(i = 0; i < sizeof(Pattern); i++)
+            {
+                if(Pattern[i] != Readback[i])
+                    Errors++;
+            }
+        }
+        SPITestResult.wErrors[Profile] = Errors;
+
+        if(Errors)
+        {
+            if(Passed)
+            {
+                MACSetSPIProfile(Profile-1);
+            }
+            else
+            {
+                MACSetSPIProfile(MAC_SPI_PROFILES-1);
+                SPITestResult.bFault = TRUE;
+            }
+            return FALSE;
+        }
+        Passed = TRUE;
+    }
+
+    if(!Passed)
+    {
+        // The instruction clock is too slow for any usable profile
+        SPIPrescale = SPIPrescales[MAC_SPI_PROFILES-1];
+        SPITestResult.bFault = TRUE;
+        return FALSE;
+    }
+
+    MACSetSPIProfile(MAC_SPI_PROFILES-1);
+    return TRUE;
+}
+
+/******************************************************************************
+ * Function:        static void LoadSPIPrescale(void)
+ *
+ * PreCondition:    ENC28J60 not selected
+ *
+ * Input:           None
+ *
+ * Output:          None
+ *
+ * Side Effects:    None
+ *
+ * Overview:        Loads SPIPrescale into ENC_SPICON.  The prescalers must 
+ *                  not be changed while the SPI is enabled.
+ *
+ * Note:            None
+ *****************************************************************************/
+static void LoadSPIPrescale(void)
+{
+    ENC_SPISTATbits.SPIEN = 0;
+    ENC_SPICON = (ENC_SPICON & ~ENC_SPICON_PRESCALE) | SPIPrescale;
+    ENC_SPISTATbits.SPIEN = 1;
+}
+#endif
+
+
+/******************************************************************************
+ * Function:        BOOL MACSetSPIProfile(BYTE Profile)
+ *
+ * PreCondition:    None
+ *
+ * Input:           Profile: 0 (slowest) to MAC_SPI_PROFILES-1 (fastest)
+ *
+ * Output:          TRUE: Profile selected
+ *                  FALSE: No such profile on this device, or its SCK is 
+ *                         below ENC_SPI_MIN_CLOCK
+ *
+ * Side Effects:    None
+ *
+ * Overview:        Selects the ENC28J60 SPI clock.  It takes effect the 
+ *                  next time the ENC28J60 is selected.
+ *
+ * Note:            MACInit() selects the fastest profile passing SPITest().
+ *****************************************************************************/
+BOOL MACSetSPIProfile(BYTE Profile)
+{
+#if defined(ENC_SPI_PROFILES)
+    if(Profile >= MAC_SPI_PROFILES)
+        return FALSE;
+    if(!SPIProfileUsable(Profile))
+        return FALSE;
+
+    SPIPrescale = SPIPrescales[Profile];
+    SPITestResult.Profile = Profile;
+    SPITestResult.dwClock = GetInstructionClock()/SPIDividers[Profile];
+    return TRUE;
+#else
+    return FALSE;
+#endif
+}
+
+
+/******************************************************************************
+ * Function:        void MACGetSPITestResult(MAC_SPI_TEST_RESULT *result)
+ *
+ * PreCondition:    None
+ *
+ * Input:           result: Location to copy the result to
+ *
+ * Output:          None
+ *
+ * Side Effects:    None
+ *
+ * Overview:        Returns the SPI clock selected and the errors seen at 
+ *                  each profile by the last MACInit() self-test.
+ *
+ * Note:            All zeros on devices without SPI clock profiles.
+ *****************************************************************************/
+void MACGetSPITestResult(MAC_SPI_TEST_RESULT *result)
+{
+#if defined(ENC_SPI_PROFILES)
+    memcpy((void*)result, (void*)&SPITestResult, sizeof(SPITestResult));
+#else
+    memset((void*)result, 0x00, sizeof(*result));
+#endif
+}
+
+
+/******************************************************************************
+ * Function:        void MACGetRXFilterStats(MAC_RX_FILTER_STATS *stats)
+ *
+ * PreCondition:    None
+ *
+ * Input:           stats: Location to copy the counters to
+ *
+ * Output:          None
+ *
+ * Side Effects:    None
+ *
+ * Overview:        Returns the number of frames let through by the receive 
+ *                  filter since MACInit(), by destination class.  The 
+ *                  ENC28J60 does not count the frames it rejects, so the 
+ *                  broadcast count staying flat during a broadcast storm 
+ *                  is what shows the filter shedding it.
+ *
+ * Note:            None
+ *****************************************************************************/
+void MACGetRXFilterStats(MAC_RX_FILTER_STATS *stats)
+{
+    memcpy((void*)stats, (void*)&RXFilterStats, sizeof(RXFilterStats));
+}
 
 
 /******************************************************************************
@@ -396,6 +903,20 @@ void MACInit(void)
  *****************************************************************************/
 BOOL MACIsLinked(void)
 {
+    if(MACFailed)
+        return FALSE;
+
+#if defined(ENC_INT_IF)
+    // Kept up to date by the link change interrupt.  The poll catches a 
+    // change MACGetHeader() has not got to yet.
+    if(IntPending || (TickGet() - LastLinkPoll >= ENC_INT_POLL_INTERVAL))
+    {
+        LastLinkPoll = TickGet();
+        ServiceLinkChange();
+    }
+    return LinkState;
+#endif
+
     // LLSTAT is a latching low link status bit.  Therefore, if the link
     // goes down and comes back up before a higher level stack program calls
     // MACIsLinked(), MACIsLinked() will still return FALSE.  The next
@@ -501,22 +1022,14 @@ WORD MACGetFreeRxSize(void)
 
     // Read the Ethernet hardware buffer write pointer.  Because packets can be
     // received at any time, it can change between reading the low and high
-    // bytes.  A loop is necessary to make certain a proper low/high byte pair
-    // is read.
-    BankSel(EPKTCNT);
+    // bytes.  Reading the high byte again shows whether that happened, 
+    // without leaving Bank 0 to check EPKTCNT.
     do {
-        // Save EPKTCNT in a temporary location
-        ReadPT.v[0] = ReadETHReg((BYTE)EPKTCNT).Val;
-
-        BankSel(ERXWRPTL);
-        WritePT.v[0] = ReadETHReg(ERXWRPTL).Val;
         WritePT.v[1] = ReadETHReg(ERXWRPTH).Val;
-
-        BankSel(EPKTCNT);
-    } while(ReadETHReg((BYTE)EPKTCNT).Val != ReadPT.v[0]);
+        WritePT.v[0] = ReadETHReg(ERXWRPTL).Val;
+    } while(ReadETHReg(ERXWRPTH).Val != WritePT.v[1]);
 
     // Determine where the write protection pointer is
-    BankSel(ERXRDPTL);
     ReadPT.v[0] = ReadETHReg(ERXRDPTL).Val;
     ReadPT.v[1] = ReadETHReg(ERXRDPTH).Val;
 
@@ -536,6 +1049,39 @@ WORD MACGetFreeRxSize(void)
     }
 }
 
+/******************************************************************************
+ * Function:        BOOL MACIsRxPending(void)
+ *
+ * PreCondition:    None
+ *
+ * Input:           None
+ *
+ * Output:          TRUE: A packet MACGetHeader() has not returned yet is 
+ *                        waiting in the RX buffer
+ *                  FALSE: The RX buffer holds no new packet
+ *
+ * Side Effects:    None
+ *
+ * Overview:        Reads EPKTCNT without touching the current packet.
+ *
+ * Note:            The packet last returned by MACGetHeader() still counts 
+ *                  in EPKTCNT until it is discarded.
+ *****************************************************************************/
+BOOL MACIsRxPending(void)
+{
+    BYTE PacketCount;
+
+    if(MACFailed)
+        return FALSE;
+
+    BankSel(EPKTCNT);
+    PacketCount = ReadETHReg((BYTE)EPKTCNT).Val;
+    BankSel(ERDPTL);
+
+    return PacketCount > (WasDiscarded ? 0u : 1u);
+}
+
+
 /******************************************************************************
  * Function:        BOOL MACGetHeader(MAC_ADDR *remote, BYTE* type)
  *
@@ -563,11 +1109,42 @@ BOOL MACGetHeader(MAC_ADDR *remote, BYTE* type)
 {
     ENC_PREAMBLE header;
     BYTE PacketCount;
+#if defined(ENC_INT_IF)
+    BOOL Woken;
+#endif
+
+    // Nothing to read until the ENC28J60 answers again
+    if(MACFailed)
+    {
+        if(TickGet() - LastReinit >= ENC_REINIT_RETRY)
+            ReinitENC();
+        return FALSE;
+    }
+
+#if defined(ENC_INT_IF)
+
+    // Nothing new can have arrived since EPKTCNT read 0 unless the INT pin 
+    // fired.  Clear the flag before reading EPKTCNT so a packet arriving in 
+    // between sets it again.
+    Woken = IntPending;
+    if(Woken)
+        IntPending = FALSE;
+    else if(RxIdle && (TickGet() - LastRxPoll < ENC_INT_POLL_INTERVAL))
+        return FALSE;
+    LastRxPoll = TickGet();
+#endif
 
     // Test if at least one packet has been received and is waiting
     BankSel(EPKTCNT);
     PacketCount = ReadETHReg((BYTE)EPKTCNT).Val;
     BankSel(ERDPTL);
+#if defined(ENC_INT_IF)
+    // The pin may have fired for a link change alone, and when idle 
+    // LINKIF must be clear too or the pin stays low
+    if(Woken || PacketCount == 0u)
+        ServiceLinkChange();
+    RxIdle = (PacketCount == 0u);
+#endif
     if(PacketCount == 0u)
         return FALSE;
 
@@ -593,18 +1170,45 @@ BOOL MACGetHeader(MAC_ADDR *remote, BYTE* type)
     // Validate the data returned from the ENC28J60.  Random data corruption,
     // such as if a single SPI bit error occurs while communicating or a
     // momentary power glitch could cause this to occur in rare circumstances.
-    if(header.NextPacketPointer > RXSTOP || ((BYTE_VAL*)(&header.NextPacketPointer))->bits.b0 ||
-       header.StatusVector.bits.Zero ||
-       header.StatusVector.bits.CRCError ||
+    if(header.NextPacketPointer > RXSTOP || header.NextPacketPointer < RXSTART ||
+       ((BYTE_VAL*)(&header.NextPacketPointer))->bits.b0)
+    {
+        RXErrorStats.dwBadNextPointer++;
+        RecoverRx(FALSE);
+        return FALSE;
+    }
+    if(header.StatusVector.bits.Zero)
+    {
+        // The header was probably read from the wrong address
+        RXErrorStats.dwBadStatus++;
+        RecoverRx(FALSE);
+        return FALSE;
+    }
+    if(header.StatusVector.bits.CRCError ||
        header.StatusVector.bits.ByteCount > 1518u ||
        !header.StatusVector.bits.ReceiveOk)
     {
-        Reset();
+        if(header.StatusVector.bits.CRCError)
+            RXErrorStats.dwCRCError++;
+        else if(header.StatusVector.bits.ByteCount > 1518u)
+            RXErrorStats.dwTooLong++;
+        else
+            RXErrorStats.dwNotOk++;
+        NextPacketLocation.Val = header.NextPacketPointer;
+        RecoverRx(TRUE);
+        return FALSE;
     }
 
     // Save the location where the hardware will write the next packet to
     NextPacketLocation.Val = header.NextPacketPointer;
 
+    if(header.StatusVector.bits.Broadcast)
+        RXFilterStats.dwBroadcast++;
+    else if(header.StatusVector.bits.Multicast)
+        RXFilterStats.dwMulticast++;
+    else
+        RXFilterStats.dwUnicast++;
+
     // Return the Ethernet frame's Source MAC address field to the caller
     // This parameter is useful for replying to requests without requiring an
     // ARP cycle.
@@ -617,6 +1221,14 @@ BOOL MACGetHeader(MAC_ADDR *remote, BYTE* type)
     {
         *type = header.Type.v[0];
     }
+    else
+    {
+        RXFilterStats.dwUnknownType++;
+    }
+
+    // Keep the ARP pattern filter matching our current IP address
+    if((RXFilterProfile & MAC_RX_FILTER_ARP_BCAST) && (RXFilterIP.Val != AppConfig.MyIPAddr.Val))
+        MACSetRXFilter(RXFilterProfile);
 
     // Mark this packet as discardable
     WasDiscarded = FALSE;
@@ -624,6 +1236,155 @@ BOOL MACGetHeader(MAC_ADDR *remote, BYTE* type)
 }
 
 
+/******************************************************************************
+ * Function:        static void RecoverRx(BOOL NextPointerValid)
+ *
+ * PreCondition:    MACGetHeader() found a corrupt receive header
+ *
+ * Input:           NextPointerValid: TRUE if NextPacketLocation was loaded 
+ *                                    from the header and can be used to skip 
+ *                                    the frame
+ *
+ * Output:          None
+ *
+ * Side Effects:    Frames still in the RX buffer may be lost
+ *
+ * Overview:        Skips the frame, resets the RX buffer or re-initializes 
+ *                  the ENC28J60, cheapest first, instead of resetting the 
+ *                  PIC.  The re-initialization keeps the SPI clock and is 
+ *                  bounded, see ReinitENC().
+ *
+ * Note:            None
+ *****************************************************************************/
+static void RecoverRx(BOOL NextPointerValid)
+{
+    if(NextPointerValid)
+    {
+        WasDiscarded = FALSE;
+        MACDiscardRx();
+        RXErrorStats.dwFramesDropped++;
+        return;
+    }
+
+    if(TickGet() - LastResync < ENC_RX_RESYNC_WINDOW)
+        ResyncBurst++;
+    else
+        ResyncBurst = 0;
+    LastResync = TickGet();
+
+    if(ResyncBurst >= ENC_RX_RESYNC_LIMIT)
+    {
+        ResyncBurst = 0;
+        ReinitENC();
+        return;
+    }
+
+    RXErrorStats.dwRingResyncs++;
+    ResyncRxRing();
+}
+
+
+/******************************************************************************
+ * Function:        static void ResyncRxRing(void)
+ *
+ * PreCondition:    Bank 0 selected
+ *
+ * Input:           None
+ *
+ * Output:          None
+ *
+ * Side Effects:    All frames in the RX buffer are discarded
+ *
+ * Overview:        Resets the receive logic, empties the RX buffer and 
+ *                  restarts reception at RXSTART.
+ *
+ * Note:            None
+ *****************************************************************************/
+static void ResyncRxRing(void)
+{
+    BYTE i;
+
+    // The RX pointers can only be written with reception disabled
+    BFSReg(ECON1, ECON1_RXRST);
+    BFCReg(ECON1, ECON1_RXRST | ECON1_RXEN);
+
+    BankSel(EPKTCNT);
+    for(i = ReadETHReg((BYTE)EPKTCNT).Val; i != 0u; i--)
+        BFSReg(ECON2, ECON2_PKTDEC);
+    BankSel(ERDPTL);
+
+    // Writing ERXST also moves ERXWRPT back to the start of the buffer
+    WriteReg(ERXSTL, LOW(RXSTART));
+    WriteReg(ERXSTH, HIGH(RXSTART));
+    WriteReg(ERXRDPTL, LOW(RXSTOP));    // Write low byte first
+    WriteReg(ERXRDPTH, HIGH(RXSTOP));   // Write high byte last
+    WriteReg(ERXNDL, LOW(RXSTOP));
+    WriteReg(ERXNDH, HIGH(RXSTOP));
+    NextPacketLocation.Val = RXSTART;
+    WasDiscarded = TRUE;
+
+    BFSReg(ECON1, ECON1_RXEN);
+}
+
+
+/******************************************************************************
+ * Function:        static void ReinitENC(void)
+ *
+ * PreCondition:    MACInit() has run
+ *
+ * Input:           None
+ *
+ * Output:          None
+ *
+ * Side Effects:    All frames in the RX and TX buffers are discarded
+ *
+ * Overview:        Resets the ENC28J60 and writes its registers again at 
+ *                  the SPI clock MACInit() selected, without the SPI 
+ *                  self-test.  If it does not come out of reset, MACFailed 
+ *                  is set: MACGetHeader() returns FALSE and calls this 
+ *                  again every ENC_REINIT_RETRY.
+ *
+ * Note:            Takes at most about 2ms * ENC_RESET_ATTEMPTS.
+ *****************************************************************************/
+static void ReinitENC(void)
+{
+    LastReinit = TickGet();
+    RXErrorStats.dwMACResets++;
+    if(!ResetENC())
+    {
+        RXErrorStats.dwMACResetFailures++;
+        MACFailed = TRUE;
+#if defined(ENC_INT_IF)
+        LinkState = FALSE;
+#endif
+        return;
+    }
+    ConfigureENC();
+}
+
+
+/******************************************************************************
+ * Function:        void MACGetRXErrorStats(MAC_RX_ERROR_STATS *stats)
+ *
+ * PreCondition:    None
+ *
+ * Input:           stats: Location to copy the counters to
+ *
+ * Output:          None
+ *
+ * Side Effects:    None
+ *
+ * Overview:        Returns the corrupt receive header counters by failure 
+ *                  reason and by recovery taken.
+ *
+ * Note:            Not cleared by MACInit().
+ *****************************************************************************/
+void MACGetRXErrorStats(MAC_RX_ERROR_STATS *stats)
+{
+    memcpy((void*)stats, (void*)&RXErrorStats, sizeof(RXErrorStats));
+}
+
+
 /******************************************************************************
  * Function:        void MACPutHeader(MAC_ADDR *remote, BYTE type, WORD dataLen)
  *
@@ -1003,6 +1764,74 @@ WORD CalcIPBufferChecksum(WORD len)
 }
 
 
+/******************************************************************************
+ * Function:        WORD MACCalcTxChecksum(WORD len)
+ *
+ * PreCondition:    Read buffer pointer set to starting of checksum data in
+ *                  the TX buffer
+ *
+ * Input:           len: Total number of bytes to calculate the checksum over.
+ *
+ * Output:          16-bit checksum as defined by RFC 793, same as
+ *                  CalcIPBufferChecksum()
+ *
+ * Side Effects:    Reception is paused while the DMA engine runs
+ *
+ * Overview:        Checksums an assembled packet in the TX buffer with the
+ *                  DMA checksum engine instead of reading it back over SPI.
+ *                  Short lengths use CalcIPBufferChecksum().
+ *
+ * Note:            Silicon errata: a frame received while the DMA engine
+ *                  computes a checksum can be corrupted.  RXEN is cleared
+ *                  and any frame already in progress is allowed to finish
+ *                  before the engine is started, then RXEN is set again.  A
+ *                  frame that starts in those few microseconds is cleanly
+ *                  dropped instead of being corrupted.
+ *
+ *                  The read pointer is not moved.  Only for the TX buffer;
+ *                  the engine does not follow the RX ring wrap.
+ *****************************************************************************/
+WORD MACCalcTxChecksum(WORD len)
+{
+    WORD_VAL Start, End;
+    WORD_VAL Checksum;
+
+    if(len < ENC_DMA_CHECKSUM_MIN_LEN)
+        return CalcIPBufferChecksum(len);
+
+    Start.v[0] = ReadETHReg(ERDPTL).Val;
+    Start.v[1] = ReadETHReg(ERDPTH).Val;
+    End.Val = Start.Val + len - 1;
+
+    // Wait for any DMA copy still running (see MACMemCopyAsync())
+    while(ReadETHReg(ECON1).ECON1bits.DMAST);
+
+    WriteReg(EDMASTL, Start.v[0]);
+    WriteReg(EDMASTH, Start.v[1]);
+    WriteReg(EDMANDL, End.v[0]);
+    WriteReg(EDMANDH, End.v[1]);
+
+    // Errata workaround: no reception while the checksum engine runs
+    BFCReg(ECON1, ECON1_RXEN);
+    while(ReadETHReg(ESTAT).ESTATbits.RXBUSY);
+
+    BFSReg(ECON1, ECON1_CSUMEN | ECON1_DMAST);
+    while(ReadETHReg(ECON1).ECON1bits.DMAST);
+    BFCReg(ECON1, ECON1_CSUMEN);
+
+    BFSReg(ECON1, ECON1_RXEN);
+
+    // The engine leaves the complemented sum, EDMACSH goes on the wire first
+    Checksum.v[1] = ReadETHReg(EDMACSL).Val;
+    Checksum.v[0] = ReadETHReg(EDMACSH).Val;
+
+    MACChecksumOffloads++;
+    MACChecksumCyclesSaved += (DWORD)len*ENC_SW_CHECKSUM_CYCLES_PER_BYTE - ENC_DMA_CHECKSUM_CYCLES;
+
+    return Checksum.Val;
+}
+
+
 /******************************************************************************
  * Function:        void MACMemCopyAsync(PTR_BASE destAddr, PTR_BASE sourceAddr, WORD len)
  *
@@ -1140,7 +1969,7 @@ BYTE MACGet()
 {
     BYTE Result;
 
-    ENC_CS_IO = 0;
+    ENCSelect();
 	ClearSPIDoneFlag();
 
     #if defined(__C32__)
@@ -1251,7 +2080,7 @@ WORD MACGetArray(BYTE *val, WORD len)
     volatile BYTE Dummy;
 
     // Start the burst operation
-    ENC_CS_IO = 0;
+    ENCSelect();
     ClearSPIDoneFlag();
     ENC_SSPBUF = RBM;       // Send the Read Buffer Memory opcode.
     i = 0;
@@ -1290,27 +2119,39 @@ WORD MACGetArray(BYTE *val, WORD len)
     #elif defined(__C30__)
     {
         WORD_VAL wv;
+        BOOL bMore;
 
-        // Read the data, 2 bytes at a time, for as long as possible
+        // Read the data, 2 bytes at a time, for as long as possible.  The 
+        // next dummy WORD is queued in the transmit buffer while the current 
+        // one is shifting, so the clock runs without gaps.  The received 
+        // WORD must then be read before the queued one completes (16 SPI 
+        // clocks) or it is lost, so interrupts are held off for that window.
         if(len >= 2)
         {
             ENC_SPISTATbits.SPIEN = 0;
             ENC_SPICONbits.MODE16 = 1;
             ENC_SPISTATbits.SPIEN = 1;
-            while(1)
+            ENC_SSPBUF = 0x0000;        // Send a dummy WORD to generate 16 clocks
+            i += 2;
+            do
             {
-                ENC_SSPBUF = 0x0000;    // Send a dummy WORD to generate 32 clocks
-                i += 2;
-                WaitForDataByte();      // Wait until WORD is transmitted
+                __builtin_disi(0x3FFF);
+                bMore = (len - i >= 2);
+                if(bMore)
+                {
+                    while(ENC_SPISTATbits.SPITBF);  // Wait until the WORD in progress is shifting
+                    ENC_SSPBUF = 0x0000;            // Queue the next dummy WORD
+                    i += 2;
+                }
+                while(!ENC_SPISTATbits.SPIRBF);     // Wait until the WORD in progress is received
                 wv.Val = ENC_SSPBUF;
+                DISICNT = 0;
                 if(val)
                 {
                     *(++val) = wv.v[1];
                     *(++val) = wv.v[0];
                 }
-                if(len - i < 2)
-                    break;
-            };
+            } while(bMore);
             ENC_SPISTATbits.SPIEN = 0;
             ENC_SPICONbits.MODE16 = 0;
             ENC_SPISTATbits.SPIEN = 1;
@@ -1366,7 +2207,7 @@ void MACPut(BYTE val)
 {
     volatile BYTE Dummy;
 
-    ENC_CS_IO = 0;
+    ENCSelect();
     ClearSPIDoneFlag();
 
     #if defined(__C32__)
@@ -1461,7 +2302,7 @@ void MACPutArray(BYTE *val, WORD len)
     volatile BYTE Dummy;
 
     // Select the chip and send the proper opcode
-    ENC_CS_IO = 0;
+    ENCSelect();
     ClearSPIDoneFlag();
     ENC_SSPBUF = WBM;       // Send the Write Buffer Memory opcode
     WaitForDataByte();      // Wait until opcode/constant is transmitted.
@@ -1501,26 +2342,35 @@ void MACPutArray(BYTE *val, WORD len)
     {
         WORD_VAL wv;
 
-        // Send the data, 2 bytes at a time, for as long as possible
+        // Send the data, 2 bytes at a time, for as long as possible.  Each 
+        // WORD is queued in the transmit buffer as soon as the previous one 
+        // starts shifting, so the clock runs without gaps.  Received WORDs 
+        // are ignored (the overflow is cleared at the end).
         if(len >= 2)
         {
-            wv.v[1] = *val++;
-            wv.v[0] = *val++;
             ENC_SPISTATbits.SPIEN = 0;
             ENC_SPICONbits.MODE16 = 1;
             ENC_SPISTATbits.SPIEN = 1;
-            while(1)
+            do
             {
-                ENC_SSPBUF = wv.Val;        // Start sending the WORD
-                len -= 2;
-                if(len < 2)
-                    break;
                 wv.v[1] = *val++;
                 wv.v[0] = *val++;
-                WaitForDataByte();          // Wait until WORD is transmitted
-                Dummy = ENC_SSPBUF;
-            };
-            WaitForDataByte();              // Wait until WORD is transmitted
+                if(len < 4u)
+                    __builtin_disi(0x3FFF);     // Last WORD, see below
+                while(ENC_SPISTATbits.SPITBF);  // Wait for room in the transmit buffer
+                ENC_SSPBUF = wv.Val;            // Queue the WORD
+                len -= 2;
+            } while(len >= 2);
+
+            // Wait for the last WORD to finish.  Once it is shifting, discard 
+            // older received data so SPIRBF marks its completion.  Interrupts 
+            // are held off from before it was queued so it can't complete 
+            // unnoticed in between.
+            while(ENC_SPISTATbits.SPITBF);
+            Dummy = ENC_SSPBUF;
+            ENC_SPISTATbits.SPIROV = 0;
+            DISICNT = 0;
+            while(!ENC_SPISTATbits.SPIRBF);
             Dummy = ENC_SSPBUF;
             ENC_SPISTATbits.SPIEN = 0;
             ENC_SPICONbits.MODE16 = 0;
@@ -1603,7 +2453,7 @@ void MACPutROMArray(ROM BYTE *val, WORD len)
     volatile BYTE Dummy;
 
     // Select the chip and send the proper opcode
-    ENC_CS_IO = 0;
+    ENCSelect();
     ClearSPIDoneFlag();
     ENC_SSPBUF = WBM;       // Send the Write Buffer Memory opcode
     WaitForDataByte();      // Wait until opcode/constant is transmitted.
@@ -1657,7 +2507,7 @@ static void SendSystemReset(void)
     DelayMs(1);
 
     // Execute the System Reset command
-    ENC_CS_IO = 0;
+    ENCSelect();
     ClearSPIDoneFlag();
     ENC_SSPBUF = SR_CMD;
     WaitForDataByte();      // Wait until the command is transmitted.
@@ -1696,7 +2546,7 @@ static REG ReadETHReg(BYTE Address)
     REG r;
 
     // Select the chip and send the Read Control Register opcode/address
-    ENC_CS_IO = 0;
+    ENCSelect();
     ClearSPIDoneFlag();
     ENC_SSPBUF = RCR | Address;
 
@@ -1738,7 +2588,7 @@ static REG ReadMACReg(BYTE Address)
 {
     REG r;
 
-    ENC_CS_IO = 0;
+    ENCSelect();
     ClearSPIDoneFlag();
     ENC_SSPBUF = RCR | Address; // Send the Read Control Register opcode and
                                 //   address.
@@ -1830,7 +2680,7 @@ static void WriteReg(BYTE Address, BYTE Data)
 {
     volatile BYTE Dummy;
 
-    ENC_CS_IO = 0;
+    ENCSelect();
     ClearSPIDoneFlag();
 
     #if defined(__C32__)
@@ -1899,7 +2749,7 @@ static void BFCReg(BYTE Address, BYTE Data)
 {
     volatile BYTE Dummy;
 
-    ENC_CS_IO = 0;
+    ENCSelect();
     ClearSPIDoneFlag();
     ENC_SSPBUF = BFC | Address; // Send the opcode and address.
     WaitForDataByte();          // Wait until opcode/address is transmitted.
@@ -1937,7 +2787,7 @@ static void BFSReg(BYTE Address, BYTE Data)
 {
     volatile BYTE Dummy;
 
-    ENC_CS_IO = 0;
+    ENCSelect();
     ClearSPIDoneFlag();
     ENC_SSPBUF = BFS | Address; // Send the opcode and address.
     WaitForDataByte();          // Wait until opcode/address is transmitted.
@@ -2000,12 +2850,25 @@ void WritePHYReg(BYTE Register, WORD Data)
  * Overview:        BankSel takes the high byte of a register address and
  *                  changes the bank select bits in ETHCON1 to match.
  *
- * Note:            None
+ * Note:            The selected bank is cached in CurrentBank, so ECON1 must
+ *                  not be written with WriteReg() and the cache must be reset
+ *                  whenever the ENC28J60 is reset.
  *****************************************************************************/
 static void BankSel(WORD Register)
 {
-    BFCReg(ECON1, ECON1_BSEL1 | ECON1_BSEL0);
-    BFSReg(ECON1, ((WORD_VAL*)&Register)->v[1]);
+    BYTE Bank;
+
+    // Only touch the BSEL bits that differ from the bank already selected,
+    // which is nothing when returning to the current bank and a single
+    // transaction for most switches.
+    Bank = ((WORD_VAL*)&Register)->v[1];
+    if(Bank == CurrentBank)
+        return;
+    if(CurrentBank & ~Bank)
+        BFCReg(ECON1, CurrentBank & ~Bank);
+    if(Bank & ~CurrentBank)
+        BFSReg(ECON1, Bank & ~CurrentBank);
+    CurrentBank = Bank;
 }//end BankSel
 
 
@@ -2187,7 +3050,7 @@ BYTE GetCLKOUT(void)
  *					This function is intended to be used when 
  *					ERXFCON.ANDOR == 0 (OR).
  *****************************************************************************/
-#if defined(STACK_USE_ZEROCONF_MDNS_SD)
+#if defined(STACK_USE_ZEROCONF_MDNS_SD) || ((MAC_RX_FILTER_DEFAULT) & MAC_RX_FILTER_MCAST_HASH)
 void SetRXHashTableEntry(MAC_ADDR DestMACAddr)
 {
     DWORD_VAL CRC = {0xFFFFFFFF};
@@ -57,6 +57,28 @@
 
 #if defined(STACK_USE_ICMP_SERVER) || defined(STACK_USE_ICMP_CLIENT)
 
+// Echo reply waiting for the MAC, see ICMPTask()
+typedef struct
+{
+	NODE_INFO Remote;						// Requester
+	WORD wLen;								// ICMP header and data length
+	DWORD_VAL Header;						// Reply Type, Code and Checksum
+	BYTE Data[ICMP_ECHO_MAX_DATA];			// Identifier, sequence and payload
+} ICMP_ECHO_REPLY;
+
+static ICMP_ECHO_REPLY EchoQueue[ICMP_ECHO_QUEUE_DEPTH];
+static BYTE EchoQueueHead;					// Oldest queued reply
+static BYTE EchoQueueCount;
+
+// Token bucket limiting echo replies to ICMP_ECHO_RATE per second
+#define ICMP_ECHO_TOKEN_INTERVAL	((DWORD)(TICK_SECOND/ICMP_ECHO_RATE))
+static BYTE EchoTokensUsed;					// 0 = bucket full
+static DWORD dwEchoTokenTime;				// Time the last token was returned
+
+static ICMP_ECHO_STATS EchoStats;
+
+static BOOL ICMPEchoAdmit(void);
+
 #if defined(STACK_USE_ICMP_CLIENT)
 
 // ICMP Timeout Value
@@ -134,6 +156,7 @@ static enum
 void ICMPProcess(NODE_INFO *remote, WORD len)
 {
 	DWORD_VAL dwVal;
+	BYTE i;
 
     // Obtain the ICMP header Type, Code, and Checksum fields
     MACGetArray((BYTE*)&dwVal, sizeof(dwVal));
@@ -157,25 +180,50 @@ void ICMPProcess(NODE_INFO *remote, WORD len)
 			if(dwVal.v[3] == 0u)
 				dwVal.v[2]++;
 		}
+
+		if(!ICMPEchoAdmit())
+		{
+			EchoStats.dwRateLimited++;
+			return;
+		}
 	
-	    // Wait for TX hardware to become available (finish transmitting 
-	    // any previous packet)
-	    while(!IPIsTxReady());
-
-		// Position the write pointer for the next IPPutHeader operation
-		// NOTE: do not put this before the IPIsTxReady() call for WF compatbility
-	    MACSetWritePtr(BASE_TX_ADDR + sizeof(ETHER_HEADER));
-        	
-		// Create IP header in TX memory
-		IPPutHeader(remote, IP_PROT_ICMP, len);
-	
-		// Copy ICMP response into the TX memory
-		MACPutArray((BYTE*)&dwVal, sizeof(dwVal));
-		MACMemCopyAsync(-1, -1, len-4);
-		while(!MACIsMemCopyDone());
-	
-		// Transmit the echo reply packet
-	    MACFlush();
+	    // Reply straight from the RX buffer if the TX hardware is free and 
+	    // no older reply is waiting
+	    if(EchoQueueCount == 0u && IPIsTxReady())
+	    {
+			// Position the write pointer for the next IPPutHeader operation
+			// NOTE: do not put this before the IPIsTxReady() call for WF compatbility
+		    MACSetWritePtr(BASE_TX_ADDR + sizeof(ETHER_HEADER));
+	        	
+			// Create IP header in TX memory
+			IPPutHeader(remote, IP_PROT_ICMP, len);
+		
+			// Copy ICMP response into the TX memory
+			MACPutArray((BYTE*)&dwVal, sizeof(dwVal));
+			MACMemCopyAsync(-1, -1, len-4);
+			while(!MACIsMemCopyDone());
+		
+			// Transmit the echo reply packet
+		    MACFlush();
+			EchoStats.dwReplied++;
+			return;
+		}
+
+		// Keep a copy for ICMPTask() instead of waiting for the MAC
+		if(EchoQueueCount >= ICMP_ECHO_QUEUE_DEPTH || len < 4u || len-4 > ICMP_ECHO_MAX_DATA)
+		{
+			EchoStats.dwDropped++;
+			return;
+		}
+		i = EchoQueueHead + EchoQueueCount;
+		if(i >= ICMP_ECHO_QUEUE_DEPTH)
+			i -= ICMP_ECHO_QUEUE_DEPTH;
+		EchoQueue[i].Remote = *remote;
+		EchoQueue[i].wLen = len;
+		EchoQueue[i].Header.Val = dwVal.Val;
+		MACGetArray(EchoQueue[i].Data, len-4);
+		EchoQueueCount++;
+		EchoStats.dwDeferred++;
 	}
 #if defined(STACK_USE_ICMP_CLIENT)
 	else if(dwVal.w[0] == 0x0000u)	// See if this an ICMP Echo reply to our request
@@ -202,6 +250,102 @@ void ICMPProcess(NODE_INFO *remote, WORD len)
 #endif
 }
 
+/*********************************************************************
+ * Function:        void ICMPTask(void)
+ *
+ * PreCondition:    None
+ *
+ * Input:           None
+ *
+ * Output:          Sends the oldest queued echo reply if the MAC is 
+ *					free to transmit
+ *
+ * Side Effects:    None
+ *
+ * Overview:        None
+ *
+ * Note:            Called from StackTask() before new packets are 
+ *					received, so queued replies keep their order.
+ ********************************************************************/
+void ICMPTask(void)
+{
+	ICMP_ECHO_REPLY *Reply;
+
+	if(EchoQueueCount == 0u || !IPIsTxReady())
+		return;
+
+	Reply = &EchoQueue[EchoQueueHead];
+    MACSetWritePtr(BASE_TX_ADDR + sizeof(ETHER_HEADER));
+	IPPutHeader(&Reply->Remote, IP_PROT_ICMP, Reply->wLen);
+	MACPutArray((BYTE*)&Reply->Header, sizeof(Reply->Header));
+	MACPutArray(Reply->Data, Reply->wLen-4);
+    MACFlush();
+
+	if(++EchoQueueHead >= ICMP_ECHO_QUEUE_DEPTH)
+		EchoQueueHead = 0;
+	EchoQueueCount--;
+	EchoStats.dwReplied++;
+}
+
+/*********************************************************************
+ * Function:        static BOOL ICMPEchoAdmit(void)
+ *
+ * PreCondition:    None
+ *
+ * Input:           None
+ *
+ * Output:          TRUE if an echo request may be answered, FALSE if 
+ *					it is over the ICMP_ECHO_RATE limit
+ *
+ * Side Effects:    Takes a token from the bucket
+ *
+ * Overview:        One token is returned every ICMP_ECHO_TOKEN_INTERVAL, 
+ *					up to ICMP_ECHO_BURST.
+ *
+ * Note:            None
+ ********************************************************************/
+static BOOL ICMPEchoAdmit(void)
+{
+	DWORD dwTokens;
+
+	dwTokens = (TickGet() - dwEchoTokenTime) / ICMP_ECHO_TOKEN_INTERVAL;
+	if(dwTokens >= EchoTokensUsed)
+	{
+		EchoTokensUsed = 0;
+		dwEchoTokenTime = TickGet();
+	}
+	else
+	{
+		EchoTokensUsed -= (BYTE)dwTokens;
+		dwEchoTokenTime += dwTokens * ICMP_ECHO_TOKEN_INTERVAL;
+	}
+
+	if(EchoTokensUsed >= ICMP_ECHO_BURST)
+		return FALSE;
+	EchoTokensUsed++;
+	return TRUE;
+}
+
+/*********************************************************************
+ * Function:        void ICMPGetEchoStats(ICMP_ECHO_STATS *stats)
+ *
+ * PreCondition:    None
+ *
+ * Input:           stats: Location to copy the statistics to
+ *
+ * Output:          None
+ *
+ * Side Effects:    None
+ *
+ * Overview:        None
+ *
+ * Note:            Counted since reset.
+ ********************************************************************/
+void ICMPGetEchoStats(ICMP_ECHO_STATS *stats)
+{
+	memcpy((void*)stats, (void*)&EchoStats, sizeof(EchoStats));
+}
+
 #if defined(STACK_USE_ICMP_CLIENT)
 /*********************************************************************
  * Function:        void ICMPSendPing(DWORD dwRemoteIP)
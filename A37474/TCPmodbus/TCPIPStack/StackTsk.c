@@ -83,6 +83,9 @@ static SM_STACK smStack;
 
 NODE_INFO remoteNode;
 
+static STACK_TASK_STATS StackTaskStats;
+static void StackTaskDone(DWORD dwStart, WORD wPackets);
+
 #if defined (WF_CS_TRIS) && defined (STACK_USE_DHCP_CLIENT)
 BOOL g_DhcpRenew = FALSE;
 extern void SetDhcpProgressState(void);
@@ -109,6 +112,7 @@ void StackInit(void)
 {
 	static BOOL once = FALSE;
     smStack                     = SM_STACK_IDLE;
+	memset((void*)&StackTaskStats, 0x00, sizeof(StackTaskStats));
 
 #if defined(STACK_USE_IP_GLEANING) || defined(STACK_USE_DHCP_CLIENT)
     /*
@@ -209,6 +213,10 @@ void StackTask(void)
     IP_ADDR tempLocalIP;
 	BYTE cFrameType;
 	BYTE cIPFrameType;
+	DWORD dwStart;
+	WORD wPackets;
+
+	dwStart = TickGet();
 
    
     #if defined( WF_CS_TRIS )
@@ -295,6 +303,14 @@ void StackTask(void)
     AutoIPTasks();
     #endif
 
+	// Announce our address after link up or an IP address change
+	ARPTask();
+
+	#if defined(STACK_USE_ICMP_SERVER)
+	// Send echo replies deferred while the MAC was busy
+	ICMPTask();
+	#endif
+
 	#if defined(STACK_USE_TCP)
 	// Perform all TCP time related tasks (retransmit, send acknowledge, close connection, etc)
 	TCPTick();
@@ -305,9 +321,19 @@ void StackTask(void)
 	UDPTask();
 	#endif
 
-	// Process as many incomming packets as we can
-	while(1)
+	// Process incomming packets until the packet or time budget runs out
+	for(wPackets = 0; ; wPackets++)
 	{
+		// At least one packet is taken per call even if TCPTick() used up 
+		// the time budget
+		if(wPackets && (wPackets >= STACK_RX_PACKET_BUDGET || (TickGet() - dwStart) >= STACK_RX_TIME_BUDGET))
+		{
+			// Only a stop that leaves packets behind counts
+			if(MACIsRxPending())
+				StackTaskStats.dwBudgetHits++;
+			break;
+		}
+
 		//if using the random module, generate entropy
 		#if defined(STACK_USE_RANDOM)
 			RandomAdd(remoteNode.MACAddr.v[5]);
@@ -358,6 +384,10 @@ void StackTask(void)
 				if(!IPGetHeader(&tempLocalIP, &remoteNode, &cIPFrameType, &dataCount))
 					break;
 
+				#if defined(STACK_CLIENT_MODE)
+				ARPRefresh(&remoteNode);
+				#endif
+
 				#if defined(STACK_USE_ICMP_SERVER) || defined(STACK_USE_ICMP_CLIENT)
 				if(cIPFrameType == IP_PROT_ICMP)
 				{
@@ -405,13 +435,59 @@ void StackTask(void)
 				{
 					// Stop processing packets if we came upon a UDP frame with application data in it
 					if(UDPProcess(&remoteNode, &tempLocalIP, dataCount))
+					{
+						StackTaskDone(dwStart, wPackets+1);
 						return;
+					}
 				}
 				#endif
 
 				break;
 		}
 	}
+
+	StackTaskDone(dwStart, wPackets);
+}
+
+/*********************************************************************
+ * Function:        static void StackTaskDone(DWORD dwStart, WORD wPackets)
+ *
+ * PreCondition:    None
+ *
+ * Input:           dwStart: TickGet() at the start of StackTask()
+ *                  wPackets: Packets received by this call
+ *
+ * Output:          StackTaskStats maximums updated
+ *
+ * Side Effects:    None
+ *
+ * Note:            None
+ ********************************************************************/
+static void StackTaskDone(DWORD dwStart, WORD wPackets)
+{
+	dwStart = TickGet() - dwStart;
+	if(dwStart > StackTaskStats.dwMaxTicks)
+		StackTaskStats.dwMaxTicks = dwStart;
+	if(wPackets > StackTaskStats.wMaxPackets)
+		StackTaskStats.wMaxPackets = wPackets;
+}
+
+/*********************************************************************
+ * Function:        void StackGetTaskStats(STACK_TASK_STATS *stats)
+ *
+ * PreCondition:    None
+ *
+ * Input:           stats: Location to copy the statistics to
+ *
+ * Output:          None
+ *
+ * Side Effects:    None
+ *
+ * Note:            Maximums are kept since StackInit().
+ ********************************************************************/
+void StackGetTaskStats(STACK_TASK_STATS *stats)
+{
+	memcpy((void*)stats, (void*)&StackTaskStats, sizeof(StackTaskStats));
 }
 
 /*********************************************************************
@@ -72,6 +72,14 @@
 // End port for client sockets
 #define LOCAL_PORT_END_NUMBER   (5000u)
 
+// Number of hash buckets used to find the socket of a received segment, 
+// for connected sockets and again for listening sockets.  Power of 2.
+#define TCP_HASH_BUCKETS		(8u)
+
+// Longest time TCPTick() leaves a socket alone when none of its timers are 
+// running.  Only a safety net, every flag or timer change wakes the socket.
+#define TCP_TICK_MAX_IDLE		(TICK_SECOND)
+
 // For debugging only.  Normal applications should never enable these
 //#define DEBUG_GENERATE_TX_LOSS		62257
 //#define DEBUG_GENERATE_RX_LOSS		64225
@@ -243,8 +251,54 @@ static WORD NextPort __attribute__((persistent));	// Tracking variable for next
 	#endif
 #endif
 
-static TCB MyTCB;									// Currently loaded TCB
 static TCP_SOCKET hCurrentTCP = INVALID_SOCKET;		// Current TCP socket
+
+// Full TCBs are kept in a small write-back cache in PIC RAM, so switching 
+// between a few busy sockets doesn't copy TCBs to and from the Ethernet 
+// RAM each time.  MyTCB is the slot of the currently loaded TCB.
+#if !defined(TCP_TCB_CACHE_SIZE)
+	#define TCP_TCB_CACHE_SIZE	(1u)
+#endif
+static TCB TCBCache[TCP_TCB_CACHE_SIZE];				// Cached TCBs
+static TCP_SOCKET hTCBCacheOwner[TCP_TCB_CACHE_SIZE];	// Socket held in each slot, INVALID_SOCKET if empty
+static BYTE vTCBCacheOrder[TCP_TCB_CACHE_SIZE];		// Slot numbers, most recently used first
+static TCP_SOCKET hLastTCB = INVALID_SOCKET;			// Socket MyTCB belongs to
+static TCB *pMyTCB = &TCBCache[0];
+#define MyTCB		(*pMyTCB)							// Currently loaded TCB
+
+// Sockets are chained into hash buckets by remoteHash, so a received 
+// segment is matched without walking every socket.  Connected sockets use 
+// TCPHashHead[0..TCP_HASH_BUCKETS-1], listening sockets (remoteHash is the 
+// local port) the second half.  Closed sockets are in no chain.
+#define TCP_HASH_NONE		(0xFFu)
+static TCP_SOCKET TCPHashHead[TCP_HASH_BUCKETS*2];		// First socket in each bucket
+static TCP_SOCKET TCPHashNext[TCP_SOCKET_COUNT];		// Next socket in the same bucket
+static BYTE vTCPHashSlot[TCP_SOCKET_COUNT];			// Bucket each socket is chained in, or TCP_HASH_NONE
+
+DWORD TCBCacheHits;			// Socket switches that found the TCB in the cache
+DWORD TCBCacheMisses;		// Socket switches that loaded the TCB from its memory medium
+DWORD TCBCacheBytesSaved;	// TCB bytes not copied thanks to cache hits
+
+// TCPTick() only visits sockets that were woken or whose deadline passed.  
+// One bit per socket, so at most 16 sockets.
+static WORD TCPTickPending;							// Sockets woken since their last visit
+static DWORD TCPTickDeadline;						// Earliest of all TCPSocketDeadline[]
+static DWORD TCPSocketDeadline[TCP_SOCKET_COUNT];	// Next time each socket has a timer due
+
+// Marks the current socket for a visit on the next TCPTick()
+#define TCPTickWake()	(TCPTickPending |= (WORD)1 << hCurrentTCP)
+
+// Per-socket FIFO usage.  With TCP_FIFO_ADAPT_INTERVAL defined, TCPTick() 
+// re-balances one idle socket's TX/RX split per interval from these.
+static TCP_FIFO_STATS TCPFIFOStats[TCP_SOCKET_COUNT];
+#if defined(TCP_FIFO_ADAPT_INTERVAL)
+	#define TCP_FIFO_ADAPT_MARGIN		(16u)	// Bytes allowed above 1.25 * high water
+	#define TCP_FIFO_ADAPT_HYSTERESIS	(32u)	// Smallest TX size change worth a resize
+	static DWORD TCPFIFOAdaptTime;						// Time of the last re-balance
+	static TCP_SOCKET hTCPFIFOAdaptNext;				// Socket re-balanced next
+	static WORD wLastTXFull[TCP_SOCKET_COUNT];			// wTXFull at the previous re-balance
+	static WORD wLastRXZeroWindow[TCP_SOCKET_COUNT];	// wRXZeroWindow at the previous re-balance
+#endif
 #if TCP_SYN_QUEUE_MAX_ENTRIES
 	#if defined(__18CXX) && !defined(HI_TECH_C)	
 		#pragma udata SYN_QUEUE_RAM_SECT
@@ -261,6 +315,7 @@ static TCP_SOCKET hCurrentTCP = INVALID_SOCKET;		// Current TCP socket
   ***************************************************************************/
 
 static void TCPRAMCopy(PTR_BASE wDest, BYTE vDestType, PTR_BASE wSource, BYTE vSourceType, WORD wLength);
+static void TCPStartTXCopy(PTR_BASE ptrDest, PTR_BASE ptrSource, WORD wLength);
 
 #if defined(__18CXX)
 	static void TCPRAMCopyROM(PTR_BASE wDest, BYTE wDestType, ROM BYTE* wSource, WORD wLength);
@@ -274,6 +329,12 @@ static BOOL FindMatchingSocket(TCP_HEADER* h, NODE_INFO* remote);
 static void SwapTCPHeader(TCP_HEADER* header);
 static void CloseSocket(void);
 static void SyncTCB(void);
+static DWORD TCPNextDeadline(void);
+static void TCPHashUpdate(void);
+static void TCPFIFOWatermark(void);
+#if defined(TCP_FIFO_ADAPT_INTERVAL)
+static void TCPAdaptFIFOSize(TCP_SOCKET hTCP);
+#endif
 
 #if defined(WF_CS_TRIS)
 UINT16 WFGetTCBSize(void);
@@ -324,24 +385,49 @@ UINT16 WFGetTCBSize(void);
 
 
 
-// Flushes MyTCB cache and loads up the specified TCB.
-// Does nothing on cache hit.
+// Points MyTCB at the TCB of the current socket.
+// Does nothing if it is already loaded, uses the cached copy if there 
+// is one, else writes back the least recently used TCB and loads it.
 static void SyncTCB(void)
 {
-	static TCP_SOCKET hLastTCB = INVALID_SOCKET;
+	BYTE i;
+	BYTE vSlot;
+	TCP_SOCKET hEvicted;
 	
 	if(hLastTCB == hCurrentTCP)
 		return;
+	hLastTCB = hCurrentTCP;
+
+	// Find the TCB in the cache, the last slot in the order is the victim
+	for(i = 0; i < TCP_TCB_CACHE_SIZE - 1u; i++)
+	{
+		if(hTCBCacheOwner[vTCBCacheOrder[i]] == hCurrentTCP)
+			break;
+	}
+	vSlot = vTCBCacheOrder[i];
 
-	if(hLastTCB != INVALID_SOCKET)
+	// Make it the most recently used
+	for(; i; i--)
+		vTCBCacheOrder[i] = vTCBCacheOrder[i-1];
+	vTCBCacheOrder[0] = vSlot;
+	pMyTCB = &TCBCache[vSlot];
+
+	if(hTCBCacheOwner[vSlot] == hCurrentTCP)
 	{
-		// Save the current TCB
-		TCPRAMCopy(TCBStubs[hLastTCB].bufferTxStart - sizeof(MyTCB), TCBStubs[hLastTCB].vMemoryMedium, (PTR_BASE)&MyTCB, TCP_PIC_RAM, sizeof(MyTCB));
+		TCBCacheHits++;
+		TCBCacheBytesSaved += 2*sizeof(TCB);
+		return;
 	}
+	TCBCacheMisses++;
+
+	// Save the evicted TCB
+	hEvicted = hTCBCacheOwner[vSlot];
+	if(hEvicted != INVALID_SOCKET)
+		TCPRAMCopy(TCBStubs[hEvicted].bufferTxStart - sizeof(TCB), TCBStubs[hEvicted].vMemoryMedium, (PTR_BASE)pMyTCB, TCP_PIC_RAM, sizeof(TCB));
 
 	// Load up the new TCB
-	hLastTCB = hCurrentTCP;
-	TCPRAMCopy((PTR_BASE)&MyTCB, TCP_PIC_RAM, MyTCBStub.bufferTxStart - sizeof(MyTCB), MyTCBStub.vMemoryMedium, sizeof(MyTCB));
+	hTCBCacheOwner[vSlot] = hCurrentTCP;
+	TCPRAMCopy((PTR_BASE)pMyTCB, TCP_PIC_RAM, MyTCBStub.bufferTxStart - sizeof(TCB), MyTCBStub.vMemoryMedium, sizeof(TCB));
 }
 
 
@@ -402,6 +488,19 @@ void TCPInit(void)
 	#if TCP_SYN_QUEUE_MAX_ENTRIES
 		memset((void*)SYNQueue, 0x00, sizeof(SYNQueue));
 	#endif
+
+	// Empty the TCB cache
+	for(i = 0; i < TCP_TCB_CACHE_SIZE; i++)
+	{
+		hTCBCacheOwner[i] = INVALID_SOCKET;
+		vTCBCacheOrder[i] = i;
+	}
+	hLastTCB = INVALID_SOCKET;
+
+	// Empty the socket hash
+	memset((void*)TCPHashHead, INVALID_SOCKET, sizeof(TCPHashHead));
+	memset((void*)vTCPHashSlot, TCP_HASH_NONE, sizeof(vTCPHashSlot));
+	memset((void*)TCPFIFOStats, 0x00, sizeof(TCPFIFOStats));
 	
 	// Allocate all socket FIFO addresses
 	vSocketsAllocated = 0;
@@ -460,6 +559,8 @@ void TCPInit(void)
 		MyTCBStub.bufferEnd		= MyTCBStub.bufferRxStart + wRXSize;
 		MyTCBStub.smState		= TCP_CLOSED;
 		MyTCBStub.Flags.bServer	= FALSE;
+		MyTCBStub.Flags.bNoDelay = FALSE;
+		MyTCBStub.Flags.bQuickACK = FALSE;
 		#if defined(STACK_USE_SSL)
 		MyTCBStub.sslStubID = SSL_INVALID_ID;
 		#endif		
@@ -614,6 +715,8 @@ TCP_SOCKET TCPOpen(DWORD dwRemoteHost, BYTE vRemoteHostType, WORD wPort, BYTE vS
 		// option is received from remote node)
 		MyTCB.wRemoteMSS = 536;
 
+		TCPTickWake();
+
 		// See if this is a server socket
 		if(vRemoteHostType == TCP_OPEN_SERVER)
 		{
@@ -680,6 +783,7 @@ TCP_SOCKET TCPOpen(DWORD dwRemoteHost, BYTE vRemoteHostType, WORD wPort, BYTE vS
 			#endif
 		}
 		
+		TCPHashUpdate();
 		return hTCP;		
 	}
 
@@ -912,6 +1016,7 @@ void TCPDisconnect(TCP_SOCKET hTCP)
 
 		case TCP_CLOSED_BUT_RESERVED:
 			MyTCBStub.smState = TCP_CLOSED;
+			TCPHashUpdate();
 			break;
 
 		// These states will close themselves after some delay, however, 
@@ -966,9 +1071,59 @@ void TCPClose(TCP_SOCKET hTCP)
     
 	SyncTCBStub(hTCP);
 	MyTCBStub.Flags.bServer = FALSE;
+	MyTCBStub.Flags.bNoDelay = FALSE;
+	MyTCBStub.Flags.bQuickACK = FALSE;
 	TCPDisconnect(hTCP);
 }
 
+/*****************************************************************************
+  Function:
+	BOOL TCPSetOptions(TCP_SOCKET hTCP, BYTE vOptions)
+
+  Summary:
+	Sets the latency options of a socket.
+
+  Description:
+	Request/response protocols pay the automatic transmit delay on every 
+	response and the delayed ACK timeout on every request that gets no 
+	quick reply.  These options remove both delays for one socket:
+	
+	TCP_OPTION_NODELAY - Data written with TCPPut() and friends is sent 
+		on the next TCPTick(), i.e. at the end of the current pass through 
+		the application, instead of after TCP_AUTO_TRANSMIT_TIMEOUT_VAL.  
+		Everything written during one pass still goes out in one segment.
+	TCP_OPTION_QUICKACK - Received data is acknowledged on the next 
+		TCPTick() instead of after TCP_DELAYED_ACK_TIMEOUT.  A response 
+		sent before then carries the ACK, so no separate ACK segment is 
+		sent.
+
+	The options stay set while a server socket returns to listening and 
+	are cleared by TCPClose().
+
+  Precondition:
+	TCP is initialized.
+
+  Parameters:
+	hTCP		- The socket to be configured
+	vOptions	- Any combination of TCP_OPTION_NODELAY and 
+				  TCP_OPTION_QUICKACK, 0 restores the default delays
+
+  Return Values:
+	TRUE - The options were set
+	FALSE - The socket is invalid
+  ***************************************************************************/
+BOOL TCPSetOptions(TCP_SOCKET hTCP, BYTE vOptions)
+{
+	if(hTCP >= TCP_SOCKET_COUNT)
+		return FALSE;
+
+	SyncTCBStub(hTCP);
+	MyTCBStub.Flags.bNoDelay = (vOptions & TCP_OPTION_NODELAY) != 0u;
+	MyTCBStub.Flags.bQuickACK = (vOptions & TCP_OPTION_QUICKACK) != 0u;
+
+	return TRUE;
+}
+
 
 /*****************************************************************************
   Function:
@@ -1160,7 +1315,10 @@ BOOL TCPPut(TCP_SOCKET hTCP, BYTE byte)
 
 	wFreeTXSpace = TCPIsPutReady(hTCP);
 	if(wFreeTXSpace == 0u)
+	{
+		TCPFIFOStats[hTCP].wTXFull++;
 		return FALSE;
+	}
 	else if(wFreeTXSpace == 1u) // About to run out of space, lets transmit so the remote node might send an ACK back faster
 		TCPFlush(hTCP);	
 
@@ -1193,6 +1351,8 @@ BOOL TCPPut(TCP_SOCKET hTCP, BYTE byte)
 	#endif
 	
 
+	TCPFIFOWatermark();
+
 	// Send the last byte as a separate packet (likely will make the remote node send back ACK faster)
 	if(wFreeTXSpace == 1u)
 	{
@@ -1204,7 +1364,8 @@ BOOL TCPPut(TCP_SOCKET hTCP, BYTE byte)
 	else if(!MyTCBStub.Flags.bTimer2Enabled)
 	{
 		MyTCBStub.Flags.bTimer2Enabled = TRUE;
-		MyTCBStub.eventTime2 = (WORD)TickGetDiv256() + TCP_AUTO_TRANSMIT_TIMEOUT_VAL/256ull;
+		MyTCBStub.eventTime2 = TickGetDiv256Word() + (MyTCBStub.Flags.bNoDelay ? 0 : TCP_AUTO_TRANSMIT_TIMEOUT_VAL/256ull);
+		TCPTickWake();
 	}
 
 	return TRUE;
@@ -1245,6 +1406,7 @@ WORD TCPPutArray(TCP_SOCKET hTCP, BYTE* data, WORD len)
 	wFreeTXSpace = TCPIsPutReady(hTCP);
 	if(wFreeTXSpace == 0u)
 	{
+		TCPFIFOStats[hTCP].wTXFull++;
 		TCPFlush(hTCP);
 		return 0;
 	}
@@ -1308,6 +1470,10 @@ WORD TCPPutArray(TCP_SOCKET hTCP, BYTE* data, WORD len)
 	MyTCBStub.txHead += wActualLen;
 	#endif
 
+	TCPFIFOWatermark();
+	if(wFreeTXSpace < len)
+		TCPFIFOStats[hTCP].wTXFull++;
+
 	// Send these bytes right now if we are out of TX buffer space
 	if(wFreeTXSpace <= len)
 	{
@@ -1319,7 +1485,8 @@ WORD TCPPutArray(TCP_SOCKET hTCP, BYTE* data, WORD len)
 	else if(!MyTCBStub.Flags.bTimer2Enabled)
 	{
 		MyTCBStub.Flags.bTimer2Enabled = TRUE;
-		MyTCBStub.eventTime2 = (WORD)TickGetDiv256() + TCP_AUTO_TRANSMIT_TIMEOUT_VAL/256ull;
+		MyTCBStub.eventTime2 = TickGetDiv256Word() + (MyTCBStub.Flags.bNoDelay ? 0 : TCP_AUTO_TRANSMIT_TIMEOUT_VAL/256ull);
+		TCPTickWake();
 	}
 
 	return wActualLen + wRightLen;
@@ -1438,7 +1605,8 @@ WORD TCPPutROMArray(TCP_SOCKET hTCP, ROM BYTE* data, WORD len)
 	else if(!MyTCBStub.Flags.bTimer2Enabled)
 	{
 		MyTCBStub.Flags.bTimer2Enabled = TRUE;
-		MyTCBStub.eventTime2 = (WORD)TickGetDiv256() + TCP_AUTO_TRANSMIT_TIMEOUT_VAL/256ull;
+		MyTCBStub.eventTime2 = TickGetDiv256Word() + (MyTCBStub.Flags.bNoDelay ? 0 : TCP_AUTO_TRANSMIT_TIMEOUT_VAL/256ull);
+		TCPTickWake();
 	}
 
 	return wActualLen + wRightLen;
@@ -1670,8 +1838,9 @@ BOOL TCPGet(TCP_SOCKET hTCP, BYTE* byte)
 	else if(!MyTCBStub.Flags.bTimer2Enabled)
 	{
 		MyTCBStub.Flags.bTimer2Enabled = TRUE;
-		MyTCBStub.eventTime2 = (WORD)TickGetDiv256() + TCP_WINDOW_UPDATE_TIMEOUT_VAL/256ull;
+		MyTCBStub.eventTime2 = TickGetDiv256Word() + TCP_WINDOW_UPDATE_TIMEOUT_VAL/256ull;
 	}
+	TCPTickWake();
 
 
 	return TRUE;
@@ -1742,8 +1911,9 @@ WORD TCPGetArray(TCP_SOCKET hTCP, BYTE* buffer, WORD len)
 	// update will get sent to the remote node at some point
 	{
 		MyTCBStub.Flags.bTimer2Enabled = TRUE;
-		MyTCBStub.eventTime2 = (WORD)TickGetDiv256() + TCP_WINDOW_UPDATE_TIMEOUT_VAL/256ull;
+		MyTCBStub.eventTime2 = TickGetDiv256Word() + TCP_WINDOW_UPDATE_TIMEOUT_VAL/256ull;
 	}
+	TCPTickWake();
 
 	return len;
 }
@@ -2337,9 +2507,10 @@ WORD TCPFindEx(TCP_SOCKET hTCP, BYTE cFind, WORD wStart, WORD wSearchLen, BOOL b
   	Performs periodic TCP tasks.
 
   Description:
-	This function performs any required periodic TCP tasks.  Each 
-	socket's state machine is checked, and any elapsed timeout periods
-	are handled.
+	This function performs any required periodic TCP tasks.  Only sockets 
+	that were woken (TCPTickWake()) or have a timer due are checked, and 
+	any elapsed timeout periods are handled.  When nothing is due it 
+	returns after one comparison, regardless of the number of sockets.
 
   Precondition:
 	TCP is initialized.
@@ -2357,10 +2528,40 @@ void TCPTick(void)
 	BOOL bCloseSocket;
 	BYTE vFlags;
 	WORD w;
+	WORD wVisited;
+	DWORD dwNow;
+
+	dwNow = TickGet();
+
+	// Re-balance one socket's FIFOs per interval
+	#if defined(TCP_FIFO_ADAPT_INTERVAL)
+	if(dwNow - TCPFIFOAdaptTime >= TCP_FIFO_ADAPT_INTERVAL)
+	{
+		TCPFIFOAdaptTime = dwNow;
+		TCPAdaptFIFOSize(hTCPFIFOAdaptNext);
+		if(++hTCPFIFOAdaptNext >= TCP_SOCKET_COUNT)
+			hTCPFIFOAdaptNext = 0;
+	}
+	#endif
 
-	// Periodically all "not closed" sockets must perform timed operations
+	// Nothing to do until a socket is woken, the earliest deadline passes or 
+	// a queued SYN needs to be serviced or timed out
+	if((TCPTickPending == 0u) && ((LONG)(dwNow - TCPTickDeadline) < (LONG)0))
+	{
+		#if TCP_SYN_QUEUE_MAX_ENTRIES
+		if(SYNQueue[0].wDestPort == 0u)
+		#endif
+			return;
+	}
+
+	// Sockets that were woken or have a timer due must perform timed operations
+	wVisited = 0;
 	for(hTCP = 0; hTCP < TCP_SOCKET_COUNT; hTCP++)
 	{
+		if(!(TCPTickPending & ((WORD)1 << hTCP)) && ((LONG)(dwNow - TCPSocketDeadline[hTCP]) < (LONG)0))
+			continue;
+		wVisited |= (WORD)1 << hTCP;
+
 		SyncTCBStub(hTCP);
 		
 		// Handle any SSL Processing and Message Transmission
@@ -2398,7 +2599,7 @@ void TCPTick(void)
 		if(MyTCBStub.Flags.bTimer2Enabled)
 		{
 			// See if the timeout has occured, and we need to send a new window update and pending data
-			if((SHORT)(MyTCBStub.eventTime2 - (WORD)TickGetDiv256()) <= (SHORT)0)
+			if((SHORT)(MyTCBStub.eventTime2 - TickGetDiv256Word()) <= (SHORT)0)
 				vFlags = ACK;
 		}
 
@@ -2406,7 +2607,7 @@ void TCPTick(void)
 		if(MyTCBStub.Flags.bDelayedACKTimerEnabled)
 		{
 			// See if the timeout has occured and delayed ACK needs to be sent
-			if((SHORT)(MyTCBStub.OverlappedTimers.delayedACKTime - (WORD)TickGetDiv256()) <= (SHORT)0)
+			if((SHORT)(MyTCBStub.OverlappedTimers.delayedACKTime - TickGetDiv256Word()) <= (SHORT)0)
 				vFlags = ACK;
 		}
 		
@@ -2415,7 +2616,7 @@ void TCPTick(void)
 		{
 			// Automatically close the socket on our end if the application 
 			// fails to call TCPDisconnect() is a reasonable amount of time.
-			if((SHORT)(MyTCBStub.OverlappedTimers.closeWaitTime - (WORD)TickGetDiv256()) <= (SHORT)0)
+			if((SHORT)(MyTCBStub.OverlappedTimers.closeWaitTime - TickGetDiv256Word()) <= (SHORT)0)
 			{
 				vFlags = FIN | ACK;
 				MyTCBStub.smState = TCP_LAST_ACK;
@@ -2455,6 +2656,7 @@ void TCPTick(void)
 						MyTCBStub.remoteHash.Val = (MyTCB.remote.niRemoteMACIP.IPAddr.w[1] + MyTCB.remote.niRemoteMACIP.IPAddr.w[0] + MyTCB.remotePort.Val) ^ MyTCB.localPort.Val;
 						vFlags = SYN | ACK;
 						MyTCBStub.smState = TCP_SYN_RECEIVED;
+						TCPHashUpdate();
 						
 						// Delete this SYN from the SYNQueue and compact the SYNQueue[] array
 						TCPRAMCopy((PTR_BASE)&SYNQueue[w], TCP_PIC_RAM, (PTR_BASE)&SYNQueue[w+1], TCP_PIC_RAM, (TCP_SYN_QUEUE_MAX_ENTRIES-1u-w)*sizeof(TCP_SYN_QUEUE));
@@ -2499,7 +2701,10 @@ void TCPTick(void)
 						// The application must call TCPDisconnect() with the handle to free this 
 						// socket (and the handle associated with it)
 						if(!vFlags)
+						{
 							MyTCBStub.smState = TCP_CLOSED_BUT_RESERVED;
+							TCPHashUpdate();
+						}
 						
 						continue;
 					}
@@ -2555,6 +2760,7 @@ void TCPTick(void)
 						MyTCB.remote.niRemoteMACIP.IPAddr.Val = ipResolvedDNSIP.Val;
 						MyTCBStub.smState = TCP_GATEWAY_SEND_ARP;
 						MyTCBStub.remoteHash.Val = (MyTCB.remote.niRemoteMACIP.IPAddr.w[1]+MyTCB.remote.niRemoteMACIP.IPAddr.w[0] + MyTCB.remotePort.Val) ^ MyTCB.localPort.Val;
+						TCPHashUpdate();
 						MyTCB.retryCount = 0;
 						MyTCB.retryInterval = (TICK_SECOND/4)/256;
 					}
@@ -2570,7 +2776,7 @@ void TCPTick(void)
 				
 			case TCP_GATEWAY_SEND_ARP:
 				// Obtain the MAC address associated with the server's IP address (either direct MAC address on same subnet, or the MAC address of the Gateway machine)
-				MyTCBStub.eventTime2 = (WORD)TickGetDiv256();
+				MyTCBStub.eventTime2 = TickGetDiv256Word();
 				ARPResolve(&MyTCB.remote.niRemoteMACIP.IPAddr);
 				MyTCBStub.smState = TCP_GATEWAY_GET_ARP;
 				break;
@@ -2583,7 +2789,7 @@ void TCPTick(void)
 					// Note that this will continuously send out ARP 
 					// requests for an infinite time if the Gateway 
 					// never responds
-					if((WORD)TickGetDiv256() - MyTCBStub.eventTime2 > (WORD)MyTCB.retryInterval)
+					if(TickGetDiv256Word() - MyTCBStub.eventTime2 > (WORD)MyTCB.retryInterval)
 					{
 						// Exponentially increase timeout until we reach 6 attempts then stay constant
 						if(MyTCB.retryCount < 6u)
@@ -2769,7 +2975,7 @@ void TCPTick(void)
 				break;
 			
 			// See if this SYN has timed out
-			if((WORD)TickGetDiv256() - SYNQueue[w].wTimestamp > (WORD)(TCP_SYN_QUEUE_TIMEOUT/256ull))
+			if(TickGetDiv256Word() - SYNQueue[w].wTimestamp > (WORD)(TCP_SYN_QUEUE_TIMEOUT/256ull))
 			{
 				// Delete this SYN from the SYNQueue and compact the SYNQueue[] array
 				TCPRAMCopy((PTR_BASE)&SYNQueue[w], TCP_PIC_RAM, (PTR_BASE)&SYNQueue[w+1], TCP_PIC_RAM, (TCP_SYN_QUEUE_MAX_ENTRIES-1u-w)*sizeof(TCP_SYN_QUEUE));
@@ -2781,6 +2987,105 @@ void TCPTick(void)
 			}
 		}
 	#endif
+
+	// Work out when the visited sockets are due next.  Sockets woken while 
+	// the others were handled keep their pending bit for the next call.
+	TCPTickPending &= ~wVisited;
+	TCPTickDeadline = TickGet() + TCP_TICK_MAX_IDLE;
+	for(hTCP = 0; hTCP < TCP_SOCKET_COUNT; hTCP++)
+	{
+		if(wVisited & ((WORD)1 << hTCP))
+		{
+			SyncTCBStub(hTCP);
+			TCPSocketDeadline[hTCP] = TCPNextDeadline();
+		}
+
+		if((LONG)(TCPSocketDeadline[hTCP] - TCPTickDeadline) < (LONG)0)
+			TCPTickDeadline = TCPSocketDeadline[hTCP];
+	}
+}
+
+/*****************************************************************************
+  Function:
+	static DWORD TCPNextDeadline(void)
+
+  Summary:
+	Finds the next time TCPTick() has to visit the current socket.
+
+  Description:
+	Converts the current socket's flags and timers into one TickGet() 
+	deadline: now if a transmission or a queued SYN is waiting, else the 
+	earliest of the retransmit/keep-alive, timer2, delayed ACK and close 
+	wait timers, but no later than TCP_TICK_MAX_IDLE.
+
+  Precondition:
+	SyncTCBStub() was called for the socket.
+
+  Parameters:
+	None
+
+  Returns:
+	The deadline in TickGet() units
+  ***************************************************************************/
+static DWORD TCPNextDeadline(void)
+{
+	DWORD dwNow;
+	DWORD dwDeadline;
+	WORD wNow256;
+	WORD wTimes[3];
+	BYTE vTimers;
+	SHORT sRemaining;
+
+	dwNow = TickGet();
+
+	#if defined(STACK_USE_SSL)
+	// SSL records and messages are handled in every TCPTick() call
+	if(MyTCBStub.sslStubID != SSL_INVALID_ID)
+		return dwNow;
+	#endif
+
+	if(MyTCBStub.Flags.bTXASAP || MyTCBStub.Flags.bTXASAPWithoutTimerReset)
+		return dwNow;
+
+	#if TCP_SYN_QUEUE_MAX_ENTRIES
+	if((MyTCBStub.smState == TCP_LISTEN) && (SYNQueue[0].wDestPort != 0u))
+		return dwNow;
+	#endif
+
+	dwDeadline = dwNow + TCP_TICK_MAX_IDLE;
+
+	// Retransmit, state and keep-alive timer, in TickGet() units
+	#if defined(TCP_KEEP_ALIVE_TIMEOUT)
+	if(MyTCBStub.Flags.bTimerEnabled || (MyTCBStub.smState == TCP_ESTABLISHED))
+	#else
+	if(MyTCBStub.Flags.bTimerEnabled)
+	#endif
+	{
+		if((LONG)(MyTCBStub.eventTime - dwDeadline) < (LONG)0)
+			dwDeadline = MyTCBStub.eventTime;
+	}
+
+	// The other timers count TickGetDiv256() units
+	vTimers = 0;
+	if(MyTCBStub.Flags.bTimer2Enabled)
+		wTimes[vTimers++] = MyTCBStub.eventTime2;
+	if(MyTCBStub.Flags.bDelayedACKTimerEnabled)
+		wTimes[vTimers++] = MyTCBStub.OverlappedTimers.delayedACKTime;
+	if(MyTCBStub.smState == TCP_CLOSE_WAIT)
+		wTimes[vTimers++] = MyTCBStub.OverlappedTimers.closeWaitTime;
+
+	wNow256 = TickGetDiv256Word();
+	while(vTimers)
+	{
+		sRemaining = (SHORT)(wTimes[--vTimers] - wNow256);
+		if(sRemaining <= (SHORT)0)
+			return dwNow;
+
+		if((LONG)(dwNow + ((DWORD)sRemaining << 8) - dwDeadline) < (LONG)0)
+			dwDeadline = dwNow + ((DWORD)sRemaining << 8);
+	}
+
+	return dwDeadline;
 }
 
 
@@ -2871,6 +3176,7 @@ BOOL TCPProcess(NODE_INFO* remote, IP_ADDR* localIP, WORD len)
 		#endif
 		
 		HandleTCPSeg(&TCPHeader, len);
+		TCPFIFOWatermark();
 		
 		#if defined(STACK_USE_SSL)
 		if(MyTCBStub.sslStubID != SSL_INVALID_ID)
@@ -2935,6 +3241,9 @@ static void SendTCP(BYTE vTCPFlags, BYTE vSendFlags)
 	
 	SyncTCB();
 
+	// Flags and timers change below, TCPTick() works out the new deadline
+	TCPTickWake();
+
 	// FINs must be handled specially
 	if(vTCPFlags & FIN)
 	{
@@ -2982,7 +3291,7 @@ static void SendTCP(BYTE vTCPFlags, BYTE vSendFlags)
 			}
 
 			// Copy application data into the raw TX buffer
-			TCPRAMCopy(BASE_TX_ADDR+sizeof(ETHER_HEADER)+sizeof(IP_HEADER)+sizeof(TCP_HEADER), TCP_ETH_RAM, MyTCB.txUnackedTail, MyTCBStub.vMemoryMedium, len);
+			TCPStartTXCopy(BASE_TX_ADDR+sizeof(ETHER_HEADER)+sizeof(IP_HEADER)+sizeof(TCP_HEADER), MyTCB.txUnackedTail, len);
 			MyTCB.txUnackedTail += len;
 		}
 		else
@@ -3003,13 +3312,13 @@ static void SendTCP(BYTE vTCPFlags, BYTE vSendFlags)
 				pseudoHeader.Length = len;
 
 			// Copy application data into the raw TX buffer
-			TCPRAMCopy(BASE_TX_ADDR+sizeof(ETHER_HEADER)+sizeof(IP_HEADER)+sizeof(TCP_HEADER), TCP_ETH_RAM, MyTCB.txUnackedTail, MyTCBStub.vMemoryMedium, pseudoHeader.Length);
+			TCPStartTXCopy(BASE_TX_ADDR+sizeof(ETHER_HEADER)+sizeof(IP_HEADER)+sizeof(TCP_HEADER), MyTCB.txUnackedTail, pseudoHeader.Length);
 			pseudoHeader.Length = len - pseudoHeader.Length;
 	
 			// Copy any left over chunks of application data over
 			if(pseudoHeader.Length)
 			{
-				TCPRAMCopy(BASE_TX_ADDR+sizeof(ETHER_HEADER)+sizeof(IP_HEADER)+sizeof(TCP_HEADER)+(MyTCBStub.bufferRxStart-MyTCB.txUnackedTail), TCP_ETH_RAM, MyTCBStub.bufferTxStart, MyTCBStub.vMemoryMedium, pseudoHeader.Length);
+				TCPStartTXCopy(BASE_TX_ADDR+sizeof(ETHER_HEADER)+sizeof(IP_HEADER)+sizeof(TCP_HEADER)+(MyTCBStub.bufferRxStart-MyTCB.txUnackedTail), MyTCBStub.bufferTxStart, pseudoHeader.Length);
 			}
 
 			MyTCB.txUnackedTail += len;
@@ -3116,6 +3425,8 @@ static void SendTCP(BYTE vTCPFlags, BYTE vSendFlags)
 		header.Window = (MyTCBStub.bufferEnd - MyTCBStub.bufferRxStart) - (MyTCBStub.rxHead - MyTCBStub.rxTail);
 	else
 		header.Window = MyTCBStub.rxTail - MyTCBStub.rxHead - 1;
+	if(header.Window == 0u)
+		TCPFIFOStats[hCurrentTCP].wRXZeroWindow++;
 
 	// Calculate the amount of free space in the MAC RX buffer area and adjust window if needed
 	wVal.Val = MACGetFreeRxSize();
@@ -3159,6 +3470,9 @@ static void SendTCP(BYTE vTCPFlags, BYTE vSendFlags)
 	SwapPseudoHeader(pseudoHeader);
 	header.Checksum = ~CalcIPChecksum((BYTE*)&pseudoHeader, sizeof(pseudoHeader));
 
+	// The payload copy must be finished before the TX buffer is accessed
+	while(!MACIsMemCopyDone());
+
 	// Write IP header
 	MACSetWritePtr(BASE_TX_ADDR + sizeof(ETHER_HEADER));
 	IPPutHeader(&MyTCB.remote.niRemoteMACIP, IP_PROT_TCP, len);
@@ -3168,7 +3482,7 @@ static void SendTCP(BYTE vTCPFlags, BYTE vSendFlags)
 
 	// Update the TCP checksum
 	MACSetReadPtr(BASE_TX_ADDR + sizeof(ETHER_HEADER) + sizeof(IP_HEADER));
-	wVal.Val = CalcIPBufferChecksum(len);
+	wVal.Val = MACCalcTxChecksum(len);
 #if defined(DEBUG_GENERATE_TX_LOSS)
 	// Damage TCP checksums on TX packets randomly
 	if(LFSRRand() > DEBUG_GENERATE_TX_LOSS)
@@ -3220,31 +3534,13 @@ static BOOL FindMatchingSocket(TCP_HEADER* h, NODE_INFO* remote)
 	partialMatch = INVALID_SOCKET;
 	hash = (remote->IPAddr.w[1]+remote->IPAddr.w[0] + h->SourcePort) ^ h->DestPort;
 
-	// Loop through all sockets looking for a socket that is expecting this 
-	// packet or can handle it.
-	for(hTCP = 0; hTCP < TCP_SOCKET_COUNT; hTCP++ )
+	// Walk the connected sockets with this hash bucket looking for the 
+	// socket that is expecting this packet
+	for(hTCP = TCPHashHead[hash & (TCP_HASH_BUCKETS-1)]; hTCP != INVALID_SOCKET; hTCP = TCPHashNext[hTCP])
 	{
 		SyncTCBStub(hTCP);
 
-		if(MyTCBStub.smState == TCP_CLOSED)
-		{
-			continue;
-		}
-		else if(MyTCBStub.smState == TCP_LISTEN)
-		{// For listening ports, check if this is the correct port
-			if(MyTCBStub.remoteHash.Val == h->DestPort)
-				partialMatch = hTCP;
-			
-			#if defined(STACK_USE_SSL_SERVER)
-			// Check the SSL port as well for SSL Servers
-			// 0 is defined as an invalid port number
-			if(MyTCBStub.sslTxHead == h->DestPort)
-				partialMatch = hTCP;
-			#endif
-			
-			continue;
-		}
-		else if(MyTCBStub.remoteHash.Val != hash)
+		if(MyTCBStub.remoteHash.Val != hash)
 		{// Ignore if the hash doesn't match
 			continue;
 		}
@@ -3258,6 +3554,32 @@ static BOOL FindMatchingSocket(TCP_HEADER* h, NODE_INFO* remote)
 		}
 	}
 
+	// Otherwise look for a socket listening on the destination port
+	for(hTCP = TCPHashHead[TCP_HASH_BUCKETS + (h->DestPort & (TCP_HASH_BUCKETS-1))]; hTCP != INVALID_SOCKET; hTCP = TCPHashNext[hTCP])
+	{
+		SyncTCBStub(hTCP);
+
+		if(MyTCBStub.remoteHash.Val == h->DestPort)
+		{
+			partialMatch = hTCP;
+			break;
+		}
+	}
+
+	#if defined(STACK_USE_SSL_SERVER)
+	// SSL ports aren't hashed, check every listening socket for them
+	// 0 is defined as an invalid port number
+	if(partialMatch == INVALID_SOCKET)
+	{
+		for(hTCP = 0; hTCP < TCP_SOCKET_COUNT; hTCP++ )
+		{
+			SyncTCBStub(hTCP);
+			if((MyTCBStub.smState == TCP_LISTEN) && (MyTCBStub.sslTxHead == h->DestPort))
+				partialMatch = hTCP;
+		}
+	}
+	#endif
+
 
 	// If there is a partial match, then a listening socket is currently 
 	// available.  Set up the extended TCB with the info needed 
@@ -3330,7 +3652,7 @@ static BOOL FindMatchingSocket(TCP_HEADER* h, NODE_INFO* remote)
 				continue;
 
 			// SYN matches SYN queue entry.  Update timestamp and do nothing.
-			SYNQueue[wQueueInsertPos].wTimestamp = TickGetDiv256();
+			SYNQueue[wQueueInsertPos].wTimestamp = TickGetDiv256Word();
 			return FALSE;
 		}
 		
@@ -3356,7 +3678,7 @@ static BOOL FindMatchingSocket(TCP_HEADER* h, NODE_INFO* remote)
 			SYNQueue[wQueueInsertPos].wSourcePort = h->SourcePort;
 			SYNQueue[wQueueInsertPos].dwSourceSEQ = h->SeqNumber;
 			SYNQueue[wQueueInsertPos].wDestPort = h->DestPort;
-			SYNQueue[wQueueInsertPos].wTimestamp = TickGetDiv256();
+			SYNQueue[wQueueInsertPos].wTimestamp = TickGetDiv256Word();
 
 			return FALSE;
 		}
@@ -3425,6 +3747,7 @@ static void SwapTCPHeader(TCP_HEADER* header)
 static void CloseSocket(void)
 {
 	SyncTCB();
+	TCPTickWake();
 
 	MyTCBStub.remoteHash.Val = MyTCB.localPort.Val;
 	MyTCBStub.txHead = MyTCBStub.bufferTxStart;
@@ -3465,6 +3788,8 @@ static void CloseSocket(void)
 	MyTCBStub.sslTxHead = MyTCB.localSSLPort.Val;
 	#endif
 
+	TCPHashUpdate();
+
 	MyTCB.flags.bFINSent = 0;
 	MyTCB.flags.bSYNSent = 0;
 	MyTCB.flags.bRXNoneACKed1 = 0;
@@ -3477,6 +3802,58 @@ static void CloseSocket(void)
 }
 
 
+/*****************************************************************************
+  Function:
+	static void TCPHashUpdate(void)
+
+  Summary:
+	Moves the current socket to the hash bucket of its state and remoteHash.
+
+  Description:
+	Unchains the current socket from its bucket and chains it again: 
+	listening sockets by local port, other open sockets by remoteHash, 
+	closed sockets not at all.  Must be called whenever smState moves 
+	between closed, listening and connected, or remoteHash changes.
+
+  Precondition:
+	SyncTCBStub() was called for the socket.
+
+  Parameters:
+	None
+
+  Returns:
+	None
+  ***************************************************************************/
+static void TCPHashUpdate(void)
+{
+	TCP_SOCKET *pLink;
+	BYTE vSlot;
+
+	// Take the socket out of its current chain
+	if(vTCPHashSlot[hCurrentTCP] != TCP_HASH_NONE)
+	{
+		pLink = &TCPHashHead[vTCPHashSlot[hCurrentTCP]];
+		while(*pLink != hCurrentTCP)
+			pLink = &TCPHashNext[*pLink];
+		*pLink = TCPHashNext[hCurrentTCP];
+	}
+
+	if(MyTCBStub.smState == TCP_CLOSED)
+		vSlot = TCP_HASH_NONE;
+	else if(MyTCBStub.smState == TCP_LISTEN)
+		vSlot = TCP_HASH_BUCKETS + (MyTCBStub.remoteHash.Val & (TCP_HASH_BUCKETS-1));
+	else
+		vSlot = MyTCBStub.remoteHash.Val & (TCP_HASH_BUCKETS-1);
+
+	vTCPHashSlot[hCurrentTCP] = vSlot;
+	if(vSlot != TCP_HASH_NONE)
+	{
+		TCPHashNext[hCurrentTCP] = TCPHashHead[vSlot];
+		TCPHashHead[vSlot] = hCurrentTCP;
+	}
+}
+
+
 /*****************************************************************************
   Function:
 	static WORD GetMaxSegSizeOption(void)
@@ -3619,6 +3996,9 @@ static void HandleTCPSeg(TCP_HEADER* h, WORD len)
 	localAckNumber = h->AckNumber;
 	localSeqNumber = h->SeqNumber;
 
+	// Any segment can start or stop timers on this socket
+	TCPTickWake();
+
 	// We received a packet, reset the keep alive timer and count
 	#if defined(TCP_KEEP_ALIVE_TIMEOUT)
 		MyTCBStub.Flags.vUnackedKeepalives = 0;
@@ -3665,6 +4045,7 @@ static void HandleTCPSeg(TCP_HEADER* h, WORD len)
 				// Respond with SYN + ACK
 				SendTCP(SYN | ACK, SENDTCP_RESET_TIMERS);
 				MyTCBStub.smState = TCP_SYN_RECEIVED;
+				TCPHashUpdate();
 			}
 			else
 			{
@@ -4199,11 +4580,13 @@ static void HandleTCPSeg(TCP_HEADER* h, WORD len)
 		
 			// Do not send an ACK immediately back.  Instead, we will 
 			// perform delayed acknowledgements.  To do this, we will 
-			// just start a timer
+			// just start a timer.  With TCP_OPTION_QUICKACK the timer 
+			// expires on the next TCPTick(), so a response written by 
+			// the application before then carries the ACK.
 			if(!MyTCBStub.Flags.bDelayedACKTimerEnabled)
 			{
 				MyTCBStub.Flags.bDelayedACKTimerEnabled = 1;
-				MyTCBStub.OverlappedTimers.delayedACKTime = (WORD)TickGetDiv256() + (WORD)((TCP_DELAYED_ACK_TIMEOUT)>>8);
+				MyTCBStub.OverlappedTimers.delayedACKTime = TickGetDiv256Word() + (MyTCBStub.Flags.bQuickACK ? 0 : (WORD)((TCP_DELAYED_ACK_TIMEOUT)>>8));
 			}
 		}
 	}
@@ -4242,7 +4625,7 @@ static void HandleTCPSeg(TCP_HEADER* h, WORD len)
 					// Stack to automatically close sockets when the 
 					// remote node sends a FIN, let's start a timer so 
 					// that we will eventually close the socket automatically
-					MyTCBStub.OverlappedTimers.closeWaitTime = (WORD)TickGetDiv256() + (WORD)((TCP_CLOSE_WAIT_TIMEOUT)>>8);
+					MyTCBStub.OverlappedTimers.closeWaitTime = TickGetDiv256Word() + (WORD)((TCP_CLOSE_WAIT_TIMEOUT)>>8);
 					break;
 	
 				case TCP_FIN_WAIT_1:
@@ -4505,6 +4888,175 @@ BOOL TCPAdjustFIFOSize(TCP_SOCKET hTCP, WORD wMinRXSize, WORD wMinTXSize, BYTE v
 
 }
 
+/*****************************************************************************
+  Function:
+	TCP_FIFO_STATS* TCPGetFIFOStats(TCP_SOCKET hTCP)
+
+  Summary:
+	Returns the FIFO usage statistics of a socket.
+
+  Description:
+	Returns the high water marks and pressure counters kept for the TX and 
+	RX FIFOs of a socket.  The counters are free running and wrap.
+
+  Precondition:
+	TCP is initialized.
+
+  Parameters:
+	hTCP - The socket to be checked
+
+  Returns:
+	Pointer to the socket's statistics, or NULL for an invalid socket.
+  ***************************************************************************/
+TCP_FIFO_STATS* TCPGetFIFOStats(TCP_SOCKET hTCP)
+{
+	if(hTCP >= TCP_SOCKET_COUNT)
+		return NULL;
+
+	return &TCPFIFOStats[hTCP];
+}
+
+/*****************************************************************************
+  Function:
+	static void TCPFIFOWatermark(void)
+
+  Summary:
+	Updates the FIFO high water marks of the current socket.
+
+  Precondition:
+	The socket's stub is loaded.
+
+  Parameters:
+	None
+
+  Returns:
+	None
+  ***************************************************************************/
+static void TCPFIFOWatermark(void)
+{
+	WORD w;
+	
+	// Bytes queued for transmit or waiting for an ACK
+	if(MyTCBStub.txHead >= MyTCBStub.txTail)
+		w = MyTCBStub.txHead - MyTCBStub.txTail;
+	else
+		w = (MyTCBStub.bufferRxStart - MyTCBStub.bufferTxStart) - (MyTCBStub.txTail - MyTCBStub.txHead);
+	if(w > TCPFIFOStats[hCurrentTCP].wTXHighWater)
+		TCPFIFOStats[hCurrentTCP].wTXHighWater = w;
+
+	// Bytes received but not yet read by the application
+	if(MyTCBStub.rxHead >= MyTCBStub.rxTail)
+		w = MyTCBStub.rxHead - MyTCBStub.rxTail;
+	else
+		w = (MyTCBStub.bufferEnd - MyTCBStub.bufferRxStart + 1) - (MyTCBStub.rxTail - MyTCBStub.rxHead);
+	if(w > TCPFIFOStats[hCurrentTCP].wRXHighWater)
+		TCPFIFOStats[hCurrentTCP].wRXHighWater = w;
+}
+
+#if defined(TCP_FIFO_ADAPT_INTERVAL)
+/*****************************************************************************
+  Function:
+	static void TCPAdaptFIFOSize(TCP_SOCKET hTCP)
+
+  Summary:
+	Re-balances a socket's TX/RX split from its measured usage.
+
+  Description:
+	Each FIFO gets 1.25 times its high water mark plus a small margin.  
+	The rest of the socket's memory goes to the side that ran out since 
+	the last re-balance (TX full or zero RX window), or is split equally 
+	if neither or both did.  The socket is only resized while connected 
+	and idle, so no data is lost, and only when the TX size changes by at 
+	least TCP_FIFO_ADAPT_HYSTERESIS bytes.  The high water marks decay 
+	by 1/8 on every call so the split follows changes in traffic.
+
+	The TX FIFO is never made smaller than the socket's wTXMinSize in 
+	TCPSocketInitializer[], so a writer that waits for room for a whole 
+	record can't be starved by a high water mark that decayed while the 
+	socket was quiet.
+
+	Only the split within the socket's own memory is changed; memory is 
+	never moved between sockets.
+
+  Precondition:
+	TCP is initialized.
+
+  Parameters:
+	hTCP - The socket to be re-balanced
+
+  Returns:
+	None
+  ***************************************************************************/
+static void TCPAdaptFIFOSize(TCP_SOCKET hTCP)
+{
+	TCP_FIFO_STATS *stats;
+	WORD wTotal, wMinTX, wMinRX, wCurrentTX, wFloorTX;
+	BYTE vFlags;
+
+	SyncTCBStub(hTCP);
+	stats = &TCPFIFOStats[hTCP];
+	wFloorTX = TCPSocketInitializer[hTCP].wTXMinSize;
+
+	if(MyTCBStub.smState != TCP_ESTABLISHED)
+		return;
+	if((MyTCBStub.txHead != MyTCBStub.txTail) || (MyTCBStub.rxHead != MyTCBStub.rxTail))
+		return;
+	#if defined(STACK_USE_SSL)
+	if(MyTCBStub.sslStubID != SSL_INVALID_ID)
+		return;
+	#endif
+	SyncTCB();
+	if(MyTCB.sHoleSize != -1)
+		return;
+
+	// Size each side for its high water mark plus 25% and a margin
+	wTotal = MyTCBStub.bufferEnd - MyTCBStub.bufferTxStart - 1;
+	wMinTX = stats->wTXHighWater + (stats->wTXHighWater>>2) + TCP_FIFO_ADAPT_MARGIN;
+	wMinRX = stats->wRXHighWater + (stats->wRXHighWater>>2) + TCP_FIFO_ADAPT_MARGIN;
+	if(wMinTX < wFloorTX)
+		wMinTX = wFloorTX;
+	if((DWORD)wMinTX + wMinRX > wTotal)
+	{
+		// Can't give both the headroom, fall back to the bare high water marks
+		wMinTX = stats->wTXHighWater;
+		if(wMinTX < wFloorTX)
+			wMinTX = wFloorTX;
+		wMinRX = stats->wRXHighWater + 1;
+		if((DWORD)wMinTX + wMinRX > wTotal)
+			goto Decay;
+	}
+
+	// Give the rest to the side that was short of space
+	vFlags = 0;
+	if(stats->wTXFull != wLastTXFull[hTCP])
+		vFlags |= TCP_ADJUST_GIVE_REST_TO_TX;
+	if(stats->wRXZeroWindow != wLastRXZeroWindow[hTCP])
+		vFlags |= TCP_ADJUST_GIVE_REST_TO_RX;
+	if(vFlags == 0u)
+		vFlags = TCP_ADJUST_GIVE_REST_TO_TX | TCP_ADJUST_GIVE_REST_TO_RX;
+
+	// Predict the TX size TCPAdjustFIFOSize() would choose
+	wCurrentTX = MyTCBStub.bufferRxStart - MyTCBStub.bufferTxStart - 1;
+	if(vFlags == TCP_ADJUST_GIVE_REST_TO_TX)
+		wMinTX = wTotal - wMinRX;
+	else if(vFlags != TCP_ADJUST_GIVE_REST_TO_RX)
+		wMinTX += (wTotal - wMinTX - wMinRX)>>1;
+
+	if((wMinTX >= wCurrentTX + TCP_FIFO_ADAPT_HYSTERESIS) || (wMinTX + TCP_FIFO_ADAPT_HYSTERESIS <= wCurrentTX))
+	{
+		if(TCPAdjustFIFOSize(hTCP, wMinRX, wMinTX, TCP_ADJUST_GIVE_REST_TO_RX | TCP_ADJUST_PRESERVE_RX))
+			stats->wResizes++;
+	}
+
+	wLastTXFull[hTCP] = stats->wTXFull;
+	wLastRXZeroWindow[hTCP] = stats->wRXZeroWindow;
+
+Decay:
+	stats->wTXHighWater -= stats->wTXHighWater>>3;
+	stats->wRXHighWater -= stats->wRXHighWater>>3;
+}
+#endif
+
 /*****************************************************************************
   Function:
 	static void TCPRAMCopy(PTR_BASE ptrDest, BYTE vDestType, PTR_BASE ptrSource, 
@@ -4648,6 +5200,46 @@ static void TCPRAMCopy(PTR_BASE ptrDest, BYTE vDestType, PTR_BASE ptrSource, BYT
 	}
 }
 
+/*****************************************************************************
+  Function:
+	static void TCPStartTXCopy(PTR_BASE ptrDest, PTR_BASE ptrSource, 
+								WORD wLength)
+
+  Summary:
+	Starts copying TX FIFO data of the current socket into the MAC TX 
+	buffer.
+
+  Description:
+	When the socket's FIFO is in Ethernet RAM the copy is started on the 
+	MAC's DMA engine and left running, so SendTCP() can build the TCP 
+	header while the payload moves.  The payload then crosses SPI only 
+	once, when the application writes it.  Other media are copied 
+	synchronously with TCPRAMCopy().
+
+  Precondition:
+	The socket's stub is loaded.
+
+  Parameters:
+	ptrDest		- Address in the MAC TX buffer to write to
+	ptrSource	- Address in the socket's TX FIFO to copy from
+	wLength		- Number of bytes to copy
+
+  Returns:
+	None
+
+  Remarks:
+	A second call waits for the previous DMA copy to finish.  The caller 
+	must wait for MACIsMemCopyDone() before reading or writing Ethernet 
+	RAM over SPI.
+  ***************************************************************************/
+static void TCPStartTXCopy(PTR_BASE ptrDest, PTR_BASE ptrSource, WORD wLength)
+{
+	if(MyTCBStub.vMemoryMedium == TCP_ETH_RAM)
+		MACMemCopyAsync(ptrDest, ptrSource, wLength);
+	else
+		TCPRAMCopy(ptrDest, TCP_ETH_RAM, ptrSource, MyTCBStub.vMemoryMedium, wLength);
+}
+
 /*****************************************************************************
   Function:
 	static void TCPRAMCopyROM(PTR_BASE wDest, BYTE wDestType, ROM BYTE* wSource, 
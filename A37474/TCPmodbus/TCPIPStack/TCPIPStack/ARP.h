@@ -57,8 +57,10 @@
 
 #ifdef STACK_CLIENT_MODE
 	void ARPInit(void);
+	void ARPTask(void);
 #else
 	#define ARPInit()
+	#define ARPTask()
 #endif
 
 #define ARP_OPERATION_REQ       0x0001u		// Operation code indicating an ARP Request
@@ -85,6 +87,7 @@ typedef struct __attribute__((aligned(2), packed))
 BOOL ARPProcess(void);
 void ARPResolve(IP_ADDR* IPAddr);
 BOOL ARPIsResolved(IP_ADDR* IPAddr, MAC_ADDR* MACAddr);
+void ARPRefresh(NODE_INFO* remote);
 void SwapARPPacket(ARP_PACKET* p);
 
 #ifdef STACK_USE_ZEROCONF_LINK_LOCAL
@@ -125,7 +125,9 @@
 
 
 // Base RAM and ROM pointer types for given architecture
-#if defined(__PIC32MX__)
+#if defined(PTR_BASE)
+	// Given on the command line by the host test build, see TCPmodbus/test/Makefile
+#elif defined(__PIC32MX__)
 	#define PTR_BASE		unsigned long
 	#define ROM_PTR_BASE	unsigned long
 #elif defined(__C30__)
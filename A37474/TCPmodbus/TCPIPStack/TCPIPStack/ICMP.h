@@ -53,7 +53,18 @@
 #ifndef __ICMP_H
 #define __ICMP_H
 
+// Echo responder statistics, see ICMPGetEchoStats()
+typedef struct
+{
+	DWORD dwReplied;		// Echo replies sent
+	DWORD dwDeferred;		// Requests queued because the MAC was busy
+	DWORD dwRateLimited;	// Requests dropped over ICMP_ECHO_RATE
+	DWORD dwDropped;		// Requests dropped with the queue full or too long to queue
+} ICMP_ECHO_STATS;
+
 void ICMPProcess(NODE_INFO *remote, WORD len);
+void ICMPTask(void);
+void ICMPGetEchoStats(ICMP_ECHO_STATS *stats);
 
 BOOL ICMPBeginUsage(void);
 void ICMPSendPing(DWORD dwRemoteIP);
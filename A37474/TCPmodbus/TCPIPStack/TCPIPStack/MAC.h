@@ -168,6 +168,11 @@ typedef struct  __attribute__((aligned(2), packed))
 
 WORD	MACCalcRxChecksum(WORD offset, WORD len);
 WORD 	CalcIPBufferChecksum(WORD len);
+WORD	MACCalcTxChecksum(WORD len);
+
+// TX checksum offload statistics, see MACCalcTxChecksum()
+extern DWORD MACChecksumOffloads;
+extern DWORD MACChecksumCyclesSaved;
 
 void	MACPowerDown(void);
 void	MACEDPowerDown(void);
@@ -180,10 +185,60 @@ PHYREG	ReadPHYReg(BYTE Register);
 #endif
 void	SetRXHashTableEntry(MAC_ADDR DestMACAddr);
 
+// ENC28J60 receive filter profile bits for MACSetRXFilter()
+#define MAC_RX_FILTER_UNICAST		0x01u	// Frames addressed to our MAC
+#define MAC_RX_FILTER_ARP_BCAST		0x02u	// Broadcast ARP requests for our IP
+#define MAC_RX_FILTER_BCAST			0x04u	// All broadcast frames
+#define MAC_RX_FILTER_MCAST_HASH	0x08u	// Multicast groups in the hash table
+
+// Receive filter statistics, see MACGetRXFilterStats()
+typedef struct
+{
+	DWORD dwUnicast;		// Unicast frames accepted by the filter
+	DWORD dwBroadcast;		// Broadcast frames accepted by the filter
+	DWORD dwMulticast;		// Multicast frames accepted by the filter
+	DWORD dwUnknownType;	// Accepted frames that were neither IP nor ARP
+} MAC_RX_FILTER_STATS;
+
+void	MACSetRXFilter(BYTE Profile);
+void	MACGetRXFilterStats(MAC_RX_FILTER_STATS *stats);
+
+// Corrupt receive header statistics, see MACGetRXErrorStats()
+typedef struct
+{
+	DWORD dwBadNextPointer;	// Next packet pointer outside the RX buffer or odd
+	DWORD dwBadStatus;		// Status vector reserved bit set
+	DWORD dwCRCError;		// CRC error reported
+	DWORD dwTooLong;		// Byte count above 1518
+	DWORD dwNotOk;			// Received OK bit clear
+	DWORD dwFramesDropped;	// Recovered by skipping the frame
+	DWORD dwRingResyncs;	// Recovered by resetting the RX buffer
+	DWORD dwMACResets;		// Recovered by re-initializing the ENC28J60
+	DWORD dwMACResetFailures;	// Re-initializations the ENC28J60 did not answer
+} MAC_RX_ERROR_STATS;
+
+void	MACGetRXErrorStats(MAC_RX_ERROR_STATS *stats);
+
 // ENC28J60 specific
 void	SetCLKOUT(BYTE NewConfig);
 BYTE	GetCLKOUT(void);
 
+// SPI clock profiles, SCK = instruction clock / 8, 4, 2 and 1.  Profiles 
+// below 8MHz can't be selected.
+#define MAC_SPI_PROFILES	4u
+
+// SPI link self-test result, see MACGetSPITestResult()
+typedef struct
+{
+	DWORD dwClock;						// Selected SCK frequency, Hz
+	BYTE Profile;						// Selected profile, 0 = slowest
+	WORD wErrors[MAC_SPI_PROFILES];		// Mismatched bytes per profile tested
+	BOOL bFault;						// No usable profile passed, the link is unreliable
+} MAC_SPI_TEST_RESULT;
+
+BOOL	MACSetSPIProfile(BYTE Profile);
+void	MACGetSPITestResult(MAC_SPI_TEST_RESULT *result);
+
 /******************************************************************************
  * Macro:        	void SetLEDConfig(WORD NewConfig)
  *
@@ -289,6 +344,7 @@ void MACProcess(void);
 BOOL MACIsLinked(void);
 
 BOOL MACGetHeader(MAC_ADDR *remote, BYTE* type);
+BOOL MACIsRxPending(void);
 void MACSetReadPtrInRx(WORD offset);
 PTR_BASE MACSetWritePtr(PTR_BASE address);
 PTR_BASE MACSetReadPtr(PTR_BASE address);
@@ -117,7 +117,16 @@ typedef struct __attribute__((__packed__)) appConfigStruct
 #endif
 
 
+// StackTask() timing, see StackGetTaskStats()
+typedef struct
+{
+	DWORD dwMaxTicks;		// Longest StackTask() call
+	WORD wMaxPackets;		// Most packets received in one call
+	DWORD dwBudgetHits;		// Calls stopped by the RX budget with packets left over
+} STACK_TASK_STATS;
+
 void StackInit(void);
 void StackTask(void);
 void StackApplications(void);
+void StackGetTaskStats(STACK_TASK_STATS *stats);
 #endif
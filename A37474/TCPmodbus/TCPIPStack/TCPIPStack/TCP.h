@@ -137,7 +137,8 @@ typedef struct
 		unsigned char bTXFIN : 1;					// FIN needs to be transmitted
 		unsigned char bSocketReset : 1;				// Socket has been reset (self-clearing semaphore)
 		unsigned char bSSLHandshaking : 1;			// Socket is in an SSL handshake
-		unsigned char filler : 2;					// Future expansion
+		unsigned char bNoDelay : 1;					// TCP_OPTION_NODELAY is set
+		unsigned char bQuickACK : 1;				// TCP_OPTION_QUICKACK is set
     } Flags;
 	WORD_VAL remoteHash;	// Consists of remoteIP, remotePort, localPort for connected sockets.  It is a localPort number only for listening server sockets.
 
@@ -196,11 +197,26 @@ typedef struct
 	WORD_VAL remotePort;	// Port number associated with remote node
 } SOCKET_INFO;
 
+// FIFO usage of a socket, see TCP_FIFO_ADAPT_INTERVAL
+typedef struct
+{
+	WORD wTXHighWater;		// Most bytes seen queued in the TX FIFO (decays as the FIFO is resized)
+	WORD wRXHighWater;		// Most bytes seen waiting in the RX FIFO (decays as the FIFO is resized)
+	WORD wTXFull;			// Puts that found the TX FIFO too small for the data
+	WORD wRXZeroWindow;		// Segments sent advertising a zero RX window
+	WORD wResizes;			// Number of automatic FIFO resizes
+} TCP_FIFO_STATS;
+
 /****************************************************************************
   Section:
 	Function Declarations
   ***************************************************************************/
 
+// TCB cache statistics, see TCP_TCB_CACHE_SIZE
+extern DWORD TCBCacheHits;
+extern DWORD TCBCacheMisses;
+extern DWORD TCBCacheBytesSaved;
+
 void TCPInit(void);
 SOCKET_INFO* TCPGetRemoteInfo(TCP_SOCKET hTCP);
 BOOL TCPWasReset(TCP_SOCKET hTCP);
@@ -288,6 +304,11 @@ WORD TCPGetTxFIFOFull(TCP_SOCKET hTCP);
 #define TCP_ADJUST_PRESERVE_TX		0x08u	// Resize flag: attempt to preserve TX buffer
 BOOL TCPAdjustFIFOSize(TCP_SOCKET hTCP, WORD wMinRXSize, WORD wMinTXSize, BYTE vFlags);
 
+#define TCP_OPTION_NODELAY			0x01u	// Socket option: put data is sent on the next TCPTick() instead of after TCP_AUTO_TRANSMIT_TIMEOUT_VAL
+#define TCP_OPTION_QUICKACK			0x02u	// Socket option: received data is ACKed on the next TCPTick() unless a response carries the ACK first
+BOOL TCPSetOptions(TCP_SOCKET hTCP, BYTE vOptions);
+TCP_FIFO_STATS* TCPGetFIFOStats(TCP_SOCKET hTCP);
+
 #if defined(STACK_USE_SSL)
 BOOL TCPStartSSLClient(TCP_SOCKET hTCP, BYTE* host);
 BOOL TCPStartSSLClientEx(TCP_SOCKET hTCP, BYTE* host, void * buffer, BYTE suppDataType);
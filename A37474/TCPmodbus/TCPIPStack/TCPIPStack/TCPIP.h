@@ -174,6 +174,7 @@
 		defined(STACK_USE_ICMP_CLIENT) || \
 		defined(STACK_USE_DYNAMICDNS_CLIENT) || \
 		defined(STACK_USE_SNTP_CLIENT) || \
+		defined(STACK_USE_UDP_TELEMETRY) || \
 		defined(STACK_USE_BERKELEY_API) || \
 		defined(STACK_USE_SSL_CLIENT) || \
         defined(STACK_USE_AUTO_IP)
@@ -237,6 +238,7 @@
 		defined(STACK_USE_ANNOUNCE) || \
 		defined(STACK_USE_UDP_PERFORMANCE_TEST) || \
 		defined(STACK_USE_SNTP_CLIENT) || \
+		defined(STACK_USE_UDP_TELEMETRY) || \
 		defined(STACK_USE_BERKELEY_API)
 	    #if !defined(STACK_USE_UDP)
 	        #define STACK_USE_UDP
@@ -83,6 +83,8 @@
 //#define STACK_USE_MODBUS_TCP_SERVER   // TCP modbus server
 
 #define STACK_USE_GENERIC_TCP_SERVER_EXAMPLE	// ToUpper server example in GenericTCPServer.c
+#define STACK_USE_PULSE_LOG_SERVER		// A/B double buffered grid pulse log streamed on its own port
+#define STACK_USE_UDP_TELEMETRY			// 10ms log data snapshot sent as a UDP datagram to the remote IP or a multicast group
 //#define STACK_USE_TELNET_SERVER			// Telnet server
 //#define STACK_USE_ANNOUNCE				// Microchip Embedded Ethernet Device Discoverer server/client
 //#define STACK_USE_DNS					// Domain Name Service Client for resolving hostname strings to IP addresses
@@ -192,6 +194,45 @@
 #define MY_DEFAULT_REM_IP_ADDR_BYTE4    (15ul)
 
 
+// =======================================================================
+//   StackTask() Options
+// =======================================================================
+// Most packets and time StackTask() spends receiving per call.  Packets 
+// left over stay in the MAC RX buffer and are handled by the next call, 
+// so a flood cannot hold off the rest of the main loop.
+#define STACK_RX_PACKET_BUDGET	(8u)
+#define STACK_RX_TIME_BUDGET	((DWORD)(TICK_SECOND/1000))
+
+// =======================================================================
+//   ARP Options
+// =======================================================================
+// Remote MAC addresses cached (the least recently used is replaced) and 
+// how long an entry is trusted before it is resolved again
+#define ARP_CACHE_ENTRIES		(4u)
+#define ARP_CACHE_TIMEOUT		((DWORD)(5ul*TICK_MINUTE))
+
+// =======================================================================
+//   ICMP Options
+// =======================================================================
+// Echo requests answered per second (with bursts of up to 
+// ICMP_ECHO_BURST), and the replies held in RAM while the MAC is busy 
+// transmitting.  Longer echo requests are only answered when the MAC is 
+// free.
+#define ICMP_ECHO_RATE			(20u)
+#define ICMP_ECHO_BURST			(4u)
+#define ICMP_ECHO_QUEUE_DEPTH	(2u)
+#define ICMP_ECHO_MAX_DATA		(64u)
+
+// =======================================================================
+//   ENC28J60 MAC Layer Options
+// =======================================================================
+// Receive filter profile loaded by MACInit(), see MACSetRXFilter().  
+// Broadcasts other than ARP requests for our IP address are dropped by 
+// the ENC28J60 before they reach the RX buffer.  Add 
+// MAC_RX_FILTER_MCAST_HASH to accept the multicast groups registered with 
+// SetRXHashTableEntry().
+#define MAC_RX_FILTER_DEFAULT	(MAC_RX_FILTER_UNICAST | MAC_RX_FILTER_ARP_BCAST)
+
 // =======================================================================
 //   PIC32MX7XX/6XX MAC Layer Options
 //   If not using a PIC32MX7XX/6XX device, ignore this section.
@@ -227,7 +268,7 @@
  *   requires them otherwise, enable them here.
  */
 #define STACK_USE_TCP
-//#define STACK_USE_UDP
+#define STACK_USE_UDP
 
 /* Client Mode Configuration
  *   Uncomment following line if this stack will be used in CLIENT
@@ -243,11 +284,22 @@
  */
 	// Allocate how much total RAM (in bytes) you want to allocate
 	// for use by your TCP TCBs, RX FIFOs, and TX FIFOs.
-	#define TCP_ETH_RAM_SIZE					(1500ul)
+	#define TCP_ETH_RAM_SIZE					(2000ul)
 	#define TCP_PIC_RAM_SIZE					(0ul)
 	#define TCP_SPI_RAM_SIZE					(0ul)
 	#define TCP_SPI_RAM_BASE_ADDRESS			(0x00)
 
+	// Number of full TCBs cached in PIC RAM (42 bytes each), enough for 
+	// the servers that are polled alternately.  The host benchmark builds 
+	// with other sizes, see TCPmodbus/test/Makefile.
+	#if !defined(TCP_TCB_CACHE_SIZE)
+	#define TCP_TCB_CACHE_SIZE					(2u)
+	#endif
+
+	// Interval at which one socket's TX/RX split is re-balanced from its 
+	// measured FIFO usage.  Comment out to keep the fixed split below.
+	#define TCP_FIFO_ADAPT_INTERVAL				(2ul*TICK_SECOND)
+
 	// Define names of socket types
 	#define TCP_SOCKET_TYPES
 		#define TCP_PURPOSE_GENERIC_TCP_CLIENT 0
@@ -264,6 +316,7 @@
 		#define TCP_PURPOSE_BERKELEY_CLIENT 11
 		#define TCP_PURPOSE_MODBUS_TCP_CLIENT  12
 		#define TCP_PURPOSE_MODBUS_TCP_SERVER  13
+		#define TCP_PURPOSE_PULSE_LOG_SERVER   14
  	#define END_OF_TCP_SOCKET_TYPES
 
 	#if defined(__TCP_C)
@@ -279,6 +332,10 @@
 		// Note: The RX FIFO must be at least 1 byte in order to
 		// receive SYN and FIN messages required by TCP.  The TX
 		// FIFO can be zero if desired.
+		//
+		// wTXMinSize is optional and only used with TCP_FIFO_ADAPT_INTERVAL: 
+		// the TX FIFO is never shrunk below it, so set it to the largest 
+		// single write the socket's owner waits to have room for.
 		#define TCP_CONFIGURATION
 		ROM struct
 		{
@@ -286,6 +343,7 @@
 			BYTE vMemoryMedium;
 			WORD wTXBufferSize;
 			WORD wRXBufferSize;
+			WORD wTXMinSize;
 		} TCPSocketInitializer[] = 
 		{
 			//{TCP_PURPOSE_GENERIC_TCP_CLIENT, TCP_ETH_RAM, 125, 100},
@@ -314,6 +372,9 @@
 #ifdef STACK_USE_GENERIC_TCP_SERVER_EXAMPLE
 			{TCP_PURPOSE_GENERIC_TCP_SERVER, TCP_ETH_RAM, MAX_TX_SIZE, 100},
 #endif
+#ifdef STACK_USE_PULSE_LOG_SERVER
+			{TCP_PURPOSE_PULSE_LOG_SERVER,   TCP_ETH_RAM, MAX_TX_SIZE, 20, PULSE_LOG_WRITE_SIZE},
+#endif
 
 		};
 		#define END_OF_TCP_CONFIGURATION
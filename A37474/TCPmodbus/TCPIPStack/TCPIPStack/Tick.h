@@ -81,6 +81,7 @@ typedef __attribute__((__deprecated__)) DWORD TICK;
 void TickInit(void);
 DWORD TickGet(void);
 DWORD TickGetDiv256(void);
+WORD TickGetDiv256Word(void);
 DWORD TickGetDiv64K(void);
 DWORD TickConvertToMilliseconds(DWORD dwTickValue);
 void TickUpdate(void);
@@ -0,0 +1,137 @@
+/*********************************************************************
+ *
+ *                  UDP Module Defs for Microchip TCP/IP Stack
+ *
+ *********************************************************************
+ * FileName:        UDP.h
+ * Dependencies:    StackTsk.h
+ *                  MAC.h
+ * Processor:       PIC18, PIC24F, PIC24H, dsPIC30F, dsPIC33F, PIC32
+ * Compiler:        Microchip C32 v1.05 or higher
+ *					Microchip C30 v3.12 or higher
+ *					Microchip C18 v3.30 or higher
+ *					HI-TECH PICC-18 PRO 9.63PL2 or higher
+ * Company:         Microchip Technology, Inc.
+ *
+ * Software License Agreement
+ *
+ * Copyright (C) 2002-2009 Microchip Technology Inc.  All rights
+ * reserved.
+ *
+ * Microchip licenses to you the right to use, modify, copy, and
+ * distribute:
+ * (i)  the Software when embedded on a Microchip microcontroller or
+ *      digital signal controller product ("Device") which is
+ *      integrated into Licensee's product; or
+ * (ii) ONLY the Software driver source files ENC28J60.c, ENC28J60.h,
+ *		ENCX24J600.c and ENCX24J600.h ported to a non-Microchip device
+ *		used in conjunction with a Microchip ethernet controller for
+ *		the sole purpose of interfacing with the ethernet controller.
+ *
+ * You should refer to the license agreement accompanying this
+ * Software for additional information regarding your rights and
+ * obligations.
+ *
+ * THE SOFTWARE AND DOCUMENTATION ARE PROVIDED "AS IS" WITHOUT
+ * WARRANTY OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION, ANY WARRANTY OF MERCHANTABILITY, FITNESS FOR A
+ * PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * MICROCHIP BE LIABLE FOR ANY INCIDENTAL, SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES, LOST PROFITS OR LOST DATA, COST OF
+ * PROCUREMENT OF SUBSTITUTE GOODS, TECHNOLOGY OR SERVICES, ANY CLAIMS
+ * BY THIRD PARTIES (INCLUDING BUT NOT LIMITED TO ANY DEFENSE
+ * THEREOF), ANY CLAIMS FOR INDEMNITY OR CONTRIBUTION, OR OTHER
+ * SIMILAR COSTS, WHETHER ASSERTED ON THE BASIS OF CONTRACT, TORT
+ * (INCLUDING NEGLIGENCE), BREACH OF WARRANTY, OR OTHERWISE.
+ *
+ *
+ *
+ * Author               Date    	Comment
+ *~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * Nilesh Rajbharti     3/19/01  	Original        (Rev 1.0)
+ *                      10/19/26    Trimmed to IP address / node info
+ *                                  opens, no DNS, for telemetry
+ ********************************************************************/
+#ifndef __UDP_H
+#define __UDP_H
+
+// Stores a UDP Port Number
+typedef WORD UDP_PORT;
+
+// Provides a handle to a UDP Socket
+typedef BYTE UDP_SOCKET;
+
+// UDP states
+typedef enum
+{
+	UDP_GATEWAY_SEND_ARP = 0u,	// Send an ARP query for the remote node (or gateway)
+	UDP_GATEWAY_GET_ARP,		// Wait for the ARP response
+	UDP_CLOSED,					// Socket is idle and unallocated
+	UDP_OPENED					// Remote MAC address is known, socket can transmit
+} UDP_STATE;
+
+// Stores information about a current UDP socket
+typedef struct
+{
+	NODE_INFO	remoteNode;		// IP and MAC of remote node
+	UDP_PORT	remotePort;		// Remote node's UDP port number
+	UDP_PORT	localPort;		// Local UDP port number, or INVALID_UDP_PORT when free
+	UDP_STATE	smState;		// State of this socket
+	DWORD		retryInterval;	// Ticks between ARP queries
+	BYTE		retryCount;		// ARP queries sent since the last response
+	DWORD		eventTime;		// Tick of the last ARP query
+} UDP_SOCKET_INFO;
+
+// Indicates a UDP socket that is not valid
+#define INVALID_UDP_SOCKET      (0xffu)
+// Indicates a UDP port that is not valid
+#define INVALID_UDP_PORT        (0ul)
+
+// Values for the remoteHostType parameter of UDPOpenEx()
+#define UDP_OPEN_SERVER		0u	// Listen on localPort, reply to whoever sends to us
+#define UDP_OPEN_IP_ADDRESS	3u	// remoteHost is an IP address (unicast, broadcast or multicast)
+#define UDP_OPEN_NODE_INFO	4u	// remoteHost is a NODE_INFO* with a known MAC address
+
+#define UDP_ARP_RETRY_TIMEOUT	(TICK_SECOND/2)	// First ARP retry, doubles on every retry
+#define UDP_ARP_MAX_RETRY		(4u)			// Queries before starting over with the short timeout
+
+// UDP packet header
+typedef struct
+{
+	UDP_PORT    SourcePort;				// Source UDP port
+	UDP_PORT    DestinationPort;		// Destination UDP port
+	WORD        Length;					// Length of data
+	WORD        Checksum;				// UDP checksum of the data
+} UDP_HEADER;
+
+extern UDP_SOCKET activeUDPSocket;
+extern UDP_SOCKET_INFO  UDPSocketInfo[MAX_UDP_SOCKETS];
+extern WORD UDPTxCount;
+extern WORD UDPRxCount;
+
+void UDPInit(void);
+void UDPTask(void);
+
+UDP_SOCKET UDPOpenEx(DWORD remoteHost, BYTE remoteHostType, UDP_PORT localPort, UDP_PORT remotePort);
+void UDPClose(UDP_SOCKET s);
+BOOL UDPIsOpened(UDP_SOCKET socket);
+BOOL UDPProcess(NODE_INFO *remoteNode, IP_ADDR *localIP, WORD len);
+
+// Legacy open, remoteNode NULL listens as a server
+#define UDPOpen(localPort, remoteNode, remotePort)	\
+	UDPOpenEx((remoteNode) ? (DWORD)(PTR_BASE)(remoteNode) : 0ul, (remoteNode) ? UDP_OPEN_NODE_INFO : UDP_OPEN_SERVER, localPort, remotePort)
+
+void UDPSetTxBuffer(WORD wOffset);
+void UDPSetRxBuffer(WORD wOffset);
+
+WORD UDPIsPutReady(UDP_SOCKET s);
+BOOL UDPPut(BYTE v);
+WORD UDPPutArray(BYTE *cData, WORD wDataLen);
+void UDPFlush(void);
+
+WORD UDPIsGetReady(UDP_SOCKET s);
+BOOL UDPGet(BYTE *v);
+WORD UDPGetArray(BYTE *cData, WORD wDataLen);
+void UDPDiscard(void);
+
+#endif
@@ -142,7 +142,10 @@ void TickInit(void)
 
   Description:
 	This function performs an interrupt-safe and synchronized read of the 
-	48-bit Tick value.
+	48-bit Tick value.  On 16-bit parts the Timer1 interrupt stays enabled: 
+	dwInternalTicks only changes in the ISR, so it doubles as a sequence 
+	number and the read is retried if it changed around the TMR1 read or 
+	the ISR is pending.
 
   Precondition:
 	None
@@ -169,35 +172,29 @@ static void GetTickCopy(void)
 	} while(INTCONbits.TMR0IF);
 	INTCONbits.TMR0IE = 1;			// Enable interrupt
 #elif defined(__C30__)
+	DWORD dwTempTicks;
+	WORD_VAL wTemp;
+
 	do
 	{
-		DWORD dwTempTicks;
-        WORD_VAL wTemp;
-		
-		IEC0bits.T1IE = 1;			// Enable interrupt
-		Nop();
-		IEC0bits.T1IE = 0;			// Disable interrupt
-
-		// Get low 2 bytes
-        wTemp.Val = TMR1;
-        vTickReading[0] = wTemp.v[0];
-        vTickReading[1] = wTemp.v[1];
-		//((WORD*)vTickReading)[0] = TMR1;
-		
-		// Correct corner case where interrupt increments byte[4+] but 
-		// TMR1 hasn't rolled over to 0x0000 yet
 		dwTempTicks = dwInternalTicks;
-        //if(((WORD*)vTickReading)[0] == 0xFFFFu)
-        if(wTemp.Val == 0xFFFFu)
-			dwTempTicks--;
-		
-		// Get high 4 bytes
-		vTickReading[2] = ((BYTE*)&dwTempTicks)[0];
-		vTickReading[3] = ((BYTE*)&dwTempTicks)[1];
-		vTickReading[4] = ((BYTE*)&dwTempTicks)[2];
-		vTickReading[5] = ((BYTE*)&dwTempTicks)[3];
-	} while(IFS0bits.T1IF);
-	IEC0bits.T1IE = 1;				// Enable interrupt
+		wTemp.Val = TMR1;
+	} while((dwTempTicks != dwInternalTicks) || IFS0bits.T1IF);
+
+	// Get low 2 bytes
+	vTickReading[0] = wTemp.v[0];
+	vTickReading[1] = wTemp.v[1];
+
+	// Correct corner case where interrupt increments byte[4+] but 
+	// TMR1 hasn't rolled over to 0x0000 yet
+	if(wTemp.Val == 0xFFFFu)
+		dwTempTicks--;
+
+	// Get high 4 bytes
+	vTickReading[2] = ((BYTE*)&dwTempTicks)[0];
+	vTickReading[3] = ((BYTE*)&dwTempTicks)[1];
+	vTickReading[4] = ((BYTE*)&dwTempTicks)[2];
+	vTickReading[5] = ((BYTE*)&dwTempTicks)[3];
 #else	// PIC32
 	do
 	{
@@ -316,6 +313,49 @@ DWORD TickGetDiv256(void)
 	return dw;
 }
 
+/*****************************************************************************
+  Function:
+	WORD TickGetDiv256Word(void)
+
+  Summary:
+	Obtains the low 16 bits of the current Tick value divided by 256.
+
+  Description:
+	Fast path for the 16-bit TickGetDiv256() timers kept by TCP.  On 16-bit 
+	parts only TMR1 and dwInternalTicks are read, without the byte by byte 
+	48-bit copy through vTickReading.
+
+  Precondition:
+	None
+
+  Parameters:
+	None
+
+  Returns:
+  	(WORD)TickGetDiv256()
+  ***************************************************************************/
+WORD TickGetDiv256Word(void)
+{
+#if defined(__C30__)
+	WORD wTicks, wTimer;
+
+	// Same retry rule as GetTickCopy(); the low word of dwInternalTicks 
+	// changes on every interrupt
+	do
+	{
+		wTicks = (WORD)dwInternalTicks;
+		wTimer = TMR1;
+	} while((wTicks != (WORD)dwInternalTicks) || IFS0bits.T1IF);
+
+	if(wTimer == 0xFFFFu)
+		wTicks--;
+
+	return (wTicks<<8) | (wTimer>>8);
+#else
+	return (WORD)TickGetDiv256();
+#endif
+}
+
 /*****************************************************************************
   Function:
 	DWORD TickGetDiv64K(void)
@@ -0,0 +1,988 @@
+/*********************************************************************
+ *
+ *  User Datagram Protocol (UDP) Communications Layer
+ *  Module for Microchip TCP/IP Stack
+ *   -Provides unreliable, minimum latency transport of application 
+ *	  datagram (packet) oriented data
+ *	 -Reference: RFC 768
+ *
+ *********************************************************************
+ * FileName:        UDP.c
+ * Dependencies:    IP, Ethernet (ENC28J60.c or ETH97J60.c), ARP
+ * Processor:       PIC18, PIC24F, PIC24H, dsPIC30F, dsPIC33F, PIC32
+ * Compiler:        Microchip C32 v1.05 or higher
+ *					Microchip C30 v3.12 or higher
+ *					Microchip C18 v3.30 or higher
+ *					HI-TECH PICC-18 PRO 9.63PL2 or higher
+ * Company:         Microchip Technology, Inc.
+ *
+ * Software License Agreement
+ *
+ * Copyright (C) 2002-2009 Microchip Technology Inc.  All rights
+ * reserved.
+ *
+ * Microchip licenses to you the right to use, modify, copy, and
+ * distribute:
+ * (i)  the Software when embedded on a Microchip microcontroller or
+ *      digital signal controller product ("Device") which is
+ *      integrated into Licensee's product; or
+ * (ii) ONLY the Software driver source files ENC28J60.c, ENC28J60.h,
+ *		ENCX24J600.c and ENCX24J600.h ported to a non-Microchip device
+ *		used in conjunction with a Microchip ethernet controller for
+ *		the sole purpose of interfacing with the ethernet controller.
+ *
+ * You should refer to the license agreement accompanying this
+ * Software for additional information regarding your rights and
+ * obligations.
+ *
+ * THE SOFTWARE AND DOCUMENTATION ARE PROVIDED "AS IS" WITHOUT
+ * WARRANTY OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION, ANY WARRANTY OF MERCHANTABILITY, FITNESS FOR A
+ * PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * MICROCHIP BE LIABLE FOR ANY INCIDENTAL, SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES, LOST PROFITS OR LOST DATA, COST OF
+ * PROCUREMENT OF SUBSTITUTE GOODS, TECHNOLOGY OR SERVICES, ANY CLAIMS
+ * BY THIRD PARTIES (INCLUDING BUT NOT LIMITED TO ANY DEFENSE
+ * THEREOF), ANY CLAIMS FOR INDEMNITY OR CONTRIBUTION, OR OTHER
+ * SIMILAR COSTS, WHETHER ASSERTED ON THE BASIS OF CONTRACT, TORT
+ * (INCLUDING NEGLIGENCE), BREACH OF WARRANTY, OR OTHERWISE.
+ *
+ *
+ *
+ * Author               Date    	Comment
+ *~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * Nilesh Rajbharti     3/19/01  	Original        (Rev 1.0)
+ * Nilesh Rajbharti     2/26/03     Fixed UDPGet and UDPProcess bugs
+ *                                  as discovered and fixed by John Owen
+ *                                  of Powerwave.
+ *                                  1. UDPGet would return FALSE on last good byte
+ *                                  2. UDPProcess was incorrectly calculating length.
+ * Howard Schlunder     12/11/06    Changed almost everything to 
+ *                                  better meet spec and increase speed.
+ *                      10/19/26    Trimmed to IP address / node info
+ *                                  opens, no DNS, for telemetry
+ ********************************************************************/
+#define __UDP_C
+
+#include "TCPIPStack/TCPIP.h"
+
+#if defined(STACK_USE_UDP)
+
+/****************************************************************************
+  Section:
+	Configuration Parameters
+  ***************************************************************************/
+
+// First port number for randomized local port number selection
+#define LOCAL_UDP_PORT_START_NUMBER (4096u)
+
+// Last port number for randomized local port number selection
+#define LOCAL_UDP_PORT_END_NUMBER   (8192u)
+
+/****************************************************************************
+  Section:
+	UDP Global Variables
+  ***************************************************************************/
+
+// Stores an array of information pertaining to each UDP socket
+UDP_SOCKET_INFO		UDPSocketInfo[MAX_UDP_SOCKETS];
+
+// Indicates which UDP socket is currently active
+UDP_SOCKET			activeUDPSocket;
+
+WORD UDPTxCount;	// Number of bytes written to this UDP segment
+WORD UDPRxCount;	// Number of bytes read from this UDP segment
+static UDP_SOCKET	LastPutSocket = INVALID_UDP_SOCKET;	// Indicates the last socket to which data was written
+static WORD wPutOffset;		// Offset from beginning of payload where data is to be written.
+static WORD wGetOffset;		// Offset from beginning of payload where data is to be read.
+
+// Stores various flags for the UDP module
+static struct
+{
+	unsigned char bFirstRead : 1;		// No data has been read from this segment yet
+	unsigned char bWasDiscarded : 1;	// The data in this segment has been discarded
+} Flags;
+
+// Indicates which socket has currently received data for this loop
+static UDP_SOCKET SocketWithRxData = INVALID_UDP_SOCKET;
+
+/****************************************************************************
+  Section:
+	Function Prototypes
+  ***************************************************************************/
+
+static UDP_SOCKET FindMatchingSocket(UDP_HEADER *h, NODE_INFO *remoteNode,
+                                    IP_ADDR *localIP);
+static UDP_PORT GetNextLocalPort(void);
+
+/****************************************************************************
+  Section:
+	Connection Management Functions
+  ***************************************************************************/
+
+/*****************************************************************************
+  Function:
+	void UDPInit(void)
+
+  Summary:
+	Initializes the UDP module.
+
+  Description:
+	Initializes the UDP module.  This function initializes all the UDP 
+	sockets to the closed state.
+
+  Precondition:
+	None
+
+  Parameters:
+	None
+		
+  Returns:
+  	None
+  	
+  Remarks:
+	This function is called only one during lifetime of the application.
+  ***************************************************************************/
+void UDPInit(void)
+{
+    UDP_SOCKET s;
+
+    for ( s = 0; s < MAX_UDP_SOCKETS; s++ )
+    {
+		UDPClose(s);
+    }
+	Flags.bWasDiscarded = 1;
+}
+
+/*****************************************************************************
+  Function:
+	void UDPTask(void)
+
+  Summary:
+	Performs periodic UDP tasks.
+
+  Description:
+	This function resolves the remote MAC address of sockets opened to a 
+	unicast IP address.  ARP queries are retried with a doubling timeout 
+	until the remote node (or the gateway, if it is off of our subnet) 
+	answers.
+
+  Precondition:
+	None
+
+  Parameters:
+	None
+
+  Returns:
+	None
+  ***************************************************************************/
+void UDPTask(void)
+{
+	UDP_SOCKET s;
+	UDP_SOCKET_INFO *p;
+
+	for ( s = 0; s < MAX_UDP_SOCKETS; s++ )
+	{
+		p = &UDPSocketInfo[s];
+
+		switch(p->smState)
+		{
+			case UDP_GATEWAY_SEND_ARP:
+				if(!MACIsTxReady())
+					break;
+
+				ARPResolve(&p->remoteNode.IPAddr);
+				p->eventTime = TickGet();
+				p->smState = UDP_GATEWAY_GET_ARP;
+				break;
+
+			case UDP_GATEWAY_GET_ARP:
+				if(ARPIsResolved(&p->remoteNode.IPAddr, &p->remoteNode.MACAddr))
+				{
+					p->smState = UDP_OPENED;
+					break;
+				}
+
+				if(TickGet() - p->eventTime < p->retryInterval)
+					break;
+
+				// Back off, then start over so a host that shows up late is still found
+				if(++p->retryCount >= UDP_ARP_MAX_RETRY)
+				{
+					p->retryCount = 0;
+					p->retryInterval = UDP_ARP_RETRY_TIMEOUT;
+				}
+				else
+				{
+					p->retryInterval <<= 1;
+				}
+				p->smState = UDP_GATEWAY_SEND_ARP;
+				break;
+
+			default:
+				break;
+		}
+	}
+}
+
+/*****************************************************************************
+  Function:
+	UDP_SOCKET UDPOpenEx(DWORD remoteHost, BYTE remoteHostType, 
+						 UDP_PORT localPort, UDP_PORT remotePort)
+
+  Summary:
+	Opens a UDP socket for a client or server.
+
+  Description:
+	Provides handles to UDP sockets.  Sockets opened to a unicast IP 
+	address resolve the remote MAC address in UDPTask() and can't transmit 
+	until UDPIsOpened() returns TRUE.  Broadcast and multicast (224.0.0.0 
+	to 239.255.255.255) destinations map straight to their MAC address 
+	and are opened immediately.
+
+  Precondition:
+	UDPInit() must have been previously called.
+
+  Parameters:
+	remoteHost - IP address (IP_ADDR.Val) for UDP_OPEN_IP_ADDRESS, a 
+		NODE_INFO pointer for UDP_OPEN_NODE_INFO, ignored for 
+		UDP_OPEN_SERVER
+	remoteHostType - UDP_OPEN_SERVER, UDP_OPEN_IP_ADDRESS or 
+		UDP_OPEN_NODE_INFO
+	localPort - UDP port number to listen on.  If 0, a random port in 
+		the LOCAL_UDP_PORT_START_NUMBER range is used.
+	remotePort - Remote UDP port number to send to
+
+  Returns:
+ 	INVALID_UDP_SOCKET -  No sockets of the specified type were available 
+ 		to be opened.
+ 	Otherwise - A UDP_SOCKET handle.
+  ***************************************************************************/
+UDP_SOCKET UDPOpenEx(DWORD remoteHost, BYTE remoteHostType, UDP_PORT localPort, UDP_PORT remotePort)
+{
+	UDP_SOCKET s;
+	UDP_SOCKET_INFO *p;
+
+	if(localPort == 0u)
+		localPort = GetNextLocalPort();
+
+	p = UDPSocketInfo;
+	for ( s = 0; s < MAX_UDP_SOCKETS; s++ )
+	{
+		if(p->localPort == INVALID_UDP_PORT)
+		{
+			p->localPort = localPort;
+			p->remotePort = remotePort;
+			p->retryCount = 0;
+			p->retryInterval = UDP_ARP_RETRY_TIMEOUT;
+			p->smState = UDP_OPENED;
+
+			switch(remoteHostType)
+			{
+				case UDP_OPEN_NODE_INFO:
+					memcpy((void*)&p->remoteNode, (void*)(PTR_BASE)remoteHost, sizeof(p->remoteNode));
+					break;
+
+				case UDP_OPEN_IP_ADDRESS:
+					p->remoteNode.IPAddr.Val = remoteHost;
+					if((p->remoteNode.IPAddr.Val == 0xFFFFFFFFul) ||
+					   (p->remoteNode.IPAddr.Val == (AppConfig.MyIPAddr.Val | ~AppConfig.MyMask.Val)))
+					{
+						// Broadcast
+						memset((void*)&p->remoteNode.MACAddr, 0xFF, sizeof(p->remoteNode.MACAddr));
+					}
+					else if((p->remoteNode.IPAddr.v[0] & 0xF0) == 0xE0)
+					{
+						// Multicast, low 23 bits of the group under 01-00-5E
+						p->remoteNode.MACAddr.v[0] = 0x01;
+						p->remoteNode.MACAddr.v[1] = 0x00;
+						p->remoteNode.MACAddr.v[2] = 0x5E;
+						p->remoteNode.MACAddr.v[3] = 0x7F & p->remoteNode.IPAddr.v[1];
+						p->remoteNode.MACAddr.v[4] = p->remoteNode.IPAddr.v[2];
+						p->remoteNode.MACAddr.v[5] = p->remoteNode.IPAddr.v[3];
+					}
+					else
+					{
+						p->smState = UDP_GATEWAY_SEND_ARP;
+					}
+					break;
+
+				default:	// UDP_OPEN_SERVER
+					// Reply to the sender of the last datagram, broadcast until one arrives
+					memset((void*)&p->remoteNode, 0xFF, sizeof(p->remoteNode));
+					break;
+			}
+
+			return s;
+		}
+		p++;
+	}
+
+	return (UDP_SOCKET)INVALID_UDP_SOCKET;
+}
+
+/*****************************************************************************
+  Function:
+	BOOL UDPIsOpened(UDP_SOCKET socket)
+
+  Summary:
+	Determines if a socket can transmit.
+
+  Precondition:
+	UDPOpenEx() was called.
+
+  Parameters:
+	socket - the socket to check
+
+  Return Values:
+	TRUE - the remote MAC address is known
+	FALSE - still resolving, or not a valid socket
+  ***************************************************************************/
+BOOL UDPIsOpened(UDP_SOCKET socket)
+{
+	if(socket >= MAX_UDP_SOCKETS)
+		return FALSE;
+
+	return UDPSocketInfo[socket].smState == UDP_OPENED;
+}
+
+/*****************************************************************************
+  Function:
+	void UDPClose(UDP_SOCKET s)
+
+  Summary:
+	Closes a UDP socket and frees the handle.
+	
+  Description:
+	Closes a UDP socket and frees the handle.  Call this function to release
+	a socket and return it to the pool for use by future communications.
+
+  Precondition:
+	UDPInit() must have been called.
+
+  Parameters:
+	s - The socket handle to be released.  If an illegal handle value is 
+		provided, the function safely does nothing.
+
+  Returns:
+	None
+  ***************************************************************************/
+void UDPClose(UDP_SOCKET s)
+{
+	if(s >= MAX_UDP_SOCKETS)
+		return;
+
+	UDPSocketInfo[s].localPort = INVALID_UDP_PORT;
+	UDPSocketInfo[s].remoteNode.IPAddr.Val = 0x00000000;
+	UDPSocketInfo[s].smState = UDP_CLOSED;
+
+	if(LastPutSocket == s)
+		LastPutSocket = INVALID_UDP_SOCKET;
+}
+
+/****************************************************************************
+  Section:
+	Transmit Functions
+  ***************************************************************************/
+
+/*****************************************************************************
+  Function:
+	WORD UDPIsPutReady(UDP_SOCKET s)
+
+  Summary:
+	Determines how many bytes can be written to the UDP socket.
+
+  Description:
+	This function determines if bytes can be written to the specified UDP
+	socket.  It also prepares the UDP module for writing by setting the 
+	indicated socket as the currently active connection.
+
+  Precondition:
+	UDPInit() must have been previously called.
+
+  Parameters:
+	s - The socket to be made active
+
+  Returns:
+	The number of bytes that can be written to this socket.  0 while the 
+	remote MAC address is being resolved or the MAC is still transmitting.
+  ***************************************************************************/
+WORD UDPIsPutReady(UDP_SOCKET s)
+{
+	if(!UDPIsOpened(s))
+		return 0;
+
+	if(!MACIsTxReady())
+		return 0;
+
+	if(LastPutSocket != s)
+	{
+		LastPutSocket = s;
+		UDPTxCount = 0;
+		UDPSetTxBuffer(0);
+	}
+
+	activeUDPSocket = s;
+
+	return MAC_TX_BUFFER_SIZE - sizeof(IP_HEADER) - sizeof(UDP_HEADER) - UDPTxCount;
+}
+
+/*****************************************************************************
+  Function:
+	BOOL UDPPut(BYTE v)
+
+  Summary:
+	Writes a byte to the currently active socket.
+
+  Precondition:
+	UDPIsPutReady() was previously called to specify the current socket.
+
+  Parameters:
+	v - The byte to be loaded into the transmit buffer.
+
+  Return Values:
+  	TRUE - The byte was successfully written to the socket.
+  	FALSE - The transmit buffer is already full and so the write failed.
+  ***************************************************************************/
+BOOL UDPPut(BYTE v)
+{
+	// See if we are out of transmit space.
+	if(wPutOffset >= (MAC_TX_BUFFER_SIZE - sizeof(IP_HEADER) - sizeof(UDP_HEADER)))
+	{
+		return FALSE;
+	}
+
+    // Load application data byte
+    MACPut(v);
+	wPutOffset++;
+	if(wPutOffset > UDPTxCount)
+		UDPTxCount = wPutOffset;
+
+    return TRUE;
+}
+
+/*****************************************************************************
+  Function:
+	WORD UDPPutArray(BYTE *cData, WORD wDataLen)
+
+  Summary:
+	Writes an array of bytes to the currently active socket.
+
+  Precondition:
+	UDPIsPutReady() was previously called to specify the current socket.
+
+  Parameters:
+	cData - The array to write to the socket.
+	wDataLen - Number of bytes from cData to be written.
+
+  Returns:
+  	The number of bytes successfully placed in the UDP transmit buffer.  If
+  	this value is less than wDataLen, then the buffer became full and the
+  	input was truncated.
+  ***************************************************************************/
+WORD UDPPutArray(BYTE *cData, WORD wDataLen)
+{
+	WORD wTemp;
+
+	wTemp = (MAC_TX_BUFFER_SIZE - sizeof(IP_HEADER) - sizeof(UDP_HEADER)) - wPutOffset;
+	if(wTemp < wDataLen)
+	{
+		wDataLen = wTemp;
+	}
+
+	wPutOffset += wDataLen;
+	if(wPutOffset > UDPTxCount)
+		UDPTxCount = wPutOffset;
+
+    // Load application data bytes
+    MACPutArray(cData, wDataLen);
+
+    return wDataLen;
+}
+
+/*****************************************************************************
+  Function:
+	void UDPFlush(void)
+
+  Summary:
+	Transmits all pending data in a UDP socket.
+
+  Description:
+	This function builds a UDP packet with the pending TX data and marks it 
+	for transmission over the network interface.  With UDP_USE_TX_CHECKSUM 
+	the checksum is computed over the pseudo header and the packet in the 
+	MAC TX buffer, using the same buffer checksum routine as TCP.  There 
+	is no UDP state machine to remember that the packet was sent, so there 
+	is no resend if it gets lost on the network.
+
+  Precondition:
+	UDPIsPutReady() was previously called to specify the current socket, and
+	data has been written to the socket using the UDPPut family of functions.
+
+  Parameters:
+	None
+
+  Returns:
+	None
+  ***************************************************************************/
+void UDPFlush(void)
+{
+    UDP_HEADER      h;
+    UDP_SOCKET_INFO *p;
+    WORD			wUDPLength;
+
+    p = &UDPSocketInfo[activeUDPSocket];
+
+	wUDPLength = UDPTxCount + sizeof(UDP_HEADER);
+
+	// Generate the correct UDP header
+    h.SourcePort        = swaps(p->localPort);
+    h.DestinationPort   = swaps(p->remotePort);
+    h.Length            = swaps(wUDPLength);
+	h.Checksum 			= 0x0000;
+    
+	// Calculate IP pseudoheader checksum if we are going to enable 
+	// the checksum field
+	#if defined(UDP_USE_TX_CHECKSUM)
+	{
+		PSEUDO_HEADER   pseudoHeader;
+		
+		pseudoHeader.SourceAddress	= AppConfig.MyIPAddr;
+		pseudoHeader.DestAddress    = p->remoteNode.IPAddr;
+		pseudoHeader.Zero           = 0x0;
+		pseudoHeader.Protocol       = IP_PROT_UDP;
+		pseudoHeader.Length			= wUDPLength;
+		SwapPseudoHeader(pseudoHeader);
+		h.Checksum = ~CalcIPChecksum((BYTE*)&pseudoHeader, sizeof(pseudoHeader));
+	}
+	#endif
+
+	// Position the hardware write pointer where we will need to 
+	// begin writing the IP header
+	MACSetWritePtr(BASE_TX_ADDR + sizeof(ETHER_HEADER));
+	
+	// Write IP header to packet
+	IPPutHeader(&p->remoteNode, IP_PROT_UDP, wUDPLength);
+
+    // Write UDP header to packet
+    MACPutArray((BYTE*)&h, sizeof(h));
+    
+	// Calculate the final UDP checksum and write it in, if enabled
+	#if defined(UDP_USE_TX_CHECKSUM)
+	{
+        WORD_VAL        udpChecksum;
+
+		MACSetReadPtr(BASE_TX_ADDR + sizeof(ETHER_HEADER) + sizeof(IP_HEADER));
+		udpChecksum.Val = MACCalcTxChecksum(wUDPLength);
+		if(udpChecksum.Val == 0x0000u)
+			udpChecksum.Val = 0xFFFF;	// 0 means no checksum was computed
+
+		MACSetWritePtr(BASE_TX_ADDR + sizeof(ETHER_HEADER) + sizeof(IP_HEADER) + 6);	// 6 is the offset to the Checksum field in UDP_HEADER
+		MACPutArray((BYTE*)&udpChecksum, sizeof(udpChecksum));
+	}
+	#endif
+    
+	// Transmit the packet
+    MACFlush();
+
+	// Reset packet size counter for the next TX operation
+    UDPTxCount = 0;
+	LastPutSocket = INVALID_UDP_SOCKET;
+}
+
+/****************************************************************************
+  Section:
+	Receive Functions
+  ***************************************************************************/
+
+/*****************************************************************************
+  Function:
+	WORD UDPIsGetReady(UDP_SOCKET s)
+
+  Summary:
+	Determines how many bytes can be read from the UDP socket.
+
+  Description:
+	This function determines if bytes can be read from the specified UDP
+	socket.  It also prepares the UDP module for reading by setting the 
+	indicated socket as the currently active connection.
+
+  Precondition:
+	UDPInit() must have been previously called.
+
+  Parameters:
+	s - The socket to be made active (which has already been opened or is
+		listening)
+
+  Returns:
+	The number of bytes that can be read from this socket.
+  ***************************************************************************/
+WORD UDPIsGetReady(UDP_SOCKET s)
+{
+	activeUDPSocket = s;
+
+	return (SocketWithRxData == s) ? UDPRxCount : 0;
+}
+
+/*****************************************************************************
+  Function:
+	BOOL UDPGet(BYTE *v)
+
+  Summary:
+	Reads a byte from the currently active socket.
+
+  Precondition:
+	UDPIsGetReady() was previously called to specify the current socket.
+
+  Parameters:
+	v - The buffer to receive the data being read.
+
+  Return Values:
+  	TRUE - A byte was successfully read
+  	FALSE - No data remained in the read buffer
+  ***************************************************************************/
+BOOL UDPGet(BYTE *v)
+{
+	// Make sure that there is data to return
+    if((wGetOffset >= UDPRxCount) || (SocketWithRxData != activeUDPSocket))
+        return FALSE;
+
+    *v = MACGet();
+    wGetOffset++;
+
+    return TRUE;
+}
+
+/*****************************************************************************
+  Function:
+	WORD UDPGetArray(BYTE *cData, WORD wDataLen)
+
+  Summary:
+	Reads an array of bytes from the currently active socket.
+
+  Precondition:
+	UDPIsGetReady() was previously called to specify the current socket.
+
+  Parameters:
+	cData - The buffer to receive the bytes being read.  If NULL, the bytes are 
+			simply discarded without being written anywhere (effectively skips 
+			over the bytes in the RX buffer, although if you need to skip a lot 
+			of data, seeking using the UDPSetRxBuffer() will be more efficient).
+	wDateLen - Number of bytes to be read from the socket.
+
+  Returns:
+  	The number of bytes successfully read from the UDP buffer.  If this
+  	value is less than wDataLen, then the buffer was emptied and no more 
+  	data is available.
+  ***************************************************************************/
+WORD UDPGetArray(BYTE *cData, WORD wDataLen)
+{
+	WORD wBytesAvailable;
+	
+	// Make sure that there is data to return
+	if((wGetOffset >= UDPRxCount) || (SocketWithRxData != activeUDPSocket))
+		return 0;
+
+	// Make sure we don't try to read more data than exists
+	wBytesAvailable = UDPRxCount - wGetOffset;
+	if(wBytesAvailable < wDataLen)
+		wDataLen = wBytesAvailable;
+
+	wDataLen = MACGetArray(cData, wDataLen);
+    wGetOffset += wDataLen;
+
+    return wDataLen;
+}
+
+/*****************************************************************************
+  Function:
+	void UDPDiscard(void)
+
+  Summary:
+	Discards any remaining RX data from a UDP socket.
+
+  Description:
+	This function discards any remaining received data in the currently 
+	active UDP socket.
+
+  Precondition:
+	UDPIsGetReady() was previously called to select the currently active
+	socket.
+
+  Parameters:
+	None
+
+  Returns:
+	None
+
+  Remarks:
+	It is safe to call this function more than is necessary.  If no data is
+	available, this function does nothing.
+  ***************************************************************************/
+void UDPDiscard(void)
+{
+	if(!Flags.bWasDiscarded)
+	{
+		MACDiscardRx();
+		UDPRxCount = 0;
+		SocketWithRxData = INVALID_UDP_SOCKET;
+		Flags.bWasDiscarded = 1;
+	}
+}
+
+/****************************************************************************
+  Section:
+	Data Processing Functions
+  ***************************************************************************/
+
+/*****************************************************************************
+  Function:
+	BOOL UDPProcess(NODE_INFO *remoteNode, IP_ADDR *localIP, WORD len)
+
+  Summary:
+	Handles an incoming UDP segment.
+
+  Description:
+	This function handles an incoming UDP segment to determine if it is 
+	acceptable and should be handed to one of the stack applications for
+	processing.
+
+  Precondition:
+	UDPInit() has been called an a UDP segment is ready in the MAC buffer.
+
+  Parameters:
+	remoteNode - Remote node info
+	localIP - Local IP address
+	len - Total length of UDP semgent.
+
+  Return Values:
+	TRUE - A valid packet is waiting and the stack applications should be
+		called to handle it.
+	FALSE - The packet was discarded.
+  ***************************************************************************/
+BOOL UDPProcess(NODE_INFO *remoteNode, IP_ADDR *localIP, WORD len)
+{
+    UDP_HEADER		h;
+    UDP_SOCKET		s;
+    PSEUDO_HEADER	pseudoHeader;
+    DWORD_VAL		checksums;
+
+	UDPRxCount = 0;
+
+    // Retrieve UDP header.
+    MACGetArray((BYTE*)&h, sizeof(h));
+
+    h.SourcePort        = swaps(h.SourcePort);
+    h.DestinationPort   = swaps(h.DestinationPort);
+    h.Length            = swaps(h.Length) - sizeof(UDP_HEADER);
+
+	// See if we need to validate the checksum field (0x0000 is disabled)
+	if(h.Checksum)
+	{
+	    // Calculate IP pseudoheader checksum.
+	    pseudoHeader.SourceAddress		= remoteNode->IPAddr;
+	    pseudoHeader.DestAddress.Val	= localIP->Val;
+	    pseudoHeader.Zero				= 0x0;
+	    pseudoHeader.Protocol			= IP_PROT_UDP;
+	    pseudoHeader.Length				= len;
+
+	    SwapPseudoHeader(pseudoHeader);
+	
+	    checksums.w[0] = ~CalcIPChecksum((BYTE*)&pseudoHeader,
+	                                    sizeof(pseudoHeader));
+	
+	    // Now calculate UDP packet checksum in NIC RAM -- should match pseudoHeader
+	    IPSetRxBuffer(0);
+	    checksums.w[1] = CalcIPBufferChecksum(len);
+	
+	    if(checksums.w[0] != checksums.w[1])
+	    {
+	        MACDiscardRx();
+	        return FALSE;
+	    }
+	}
+
+    s = FindMatchingSocket(&h, remoteNode, localIP);
+    if(s == INVALID_UDP_SOCKET)
+    {
+        // If there is no matching socket, There is no one to handle
+        // this data.  Discard it.
+        MACDiscardRx();
+		return FALSE;
+    }
+    else
+    {
+		SocketWithRxData = s;
+        UDPRxCount = h.Length;
+        Flags.bFirstRead = 1;
+		Flags.bWasDiscarded = 0;
+    }
+
+	// Start reading the application data
+	UDPSetRxBuffer(0);
+
+    return TRUE;
+}
+
+/*****************************************************************************
+  Function:
+	static UDP_SOCKET FindMatchingSocket(UDP_HEADER *h, NODE_INFO *remoteNode,
+                                    IP_ADDR *localIP)
+
+  Summary:
+	Matches an incoming UDP segment to a currently active socket.
+	
+  Description:
+	This function attempts to match an incoming UDP segment to a currently
+	active socket for processing.  A socket opened as a server takes the 
+	sender as its remote node, so replies go back to it.
+
+  Precondition:
+	UDP segment header and IP header have both been retrieved.
+
+  Parameters:
+	h - The UDP header that was received.
+	remoteNode - IP and MAC of the remote node that sent this segment.
+	localIP - IP address that this segment was destined for.
+
+  Returns:
+	A UDP_SOCKET handle of a matching socket, or INVALID_UDP_SOCKET when no
+	match could be made.
+  ***************************************************************************/
+static UDP_SOCKET FindMatchingSocket(UDP_HEADER *h,
+                                     NODE_INFO *remoteNode,
+                                     IP_ADDR *localIP)
+{
+	UDP_SOCKET s;
+	UDP_SOCKET partialMatch;
+	UDP_SOCKET_INFO *p;
+
+	partialMatch = INVALID_UDP_SOCKET;
+
+	p = UDPSocketInfo;
+    for ( s = 0; s < MAX_UDP_SOCKETS; s++ )
+	{
+		// This packet is said to be matching with current socket:
+		// 1. If its destination port matches with our local port and
+		// 2. Packet source IP address matches with previously saved socket remote IP address and
+		// 3. Packet source port number matches with previously saved socket remote port number
+		if(p->localPort == h->DestinationPort)
+		{
+			if(p->remotePort == h->SourcePort)
+			{
+				if(p->remoteNode.IPAddr.Val == remoteNode->IPAddr.Val)
+				{
+					return s;
+				}
+			}
+
+			partialMatch = s;
+		}
+		p++;
+	}
+
+	if(partialMatch != INVALID_UDP_SOCKET)
+	{
+		p = &UDPSocketInfo[partialMatch];
+
+		// Only a server socket follows whoever talks to it
+		if(p->remoteNode.IPAddr.Val == 0xFFFFFFFFul || p->remotePort == 0u)
+		{
+			memcpy((void*)&p->remoteNode, (const void*)remoteNode, sizeof(p->remoteNode));
+			p->remotePort = h->SourcePort;
+		}
+	}
+
+	return partialMatch;
+}
+
+/*****************************************************************************
+  Function:
+	void UDPSetTxBuffer(WORD wOffset)
+
+  Summary:
+	Moves the pointer within the TX buffer.
+	
+  Description:
+	This function allows the write location within the TX buffer to be 
+	specified.  Future calls to UDPPut, UDPPutArray, UDPPutString, etc will
+	write data from the indicated location.
+
+  Precondition:
+	UDPIsPutReady() was previously called to specify the current socket.
+
+  Parameters:
+	wOffset - Offset from beginning of UDP packet data payload to place the
+		write pointer.
+
+  Returns:
+  	None
+  ***************************************************************************/
+void UDPSetTxBuffer(WORD wOffset)
+{
+	IPSetTxBuffer(wOffset+sizeof(UDP_HEADER));
+	wPutOffset = wOffset;
+}
+
+/*****************************************************************************
+  Function:
+	void UDPSetRxBuffer(WORD wOffset)
+
+  Summary:
+	Moves the pointer within the RX buffer.
+	
+  Description:
+	This function allows the read location within the RX buffer to be 
+	specified.  Future calls to UDPGet and UDPGetArray will read data from
+	the indicated location forward.
+
+  Precondition:
+	UDPInit() must have been called and a UDP segment is ready in the RX 
+	buffer.
+
+  Parameters:
+	wOffset - Offset from beginning of UDP packet data payload to place the
+		read pointer.
+
+  Returns:
+  	None
+  ***************************************************************************/
+void UDPSetRxBuffer(WORD wOffset)
+{
+	IPSetRxBuffer(wOffset+sizeof(UDP_HEADER));
+	wGetOffset = wOffset;
+}
+
+/*****************************************************************************
+  Function:
+	static UDP_PORT GetNextLocalPort(void)
+
+  Summary:
+	Picks the next free local port number.
+
+  Returns:
+	A port between LOCAL_UDP_PORT_START_NUMBER and LOCAL_UDP_PORT_END_NUMBER
+	that no socket is using.
+  ***************************************************************************/
+static UDP_PORT GetNextLocalPort(void)
+{
+	static UDP_PORT nextPort = LOCAL_UDP_PORT_START_NUMBER;
+	UDP_SOCKET s;
+
+	while(1)
+	{
+		if(++nextPort > LOCAL_UDP_PORT_END_NUMBER)
+			nextPort = LOCAL_UDP_PORT_START_NUMBER;
+
+		for ( s = 0; s < MAX_UDP_SOCKETS; s++ )
+		{
+			if(UDPSocketInfo[s].localPort == nextPort)
+				break;
+		}
+
+		if(s == MAX_UDP_SOCKETS)
+			return nextPort;
+	}
+}
+
+#endif //#if defined(STACK_USE_UDP)
@@ -66,6 +66,12 @@
 	#include "TcpServerCanFormat.h" 
 #endif
 
+#ifdef STACK_USE_UDP_TELEMETRY
+	#include "TelemetryFormat.h"
+#endif
+
+#include "Profiler.h"
+
 #include <p30F6014a.h>
 //#include "TCPmodbus.h"
 //#include "A37474.h"
@@ -105,10 +111,22 @@ static BYTE         eth_message_from_GUI_get_index;
 
 static BYTE         eth_cal_to_GUI_put_index;
 static BYTE         eth_cal_to_GUI_get_index;
-
-static BYTE         send_high_speed_data_buffer;  /* bit 0 high for buffer A, bit 1 high for buffer B */
 #endif
 
+#define PULSE_LOG_PORT  9761
+
+ETMPulseLogEntry    pulse_log_buffer_a[PULSE_LOG_ENTRIES];
+ETMPulseLogEntry    pulse_log_buffer_b[PULSE_LOG_ENTRIES];
+unsigned int        pulse_log_overrun;         /* pulses dropped because both buffers were full */
+
+static volatile BYTE send_high_speed_data_buffer[2];  /* [SEND_BUFFER_A] / [SEND_BUFFER_B] set while waiting to be streamed */
+static WORD         pulse_log_sequence;
+
+#define UDP_TELEMETRY_PORT  9762
+//#define UDP_TELEMETRY_GROUP (239ul | 1ul<<8 | 37ul<<16 | 74ul<<24)   // 239.1.37.74, unicast to MyRemIPAddr when not defined
+
+ETMTelemetryRecord  telemetry_record;
+
 /****************************************************************************
   Function:
     static void InitializeBoard(void)
@@ -306,6 +324,154 @@ void TCPmodbusSetRemoteIPAddress(unsigned char byte4, unsigned char byte3, unsig
   AppConfig.MyRemIPAddr.Val |= byte1;
 }
 
+//
+// Hand a full pulse log buffer to the stream, called from the pulse path
+//
+void SendPulseData(unsigned int buffer_select)
+{
+  send_high_speed_data_buffer[buffer_select & 1] = 1;
+}
+
+unsigned int PulseDataBufferFree(unsigned int buffer_select)
+{
+  return (send_high_speed_data_buffer[buffer_select & 1] == 0);
+}
+
+//
+// Result of the ENC28J60 SPI self-test run by TCPmodbus_init()
+//
+unsigned int TCPmodbusGetSPIFault(void)
+{
+  MAC_SPI_TEST_RESULT result;
+
+  MACGetSPITestResult(&result);
+  if (!result.bFault)
+    return 0;
+  if (result.wErrors[result.Profile] == 0)
+    return 0xFFFF;
+  return result.wErrors[result.Profile];
+}
+
+#ifdef STACK_USE_PULSE_LOG_SERVER
+/****************************************************************************
+  Function:
+    static void PulseLogServer(unsigned int reset_TCP)
+
+  Description:
+    Streams full pulse log buffers, A then B, to the client on PULSE_LOG_PORT.
+    Each buffer goes out in one write of a 4 word header
+    (MODBUS_WR_PULSE_LOG, sequence, entries, overrun count) and the
+    MAX_DATA_SIZE bytes of entries, then is flushed.  Without a client the
+    buffers are released right away so the pulse path never backs up.
+
+  Parameters:
+    reset_TCP - close the connection and listen again
+***************************************************************************/
+static void PulseLogServer(unsigned int reset_TCP)
+{
+  static TCP_SOCKET socket;
+  static BYTE       send_select = SEND_BUFFER_A;
+  static enum
+  {
+    SM_HOME = 0,
+    SM_LISTENING,
+    SM_CLOSING,
+  } state = SM_HOME;
+  WORD header[4];
+
+  if (reset_TCP) {
+    state = SM_CLOSING;
+  }
+
+  switch(state)
+  {
+    case SM_HOME:
+      socket = TCPOpen(0, TCP_OPEN_SERVER, PULSE_LOG_PORT, TCP_PURPOSE_PULSE_LOG_SERVER);
+      if(socket == INVALID_SOCKET)
+        return;
+
+      state = SM_LISTENING;
+      break;
+
+    case SM_LISTENING:
+      if (!send_high_speed_data_buffer[send_select])
+        return;
+
+      if (TCPIsConnected(socket)) {
+        if (TCPIsPutReady(socket) < sizeof(header) + MAX_DATA_SIZE)
+          return;   // wait for the last buffer to be acked, the pulse path counts any overrun
+
+        header[0] = MODBUS_WR_PULSE_LOG;
+        header[1] = pulse_log_sequence++;
+        header[2] = PULSE_LOG_ENTRIES;
+        header[3] = pulse_log_overrun;
+        TCPPutArray(socket, (BYTE*)header, sizeof(header));
+        TCPPutArray(socket, (BYTE*)(send_select == SEND_BUFFER_A ? pulse_log_buffer_a : pulse_log_buffer_b), MAX_DATA_SIZE);
+        TCPFlush(socket);
+      }
+
+      send_high_speed_data_buffer[send_select] = 0;
+      send_select ^= 1;
+      break;
+
+    case SM_CLOSING:
+      TCPClose(socket);
+
+      state = SM_HOME;
+      break;
+  }
+}
+#endif
+
+#ifdef STACK_USE_UDP_TELEMETRY
+/****************************************************************************
+  Function:
+    static void TelemetryPublisher(void)
+
+  Description:
+    Sends telemetry_record as one datagram to UDP_TELEMETRY_PORT on the
+    remote IP (or UDP_TELEMETRY_GROUP).  The datagram is a MODBUS_WR_TELEMETRY
+    byte and one delta encoded record (TelemetryFormat.h), a new socket
+    starts with a keyframe.  Called every 10ms, nothing is queued: if the
+    remote MAC is not resolved yet or the MAC is still sending, the
+    snapshot is counted in skipped and dropped.
+***************************************************************************/
+static void TelemetryPublisher(void)
+{
+  static UDP_SOCKET       socket = INVALID_UDP_SOCKET;
+  static DWORD            remote_host;
+  static TELEMETRY_FORMAT format;
+  static BYTE             datagram[1 + TELEMETRY_MAX_RECORD];
+  DWORD                   host;
+  WORD                    length;
+
+#ifdef UDP_TELEMETRY_GROUP
+  host = UDP_TELEMETRY_GROUP;
+#else
+  host = AppConfig.MyRemIPAddr.Val;
+#endif
+
+  if ((socket == INVALID_UDP_SOCKET) || (host != remote_host)) {
+    UDPClose(socket);
+    remote_host = host;
+    TelemetryFormatReset(&format);
+    socket = UDPOpenEx(host, UDP_OPEN_IP_ADDRESS, 0, UDP_TELEMETRY_PORT);
+    if (socket == INVALID_UDP_SOCKET)
+      return;
+  }
+
+  if (UDPIsPutReady(socket) < sizeof(datagram)) {
+    telemetry_record.skipped++;
+    return;
+  }
+
+  datagram[0] = MODBUS_WR_TELEMETRY;
+  length = 1 + TelemetryEncode(&format, (unsigned int*)&telemetry_record, &datagram[1]);
+  UDPPutArray(datagram, length);
+  UDPFlush();
+}
+#endif
+
 //
 // called once for initilization.
 //
@@ -361,7 +527,9 @@ void TCPmodbus_task(unsigned int reset_TCP)
   // This task performs normal stack task including checking
   // for incoming packet, type of packet and calling
   // appropriate stack entity to process it.
+  ProfileEnter(PROFILE_STACK_TASK);
   StackTask();
+  ProfileExit(PROFILE_STACK_TASK);
         
   
   // This tasks invokes each of the core stack application tasks
@@ -372,8 +540,13 @@ void TCPmodbus_task(unsigned int reset_TCP)
 #endif
 
 #ifdef STACK_USE_GENERIC_TCP_SERVER_EXAMPLE 
-  GenericTCPServer(reset_TCP);
-  DoTcpCanCommand();
+  ProfileEnter(PROFILE_TCP_SERVER);
+  GenericTCPServer(reset_TCP);  // also runs DoTcpCanCommand() between receive and send
+  ProfileExit(PROFILE_TCP_SERVER);
+#endif
+
+#ifdef STACK_USE_PULSE_LOG_SERVER
+  PulseLogServer(reset_TCP);
 #endif
 
 #ifdef STACK_USE_MODBUS_TCP_SERVER
@@ -385,6 +558,19 @@ void TCPmodbus_task(unsigned int reset_TCP)
 //  ExecuteCommands();
 
 }
+//
+// Need to call this every 10ms from the control loop
+//
+void TCPmodbus_10ms_task(void)
+{
+#ifdef STACK_USE_GENERIC_TCP_SERVER_EXAMPLE 
+  TcpCanSubscriptionTask();
+#endif
+
+#ifdef STACK_USE_UDP_TELEMETRY
+  TelemetryPublisher();
+#endif
+}
 
 
 
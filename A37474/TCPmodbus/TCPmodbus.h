@@ -29,12 +29,28 @@ void TCPmodbus_init(IPCONFIG* ip_config);
 
 void TCPmodbus_task(unsigned int reset_TCP);
 
+void TCPmodbus_10ms_task(void);
+
 unsigned int SendCalibrationDataToGUI(unsigned int index, unsigned int scale, unsigned int offset);
 
 void SendPulseData(unsigned int buffer_select);
 #define SEND_BUFFER_A            1
 #define SEND_BUFFER_B            0
 
+unsigned int PulseDataBufferFree(unsigned int buffer_select);
+/*
+  The pulse path fills one buffer while the other is streamed.  When a buffer is
+  full call SendPulseData() and switch to the other one, if it is not free yet
+  the pulse is dropped and counted in pulse_log_overrun.
+*/
+
+unsigned int TCPmodbusGetSPIFault(void);
+/*
+  0 if the ENC28J60 SPI link passed its self-test at 8MHz or faster, else the
+  mismatched bytes at the fastest clock (0xFFFF if it could not be tested).
+  There is no slower fallback, the Ethernet is not reliable while this is set.
+*/
+
 
 
 //#define TEST_MODBUS	   1
@@ -43,9 +59,48 @@ void SendPulseData(unsigned int buffer_select);
 
 #define MAX_TX_SIZE    800	 // ethernet header for TCP/modbus is 60 bytes
 #define MAX_DATA_SIZE  640	// leave some room for modbus header
+#define PULSE_LOG_WRITE_SIZE  (8 + MAX_DATA_SIZE)   // header + one buffer, PulseLogServer() writes it whole
 
 #define ETH_EVENT_SIZE  100
 
+typedef struct {
+  unsigned int pulse_count;             // counts every grid pulse, gaps show dropped pulses
+  unsigned int time_10ms;               // run time counter when the pulse was logged
+  unsigned int capture;                 // TMR2 at the grid pulse edge, 0.8us per count
+  unsigned int gun_i_peak;              // latest gun peak current reading
+} ETMPulseLogEntry;
+
+#define PULSE_LOG_ENTRIES   (MAX_DATA_SIZE / sizeof(ETMPulseLogEntry))
+
+extern ETMPulseLogEntry pulse_log_buffer_a[PULSE_LOG_ENTRIES];
+extern ETMPulseLogEntry pulse_log_buffer_b[PULSE_LOG_ENTRIES];
+extern unsigned int     pulse_log_overrun;
+
+#define TELEMETRY_LOG_WORDS 16
+#define TELEMETRY_ADC_WORDS 17
+
+typedef struct {
+  unsigned int log_data[TELEMETRY_LOG_WORDS];
+  unsigned int state_message;
+  unsigned int control_state;
+  unsigned int fault_register;
+  unsigned int warning_register;
+  unsigned int fpga_raw_high;           // last 32 bits read from the FPGA
+  unsigned int fpga_raw_low;
+  unsigned int adc_raw[TELEMETRY_ADC_WORDS];  // last MAX1230 read, before scaling
+  unsigned int timestamp_high;          // TimestampGet() when the record was filled
+  unsigned int timestamp_low;
+  unsigned int skipped;                 // snapshots not sent because the MAC was busy
+} ETMTelemetryRecord;
+
+#define TELEMETRY_FIELDS    (sizeof(ETMTelemetryRecord) / sizeof(unsigned int))
+
+extern ETMTelemetryRecord telemetry_record;
+/*
+  Fill everything but skipped before TCPmodbus_10ms_task(), it is sent as
+  one delta encoded record, see TelemetryFormat.h
+*/
+
 enum
 {
 	MODBUS_WR_HVLAMBDA = 1, 	
@@ -62,6 +117,7 @@ enum
 	
 	MODBUS_WR_ONE_CAL_ENTRY,
 	MODBUS_WR_PULSE_LOG,
+	MODBUS_WR_TELEMETRY,
 	MODBUS_RD_COMMAND_DETAIL,
 
 
@@ -95,6 +95,7 @@
 
 
 #include "TcpServerCanFormat.h"
+#include "Profiler.h"
 #include "..\A37474.h"
 #include "..\A37474_CONFIG.h"
 
@@ -115,6 +116,7 @@ unsigned char sdo_trig_enable;
 
 CANMSG tcp_can_in_buffer[TCP_CAN_INPUT_BUFFER_SIZE]; 
 CANMSG tcp_can_out_buffer[TCP_CAN_OUTPUT_BUFFER_SIZE]; 
+unsigned long tcp_can_in_timestamp[TCP_CAN_INPUT_BUFFER_SIZE];  // TimestampGet() when each command was taken from the socket
 
 signed char tcp_can_input_get_ptr;  // pointer to get data from buffer
 signed char tcp_can_input_put_ptr;  // pointer to put data into buffer
@@ -122,6 +124,12 @@ signed char tcp_can_input_put_ptr;  // pointer to put data into buffer
 signed char tcp_can_output_get_ptr;  // pointer to get data from buffer
 signed char tcp_can_output_put_ptr;  // pointer to put data into buffer
 
+TCP_CAN_SUBSCRIPTION tcp_can_sub[TCP_CAN_SUB_SIZE];
+unsigned char tcp_can_sub_count;
+unsigned int  tcp_can_sub_period;    // min period for the next subscription, in 10ms
+unsigned int  tcp_can_sub_deadband;  // deadband for the next subscription
+unsigned int  tcp_can_sub_skipped;   // pushes deferred because the output buffer was full
+
 
 /*****************************************************************************
   Function:
@@ -151,6 +159,7 @@ void GenericTCPServer(unsigned int resetTCP)
 {
 	WORD wMaxGet, wMaxPut;
 	int buf_room;
+	BOOL bPut;
     
 	static TCP_SOCKET	MySocket;
 	static enum _TCPServerState
@@ -172,13 +181,18 @@ void GenericTCPServer(unsigned int resetTCP)
 			if(MySocket == INVALID_SOCKET)
 				return;
 
+			// Request/response traffic: no coalescing or delayed ACKs on this socket
+			TCPSetOptions(MySocket, TCP_OPTION_NODELAY | TCP_OPTION_QUICKACK);
+
 			TCPServerState = SM_LISTENING;
 			break;
 
 		case SM_LISTENING:
 			// See if anyone is connected to us
-			if(!TCPIsConnected(MySocket))
+			if(!TCPIsConnected(MySocket)) {
+				tcp_can_sub_count = 0;	// subscriptions belong to the connection
 				return;
+			}
 
 
 			// Figure out how many bytes have been received and how many we can transmit.
@@ -186,32 +200,51 @@ void GenericTCPServer(unsigned int resetTCP)
 
 	     	buf_room = (tcp_can_input_get_ptr - tcp_can_input_put_ptr - 1) & (TCP_CAN_INPUT_BUFFER_SIZE - 1);	 /* & 0x0f */
             
-            if (wMaxGet >= 8 && buf_room > 0)
+            // take every whole frame the client has pipelined, as long as there is room
+            while (wMaxGet >= 8 && buf_room > 0)
             {
 				// Transfer the data out of the TCP RX FIFO and into our local processing buffer.
 				tcp_can_in_buffer[tcp_can_input_put_ptr].length = TCPGetArray(MySocket, &tcp_can_in_buffer[tcp_can_input_put_ptr].bytes[0], 8);
+				tcp_can_in_timestamp[tcp_can_input_put_ptr] = TimestampGet();
                 
             	tcp_can_input_put_ptr++;
 	            tcp_can_input_put_ptr &= (TCP_CAN_INPUT_BUFFER_SIZE - 1);
 
+                wMaxGet -= 8;
+                buf_room--;
             }
 			
-            // any data out?
-		    if (tcp_can_output_put_ptr != tcp_can_output_get_ptr)
-		    {
-            	wMaxPut = TCPIsPutReady(MySocket);	// Get TCP TX FIFO free space
+            // answer every pipelined request while the longest response still fits,
+            // so they all leave in this pass.  Segmented uploads queue several frames at once.
+            bPut = FALSE;
+            wMaxPut = TCPIsPutReady(MySocket);	// Get TCP TX FIFO free space
+            for (;;)
+            {
+		        while (tcp_can_output_put_ptr != tcp_can_output_get_ptr && wMaxPut >= 8)
+		        {
+				    // Transfer the data out of our local processing buffer and into the TCP TX FIFO.
+				    TCPPutArray(MySocket, &tcp_can_out_buffer[tcp_can_output_get_ptr].bytes[0], 8);
                 
-                if (wMaxPut >= 8) 
-                {
-					// Transfer the data out of our local processing buffer and into the TCP TX FIFO.
-					TCPPutArray(MySocket, &tcp_can_out_buffer[tcp_can_output_get_ptr].bytes[0], 8);
-			
-					// No need to perform any flush.  TCP data in TX FIFO will automatically transmit itself after it accumulates for a while.  If you want to decrease latency (at the expense of wasting network bandwidth on TCP overhead), perform and explicit flush via the TCPFlush() API.
                     tcp_can_output_get_ptr++;
-			        tcp_can_output_get_ptr &= (TCP_CAN_OUTPUT_BUFFER_SIZE - 1);
-		        }       
+		            tcp_can_output_get_ptr &= (TCP_CAN_OUTPUT_BUFFER_SIZE - 1);
+			
+                    wMaxPut -= 8;
+                    bPut = TRUE;
+		        }
+
+                buf_room = (tcp_can_output_get_ptr - tcp_can_output_put_ptr - 1) & (TCP_CAN_OUTPUT_BUFFER_SIZE - 1);
+                if (!TcpCanGotCommand() || buf_room < SDO_REC_MAX_FRAMES)
+                    break;
+
+                ProfileEnter(PROFILE_TCP_CAN_COMMAND);
+                DoTcpCanCommand();
+                ProfileExit(PROFILE_TCP_CAN_COMMAND);
+            }
 		          
-		    }
+            // end of the pass: one segment for everything queued, carrying the ACK for the requests
+            if (bPut) {
+                TCPFlush(MySocket);
+            }
 	
 
 			break;
@@ -247,6 +280,10 @@ void InitTcpCan(void)
     tcp_can_output_get_ptr = 0;
     tcp_can_output_put_ptr = 0;
 
+    tcp_can_sub_count = 0;
+    tcp_can_sub_period = 0;
+    tcp_can_sub_deadband = 0;
+    tcp_can_sub_skipped = 0;
 
 } // InitCan()
 
@@ -270,25 +307,349 @@ int TcpCanGotCommand(void)
 }*/
 /////////////////////////////////////////////////////////////////////////
 // put_response_to_buffer 
-// 
+// returns 0 and drops the frame when the output buffer is full
 //
-void PutResponseToBuffer(unsigned char length, unsigned char * data)
+unsigned char PutResponseToBuffer(unsigned char length, unsigned char * data)
 {
    char next_xmit_ptr;
    unsigned char i;
    // rare chance to check output buffer overflow
 
    next_xmit_ptr = (tcp_can_output_put_ptr + 1) & (TCP_CAN_OUTPUT_BUFFER_SIZE - 1);
-   //if (next_xmit_ptr != XmitPtr(); /* can_output_get_ptr */  // overwrite if buffer overflow
+   if (next_xmit_ptr != tcp_can_output_get_ptr)
    {
       tcp_can_out_buffer[tcp_can_output_put_ptr].length = length;
   	  for (i = 0; i < length; i++)
   			tcp_can_out_buffer[tcp_can_output_put_ptr].bytes[i] = *(data + i);
       tcp_can_output_put_ptr = next_xmit_ptr;
+      return 1;
    }
    // else output buffer overflows
+   return 0;
+}
+/////////////////////////////////////////////////////////////////////////
+// SdoPutWord
+// little endian word into sdo data bytes
+//
+static void SdoPutWord(unsigned char * value, unsigned int word)
+{
+    value[0] = word & 0x00ff;
+    value[1] = (word >> 8) & 0x00ff;
+}
+
+/////////////////////////////////////////////////////////////////////////
+// SdoPutLong
+// little endian long into sdo data bytes
+//
+static void SdoPutLong(unsigned char * value, unsigned long data)
+{
+    SdoPutWord(&value[0], data & 0xffff);
+    SdoPutWord(&value[2], data >> 16);
+}
+
+/////////////////////////////////////////////////////////////////////////
+// SdoProfileMean
+//
+static unsigned long SdoProfileMean(const PROFILE_PROBE * p)
+{
+    return p->count ? p->sum / p->count : 0;
+}
+
+/////////////////////////////////////////////////////////////////////////
+// SdoIndexIsRegister
+// indexes whose words are bits or states, a change of one count matters
+// as much as any other so they are pushed on every change
+//
+static unsigned char SdoIndexIsRegister(unsigned long sdo_index)
+{
+    switch (sdo_index) {
+    case SDO_IDX_RESET_CMD:
+    case SDO_IDX_ZERO_HTD:
+    case SDO_IDX_HTR_CMD:
+    case SDO_IDX_HV_CMD:
+    case SDO_IDX_TRIG_CMD:
+    case SDO_IDX_GD_STATE:
+    case SDO_IDX_GD_FAULT:
+        return 1;
+    }
+    return 0;
+}
 
+/////////////////////////////////////////////////////////////////////////
+// SdoWordMoved
+// the low word of now moved more than the deadband away from last
+//
+static unsigned char SdoWordMoved(unsigned long now, unsigned long last, unsigned int deadband)
+{
+    unsigned int a = now & 0xffff;
+    unsigned int b = last & 0xffff;
+
+    return (a > b ? a - b : b - a) > deadband;
 }
+
+/////////////////////////////////////////////////////////////////////////
+// SdoReadIndex
+// fill the 4 data bytes of an upload for one object index
+// unknown or write only indexes read back as 0
+//
+void SdoReadIndex(unsigned long sdo_index, unsigned char * value)
+{
+    unsigned int set_value;
+    unsigned int ipl_save;
+
+    value[0] = 0;
+    value[1] = 0;
+    value[2] = 0;
+    value[3] = 0;
+
+    switch (sdo_index) {
+    case SDO_IDX_DEVICE_NAME:
+    case SDO_IDX_FW_NAME:
+    	value[0] = '7';
+        value[1] = '4';
+        value[2] = '7';
+        value[3] = '4';
+     break;
+
+    case SDO_IDX_HW_VERSION:
+    	value[0] = INTERFACE_HARDWARE_REV;   //TARGET_CUSTOMER_HARDWARE_REV & 0xff;
+     break;
+
+    case SDO_IDX_FW_VERSION:
+    	value[0] = FIRMWARE_MINOR_REV & 0xff;
+        value[1] = FIRMWARE_BRANCH & 0xff;
+        value[2] = FIRMWARE_AGILE_REV & 0xff;
+     break;
+
+    case SDO_IDX_RESET_CMD:
+        value[0] = (unsigned char) global_data_A37474.reset_active & 0xff; //sdo_reset_cmd_active;
+     break;
+
+    case SDO_IDX_ZERO_HTD:
+        value[0] = sdo_htd_timer_reset;
+     break;
+
+    case SDO_IDX_HTR_CMD:
+    	value[0] = sdo_htr_enable;
+     break;
+
+    case SDO_IDX_HV_CMD:
+    	value[0] = sdo_hv_enable;
+     break;
+
+    case SDO_IDX_TRIG_CMD:
+    	value[0] = sdo_trig_enable;
+     break;
+
+    case SDO_IDX_EF_REF:
+    	SdoPutWord(value, global_data_A37474.heater_voltage_target);
+     break;
+
+    case SDO_IDX_EG_REF:
+    	SdoPutWord(value, global_data_A37474.analog_output_top_voltage.set_point);
+     break;
+
+    case SDO_IDX_EK_REF:
+    	SdoPutWord(value, global_data_A37474.analog_output_high_voltage.set_point);
+     break;
+
+    case SDO_IDX_EF_READ:
+    	SdoPutWord(value, global_data_A37474.input_htr_v_mon.reading_scaled_and_calibrated);
+     break;
+
+    case SDO_IDX_IF_READ:
+    	SdoPutWord(value, global_data_A37474.input_htr_i_mon.reading_scaled_and_calibrated);
+     break;
+
+    case SDO_IDX_EC_READ:
+    	SdoPutWord(value, global_data_A37474.input_bias_v_mon.reading_scaled_and_calibrated / 10);
+     break;
+
+    case SDO_IDX_EG_READ:
+    	SdoPutWord(value, global_data_A37474.input_top_v_mon.reading_scaled_and_calibrated);
+     break;
+
+    case SDO_IDX_EK_READ:
+    	SdoPutWord(value, global_data_A37474.input_hv_v_mon.reading_scaled_and_calibrated);
+     break;
+
+    case SDO_IDX_IKP_READ:
+    	SdoPutWord(value, global_data_A37474.input_gun_i_peak.reading_scaled_and_calibrated / 10);
+     break;
+
+    case SDO_IDX_HTD_REMAIN:
+	    if (global_data_A37474.control_state == STATE_HEATER_RAMP_UP) {
+	      set_value = (global_data_A37474.heater_ramp_up_time + HEATER_WARM_UP_TIME) / 100;
+	    } else if (global_data_A37474.heater_warm_up_time_remaining > 100) {
+	      set_value = global_data_A37474.heater_warm_up_time_remaining / 100;
+	    } else {
+	      set_value = 0;
+	    }
+    	SdoPutWord(value, set_value);
+     break;
+
+    case SDO_IDX_GD_STATE:
+    	SdoPutWord(value, global_data_A37474.state_message);
+//        	if (sdo_htr_enable)      	txData[6] |= 0x0001;
+//            if (sdo_hv_enable)  	 	txData[6] |= 0x0008;
+//            if (sdo_pulsetop_enable) 	txData[6] |= 0x0004;
+//            if (sdo_trig_enable)     	txData[6] |= 0x0010;
+//            if (sdo_reset_cmd_active)	txData[6] |= 0x0020;
+//            if (sdo_hv_bypass)			txData[6] |= 0x0040;
+     break;
+
+    case SDO_IDX_GD_FAULT:
+    	SdoPutWord(&value[0], _FAULT_REGISTER);
+    	SdoPutWord(&value[2], _WARNING_REGISTER);
+     break;
+
+    case SDO_IDX_SUB_CONFIG:
+    	SdoPutWord(&value[0], tcp_can_sub_period);
+    	SdoPutWord(&value[2], tcp_can_sub_deadband);
+     break;
+
+    case SDO_IDX_SUB_ADD:
+    	value[0] = tcp_can_sub_count;
+    	SdoPutWord(&value[2], tcp_can_sub_skipped);
+     break;
+
+    case SDO_IDX_PROF_LOOPS:
+    	SdoPutLong(value, ProfileGetLoopsPerSecond());
+     break;
+
+    // the tick may run from the Timer2 interrupt, hold it off so longs are not torn
+    case SDO_IDX_TICK_PERIOD_MIN:
+    	CONTROL_TASK_LOCK(ipl_save);
+    	SdoPutLong(value, global_data_A37474.tick_count > 1 ? global_data_A37474.tick_period_min : 0);
+    	CONTROL_TASK_UNLOCK(ipl_save);
+     break;
+
+    case SDO_IDX_TICK_PERIOD_MAX:
+    	CONTROL_TASK_LOCK(ipl_save);
+    	SdoPutLong(value, global_data_A37474.tick_period_max);
+    	CONTROL_TASK_UNLOCK(ipl_save);
+     break;
+
+    case SDO_IDX_TICK_LATENCY:
+    	CONTROL_TASK_LOCK(ipl_save);
+    	SdoPutLong(value, global_data_A37474.tick_latency_max);
+    	CONTROL_TASK_UNLOCK(ipl_save);
+     break;
+
+    case SDO_IDX_TICK_OVERRUNS:
+    	SdoPutWord(&value[0], global_data_A37474.tick_overruns);
+    	SdoPutWord(&value[2], global_data_A37474.tick_sequence - global_data_A37474.tick_background_sequence);
+     break;
+
+    default:
+    	// profiler probes, subindex is the probe
+    	if ((sdo_index & 0xff) >= PROFILE_PROBES)
+    		break;
+    	CONTROL_TASK_LOCK(ipl_save);
+    	if ((sdo_index & 0xffff00) == SDO_IDX_PROF_MAX)
+    		SdoPutLong(value, ProfileGetProbe(sdo_index & 0xff)->max);
+    	else if ((sdo_index & 0xffff00) == SDO_IDX_PROF_MEAN)
+    		SdoPutLong(value, SdoProfileMean(ProfileGetProbe(sdo_index & 0xff)));
+    	CONTROL_TASK_UNLOCK(ipl_save);
+     break;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////
+// record contents, 4 bytes per index in the order listed
+//
+static const unsigned long sdo_rec_monitors[] = {
+    SDO_IDX_EF_READ, SDO_IDX_IF_READ, SDO_IDX_EC_READ, SDO_IDX_EG_READ,
+    SDO_IDX_EK_READ, SDO_IDX_IKP_READ, SDO_IDX_HTD_REMAIN
+};
+
+static const unsigned long sdo_rec_status[] = {
+    SDO_IDX_GD_STATE, SDO_IDX_GD_FAULT, SDO_IDX_RESET_CMD, SDO_IDX_HTR_CMD,
+    SDO_IDX_HV_CMD, SDO_IDX_TRIG_CMD, SDO_IDX_EF_REF, SDO_IDX_EG_REF, SDO_IDX_EK_REF
+};
+
+static const unsigned long sdo_rec_identity[] = {
+    SDO_IDX_DEVICE_NAME, SDO_IDX_HW_VERSION, SDO_IDX_FW_NAME, SDO_IDX_FW_VERSION
+};
+
+static const unsigned long sdo_rec_tick[] = {
+    SDO_IDX_TICK_PERIOD_MIN, SDO_IDX_TICK_PERIOD_MAX, SDO_IDX_TICK_LATENCY, SDO_IDX_TICK_OVERRUNS
+};
+
+unsigned long sdo_rec_list[SDO_REC_LIST_SIZE];  // client defined list for SDO_IDX_REC_LIST
+unsigned char sdo_rec_list_count;
+
+unsigned char sdo_rec_payload[SDO_REC_MAX_PAYLOAD];
+
+/////////////////////////////////////////////////////////////////////////
+// SdoSegmentedUpload
+// stream a record back as initiate frame (0x41, size in bytes 4..7)
+// followed by 7 byte segments, toggle bit 0x10, last segment has bit 0 set
+// and the unused byte count in bits 1..3.
+// Aborts (0x80) when the output buffer can't hold the whole response,
+// the abort is dropped too when the buffer is full.
+//
+static void SdoSegmentedUpload(unsigned char * data, unsigned char * payload, unsigned int size)
+{
+    unsigned char txData[8];
+    unsigned char toggle;
+    unsigned char n;
+    unsigned char i;
+    unsigned int  frames;
+    int buf_room;
+
+    frames = 1 + (size > 7 ? (size + 6) / 7 : 1);   // at least one segment
+    buf_room = (tcp_can_output_get_ptr - tcp_can_output_put_ptr - 1) & (TCP_CAN_OUTPUT_BUFFER_SIZE - 1);
+
+    txData[1] = data[1];
+    txData[2] = data[2];
+    txData[3] = data[3];
+
+    if (frames > buf_room) {
+        txData[0] = 0x80;   // abort transfer
+        txData[4] = 0x05;   // 0x05040005, out of memory
+        txData[5] = 0x00;
+        txData[6] = 0x04;
+        txData[7] = 0x05;
+        PutResponseToBuffer(8, &txData[0]);
+        return;
+    }
+
+    txData[0] = 0x41;   // segmented upload, size indicated
+    txData[4] = size & 0x00ff;
+    txData[5] = (size >> 8) & 0x00ff;
+    txData[6] = 0;
+    txData[7] = 0;
+    PutResponseToBuffer(8, &txData[0]);
+
+    toggle = 0;
+    do {
+        n = size > 7 ? 7 : size;
+        for (i = 0; i < 7; i++)
+            txData[1 + i] = i < n ? payload[i] : 0;
+        txData[0] = toggle | ((7 - n) << 1) | (size <= 7 ? 0x01 : 0x00);
+        PutResponseToBuffer(8, &txData[0]);
+
+        payload += n;
+        size -= n;
+        toggle ^= 0x10;
+    } while (size);
+}
+
+/////////////////////////////////////////////////////////////////////////
+// SdoRecordUpload
+// read every index of a record into the payload and stream it
+//
+static void SdoRecordUpload(unsigned char * data, const unsigned long * record, unsigned char count)
+{
+    unsigned char i;
+
+    for (i = 0; i < count; i++)
+        SdoReadIndex(record[i], &sdo_rec_payload[i * 4]);
+
+    SdoSegmentedUpload(data, &sdo_rec_payload[0], (unsigned int)count * 4);
+}
+
 /////////////////////////////////////////////////////////////////////////
 // can_process_command 
 // process and answer canopen commands
@@ -299,6 +660,9 @@ void CanProcessCommand(unsigned char length, unsigned char * data)
     unsigned long sdo_index;
     unsigned char is_upload;
     unsigned int set_value;
+    unsigned char i;
+    const PROFILE_PROBE * probe;
+    unsigned int ipl_save;
     
     if (length < 8) return;	  // ignore comm event
     
@@ -310,71 +674,69 @@ void CanProcessCommand(unsigned char length, unsigned char * data)
     txData[2] = data[2];
     txData[3] = data[3];
     
+    if (is_upload) {
+        switch (sdo_index) {
+        case SDO_IDX_REC_MONITORS:
+            SdoRecordUpload(data, sdo_rec_monitors, sizeof(sdo_rec_monitors) / sizeof(sdo_rec_monitors[0]));
+         return;
+
+        case SDO_IDX_REC_STATUS:
+            SdoRecordUpload(data, sdo_rec_status, sizeof(sdo_rec_status) / sizeof(sdo_rec_status[0]));
+         return;
+
+        case SDO_IDX_REC_IDENTITY:
+            SdoRecordUpload(data, sdo_rec_identity, sizeof(sdo_rec_identity) / sizeof(sdo_rec_identity[0]));
+         return;
+
+        case SDO_IDX_REC_TICK:
+            SdoRecordUpload(data, sdo_rec_tick, sizeof(sdo_rec_tick) / sizeof(sdo_rec_tick[0]));
+         return;
+
+        case SDO_IDX_REC_LOG_DATA:
+            for (i = 0; i < 16; i++)
+                SdoPutWord(&sdo_rec_payload[i * 2], slave_board_data.log_data[i]);
+            SdoPutWord(&sdo_rec_payload[32], _FAULT_REGISTER);
+            SdoPutWord(&sdo_rec_payload[34], _WARNING_REGISTER);
+            SdoSegmentedUpload(data, &sdo_rec_payload[0], 36);
+         return;
+
+        case SDO_IDX_REC_LIST:
+            SdoRecordUpload(data, sdo_rec_list, sdo_rec_list_count);
+         return;
+
+        default:
+            if (((sdo_index & 0xffff00) == SDO_IDX_PROF_PROBE) && ((sdo_index & 0xff) < PROFILE_PROBES)) {
+                CONTROL_TASK_LOCK(ipl_save);
+                probe = ProfileGetProbe(sdo_index & 0xff);
+                SdoPutLong(&sdo_rec_payload[0], probe->count ? probe->min : 0);
+                SdoPutLong(&sdo_rec_payload[4], probe->max);
+                SdoPutLong(&sdo_rec_payload[8], SdoProfileMean(probe));
+                SdoPutLong(&sdo_rec_payload[12], probe->count);
+                for (i = 0; i < PROFILE_HIST_BINS; i++)
+                    SdoPutWord(&sdo_rec_payload[16 + i * 2], probe->hist[i]);
+                CONTROL_TASK_UNLOCK(ipl_save);
+                SdoSegmentedUpload(data, &sdo_rec_payload[0], 16 + PROFILE_HIST_BINS * 2);
+                return;
+            }
+            SdoReadIndex(sdo_index, &txData[4]);
+         break;
+        }
+
+        PutResponseToBuffer(8, &txData[0]);
+        return;
+    }
     
     switch (sdo_index) {
     case SDO_IDX_DEVICE_NAME:
-    	if (is_upload) {
-	    	txData[4] = '7';
-	        txData[5] = '4';
-	        txData[6] = '7';
-	        txData[7] = '4';
-        }
-        else {
-        	txData[4] = 0xff;
-            txData[5] = 4;
-        }       
-     break;
-     
     case SDO_IDX_HW_VERSION:
-    	if (is_upload) {
-        	#if 0
-	    	txData[4] = 'C';
-	        txData[5] = ' ';
-	        txData[6] = ' ';
-	        txData[7] = ' ';
-            #else
-	    	txData[4] = INTERFACE_HARDWARE_REV;   //TARGET_CUSTOMER_HARDWARE_REV & 0xff;
-	        txData[5] = 0;
-	        txData[6] = 0;
-	        txData[7] = 0;
-            #endif
-        }
-        else {
-        	txData[4] = 0xff;
-            txData[5] = 4;
-        }    
-     break;
-   
     case SDO_IDX_FW_NAME:
-    	if (is_upload) {
-	    	txData[4] = '7';
-	        txData[5] = '4';
-	        txData[6] = '7';
-	        txData[7] = '4';
-        }
-        else {
-        	txData[4] = 0xff;
-            txData[5] = 4;
-        }    
-     break;
-      
     case SDO_IDX_FW_VERSION:
-    	if (is_upload) {
-	    	txData[4] = FIRMWARE_MINOR_REV & 0xff;     
-	        txData[5] = FIRMWARE_BRANCH & 0xff;  
-	        txData[6] = FIRMWARE_AGILE_REV & 0xff;
-	        txData[7] = 0;
-        }
-        else {
-        	txData[4] = 0xff;
-            txData[5] = 4;
-        }       
+    	txData[4] = 0xff;
+        txData[5] = 4;
      break;
 
     case SDO_IDX_RESET_CMD:
-    	if (is_upload)
-            txData[4] = (unsigned char) global_data_A37474.reset_active & 0xff; //sdo_reset_cmd_active;
-        else if (data[4] == 0 || data[4] == 0xff) {
+        if (data[4] == 0 || data[4] == 0xff) {
 
       //  	if (!sdo_reset_cmd_active && data[4])  
         	if (data[4])  global_data_A37474.ethernet_reset_cmd = 1;          //sdo_logic_reset = 1;	 
@@ -388,9 +750,7 @@ void CanProcessCommand(unsigned char length, unsigned char * data)
 
   
     case SDO_IDX_ZERO_HTD:
-    	if (is_upload)
-            txData[4] = sdo_htd_timer_reset;
-        else if (data[4] == 0xff) {        
+        if (data[4] == 0xff) {
 //          //	if (!sdo_htd_timer_reset) {
 //    			sdo_htd_timer_reset = 0xff;	
 //                software_skip_warmup = 1; 
@@ -404,9 +764,7 @@ void CanProcessCommand(unsigned char length, unsigned char * data)
      
      
     case SDO_IDX_HTR_CMD:
-    	if (is_upload)
-        	txData[4] = sdo_htr_enable;
-        else if (data[4] == 0 || data[4] == 0xff) {
+        if (data[4] == 0 || data[4] == 0xff) {
 
           //	if (sdo_htr_enable != data[4]) { // only act when value changes
             	if (data[4])  global_data_A37474.request_heater_enable = 1;
@@ -435,9 +793,7 @@ void CanProcessCommand(unsigned char length, unsigned char * data)
 #endif     
 	     
     case SDO_IDX_HV_CMD:
-    	if (is_upload)
-        	txData[4] = sdo_hv_enable;
-        else if (data[4] == 0 || data[4] == 0xff) {
+        if (data[4] == 0 || data[4] == 0xff) {
 
           //	if (sdo_hv_enable != data[4]) { // only act when value changes
 //            	if (data[4] && sdo_reset_cmd_active == 0)  PIN_HV_ON_SERIAL = OLL_SERIAL_ENABLE;
@@ -472,9 +828,7 @@ void CanProcessCommand(unsigned char length, unsigned char * data)
 #endif 
 
     case SDO_IDX_TRIG_CMD:
-    	if (is_upload)
-        	txData[4] = sdo_trig_enable;
-        else if (data[4] == 0 || data[4] == 0xff) {
+        if (data[4] == 0 || data[4] == 0xff) {
 
           //	if (sdo_trig_enable != data[4]) { // only act when value changes
             	if (data[4])  	        PIN_BEAM_ENABLE_SERIAL = OLL_SERIAL_ENABLE;
@@ -489,152 +843,86 @@ void CanProcessCommand(unsigned char length, unsigned char * data)
  
 
     case SDO_IDX_EF_REF:
-    	if (is_upload) {
-        	txData[4] = global_data_A37474.heater_voltage_target & 0x00ff;
-            txData[5] = (global_data_A37474.heater_voltage_target >> 8) & 0x00ff;
-        }
-        else {
-        	// check max, min range
-            set_value  = (unsigned int)data[5] << 8;
-            set_value += (unsigned int)data[4];
-            global_data_A37474.ethernet_htr_ref = set_value;
-            ETMEEPromWriteWord(0x680, set_value);
+    	// check max, min range
+        set_value  = (unsigned int)data[5] << 8;
+        set_value += (unsigned int)data[4];
+        global_data_A37474.ethernet_htr_ref = set_value;
+        ETMEEPromWriteWord(0x680, set_value);
 //            if (set_value <= MAX_PROGRAM_HTR_VOLTAGE)
 //            {                        
 //	        	global_data_A37474.heater_voltage_target = set_value;
 //            }
-        }
     
      break;
 			
     case SDO_IDX_EG_REF:
-    	if (is_upload) {
-        	txData[4] = global_data_A37474.analog_output_top_voltage.set_point & 0x00ff;
-            txData[5] = (global_data_A37474.analog_output_top_voltage.set_point >> 8) & 0x00ff;
-        }
-        else {
-        	// check max, min range
-            set_value  = (unsigned int)data[5] << 8;
-            set_value += (unsigned int)data[4];
-            global_data_A37474.ethernet_top_ref = set_value;
-            ETMEEPromWriteWord(0x681, set_value);
+    	// check max, min range
+        set_value  = (unsigned int)data[5] << 8;
+        set_value += (unsigned int)data[4];
+        global_data_A37474.ethernet_top_ref = set_value;
+        ETMEEPromWriteWord(0x681, set_value);
 //            if (set_value <= TOP_VOLTAGE_MAX_SET_POINT)  
 //            {    
 //            	ETMAnalogSetOutput(&global_data_A37474.analog_output_top_voltage, set_value);                    
 // 			}
-       }
         
      break;
 			
     case SDO_IDX_EK_REF:
-    	if (is_upload) {
-        	txData[4] = global_data_A37474.analog_output_high_voltage.set_point & 0x00ff;
-            txData[5] = (global_data_A37474.analog_output_high_voltage.set_point >> 8) & 0x00ff;
-        }
-        else {
-        	// check max, min range
-            set_value  = (unsigned int)data[5] << 8;
-            set_value += (unsigned int)data[4];
-            global_data_A37474.ethernet_hv_ref = set_value;
-            ETMEEPromWriteWord(0x682, set_value);
+    	// check max, min range
+        set_value  = (unsigned int)data[5] << 8;
+        set_value += (unsigned int)data[4];
+        global_data_A37474.ethernet_hv_ref = set_value;
+        ETMEEPromWriteWord(0x682, set_value);
 //            if (set_value >= HIGH_VOLTAGE_MIN_SET_POINT && set_value <= HIGH_VOLTAGE_MAX_SET_POINT)  
 //            {            
 //            	ETMAnalogSetOutput(&global_data_A37474.analog_output_high_voltage, set_value);                    
 //            }
-        }
         
      break;
 		 
-
-    case SDO_IDX_EF_READ:
-    	if (is_upload) {
-        	txData[4] = global_data_A37474.input_htr_v_mon.reading_scaled_and_calibrated & 0x00ff;
-        	txData[5] = (global_data_A37474.input_htr_v_mon.reading_scaled_and_calibrated >> 8) & 0x00ff;        
-    	}
+    case SDO_IDX_REC_LIST:
+        // bytes 4..6 carry an index in the same byte order as bytes 1..3, 0 clears the list
+        sdo_index = ((unsigned long)data[5] << 16) + ((unsigned long)data[4] << 8) + (unsigned long)data[6];
+        if (sdo_index == 0)
+            sdo_rec_list_count = 0;
+        else if (sdo_rec_list_count < SDO_REC_LIST_SIZE)
+            sdo_rec_list[sdo_rec_list_count++] = sdo_index;
+        else {
+            txData[4] = 0xff;   // list full
+            txData[5] = 4;
+        }
      break;
 			
-    case SDO_IDX_IF_READ:
-    	if (is_upload) {
-        	txData[4] = global_data_A37474.input_htr_i_mon.reading_scaled_and_calibrated & 0x00ff;
-        	txData[5] = (global_data_A37474.input_htr_i_mon.reading_scaled_and_calibrated >> 8) & 0x00ff;        
-    	}
-     break;
-		 
-     
-    case SDO_IDX_EC_READ:
-     	if (is_upload) {
-            set_value = global_data_A37474.input_bias_v_mon.reading_scaled_and_calibrated / 10;
-        	txData[4] = set_value & 0x00ff;
-        	txData[5] = (set_value >> 8) & 0x00ff;        
-    	}
+    case SDO_IDX_SUB_CONFIG:
+        tcp_can_sub_period    = ((unsigned int)data[5] << 8) + (unsigned int)data[4];
+        tcp_can_sub_deadband  = ((unsigned int)data[7] << 8) + (unsigned int)data[6];
      break;
 		 
-    case SDO_IDX_EG_READ:
-    	if (is_upload) {
-        	txData[4] = global_data_A37474.input_top_v_mon.reading_scaled_and_calibrated & 0x00ff;
-        	txData[5] = (global_data_A37474.input_top_v_mon.reading_scaled_and_calibrated >> 8) & 0x00ff;        
-    	}
-     break;
-		 
-    case SDO_IDX_EK_READ:
-    	if (is_upload) {
-        	txData[4] = global_data_A37474.input_hv_v_mon.reading_scaled_and_calibrated & 0x00ff;
-        	txData[5] = (global_data_A37474.input_hv_v_mon.reading_scaled_and_calibrated >> 8) & 0x00ff;
-     	}
+    case SDO_IDX_SUB_ADD:
+        // bytes 4..6 carry an index in the same byte order as bytes 1..3, 0 clears all subscriptions
+        sdo_index = ((unsigned long)data[5] << 16) + ((unsigned long)data[4] << 8) + (unsigned long)data[6];
+        if (sdo_index == 0)
+            tcp_can_sub_count = 0;
+        else if (tcp_can_sub_count < TCP_CAN_SUB_SIZE) {
+            tcp_can_sub[tcp_can_sub_count].index      = sdo_index;
+            tcp_can_sub[tcp_can_sub_count].last_value = 0;
+            tcp_can_sub[tcp_can_sub_count].min_period = tcp_can_sub_period;
+            tcp_can_sub[tcp_can_sub_count].deadband   = SdoIndexIsRegister(sdo_index) ? 0 : tcp_can_sub_deadband;
+            tcp_can_sub[tcp_can_sub_count].elapsed    = 0xffff;   // push on the next tick
+            tcp_can_sub_count++;
+        }
+        else {
+            txData[4] = 0xff;   // table full
+            txData[5] = 4;
+        }
      break;
 		 
-
-    case SDO_IDX_IKP_READ:
-    	if (is_upload) {
-            set_value = global_data_A37474.input_gun_i_peak.reading_scaled_and_calibrated /10;
-        	txData[4] = set_value & 0x00ff;
-        	txData[5] = (set_value >> 8) & 0x00ff;        
-    	}
-     break;
-		
-    case SDO_IDX_HTD_REMAIN:
-    	if (is_upload) {   
-		    if (global_data_A37474.control_state == STATE_HEATER_RAMP_UP) {
-		      set_value = (global_data_A37474.heater_ramp_up_time + HEATER_WARM_UP_TIME) / 100;
-		    } else if (global_data_A37474.heater_warm_up_time_remaining > 100) {
-		      set_value = global_data_A37474.heater_warm_up_time_remaining / 100;
-		    } else {
-		      set_value = 0;
-		    }
-        	txData[4] = set_value & 0x00ff;
-        	txData[5] = (set_value >> 8) & 0x00ff;        
-    	}    
-     break;
-   
-
-    case SDO_IDX_GD_STATE:
-    	if (is_upload) {        
-        	txData[4] = global_data_A37474.state_message & 0x00ff;
-            txData[5] = (global_data_A37474.state_message >> 8) & 0x00ff;
-            
-//        	if (sdo_htr_enable)      	txData[6] |= 0x0001;
-//            if (sdo_hv_enable)  	 	txData[6] |= 0x0008;
-//            if (sdo_pulsetop_enable) 	txData[6] |= 0x0004;
-//            if (sdo_trig_enable)     	txData[6] |= 0x0010;
-//            if (sdo_reset_cmd_active)	txData[6] |= 0x0020;
-//            if (sdo_hv_bypass)			txData[6] |= 0x0040;
-//            
-//            if (PIN_CUSTOMER_HV_ON == ILL_PIN_CUSTOMER_HV_ON_ENABLE_HV)  	 			txData[7] |= 0x0008;
-//            if (PIN_CUSTOMER_BEAM_ENABLE == ILL_PIN_CUSTOMER_BEAM_ENABLE_BEAM_ENABLED)  txData[7] |= 0x0010;
- 
-     	}    
-    
-     break;
-     
-    case SDO_IDX_GD_FAULT:
-    	if (is_upload) {
-        	set_value = _FAULT_REGISTER;
-        	txData[4] = set_value & 0x00ff;
-        	txData[5] = (set_value >> 8) & 0x00ff;
-            set_value = _WARNING_REGISTER;	
-        	txData[6] = set_value & 0x00ff;
-        	txData[7] = (set_value >> 8) & 0x00ff;            
-    	}
+    case SDO_IDX_PROF_RESET:
+        CONTROL_TASK_LOCK(ipl_save);
+        ProfileReset();
+        ResetControlTickStats();
+        CONTROL_TASK_UNLOCK(ipl_save);
      break;
 
 #if 0  // NA for now    
@@ -667,6 +955,8 @@ void DoTcpCanCommand(void)
 {
     CANMSG msg;
     unsigned char i;
+    unsigned long latency;
+    unsigned int ipl_save;
     
     msg.length = 0;
     
@@ -675,6 +965,7 @@ void DoTcpCanCommand(void)
         msg.length = tcp_can_in_buffer[tcp_can_input_get_ptr].length;
         for (i = 0; i < msg.length; i++)
         	msg.bytes[i] = tcp_can_in_buffer[tcp_can_input_get_ptr].bytes[i];
+        global_data_A37474.tcp_request_timestamp = tcp_can_in_timestamp[tcp_can_input_get_ptr];
     	
         tcp_can_input_get_ptr = (tcp_can_input_get_ptr + 1) & (TCP_CAN_INPUT_BUFFER_SIZE - 1);
     }
@@ -682,12 +973,75 @@ void DoTcpCanCommand(void)
 	if (msg.length) // got command
     {
 //    	TCP_bus_timeout_10ms = 0;   // reset can timeout
+        // reads and writes the data the 10ms tick works on
+        CONTROL_TASK_LOCK(ipl_save);
     	CanProcessCommand(msg.length, &msg.bytes[0]);
+        CONTROL_TASK_UNLOCK(ipl_save);
+
+        // queued behind pipelined commands counts too, that is what the client sees
+        latency = TIMESTAMP_TO_US(TimestampGet() - global_data_A37474.tcp_request_timestamp);
+        if (latency > global_data_A37474.tcp_response_latency_max) {
+            global_data_A37474.tcp_response_latency_max = latency;
+        }
     }
 
     
 }
 
+/////////////////////////////////////////////////////////////////////////
+// TcpCanSubscriptionTask
+// called every 10ms, pushes subscribed indexes as 0x43 upload frames
+// when either 16 bit word moved more than the deadband, or the refresh time
+// expired, but never faster than the min period of the subscription
+//
+void TcpCanSubscriptionTask(void)
+{
+    unsigned char txData[8];
+    unsigned char i;
+    unsigned long value;
+    int buf_room;
+    unsigned int ipl_save;
+    TCP_CAN_SUBSCRIPTION * sub;
+
+    buf_room = (tcp_can_output_get_ptr - tcp_can_output_put_ptr - 1) & (TCP_CAN_OUTPUT_BUFFER_SIZE - 1);
+
+    for (i = 0; i < tcp_can_sub_count; i++) {
+        sub = &tcp_can_sub[i];
+        if (sub->elapsed != 0xffff)
+            sub->elapsed++;
+
+        if (sub->elapsed < sub->min_period)
+            continue;
+
+        CONTROL_TASK_LOCK(ipl_save);
+        SdoReadIndex(sub->index, &txData[4]);
+        CONTROL_TASK_UNLOCK(ipl_save);
+        value  = ((unsigned long)txData[7] << 24) + ((unsigned long)txData[6] << 16);
+        value += ((unsigned int)txData[5] << 8) + txData[4];
+
+        // most indexes carry two unrelated words, the deadband applies to each
+        if (!SdoWordMoved(value, sub->last_value, sub->deadband)
+            && !SdoWordMoved(value >> 16, sub->last_value >> 16, sub->deadband)
+            && sub->elapsed < TCP_CAN_SUB_REFRESH_TIME)
+            continue;
+
+        if (buf_room == 0) {
+            tcp_can_sub_skipped++;   // try again next tick
+            continue;
+        }
+
+        txData[0] = 0x43;   // expedited upload, pushed
+        txData[1] = (sub->index >> 8) & 0xff;
+        txData[2] = (sub->index >> 16) & 0xff;
+        txData[3] = sub->index & 0xff;
+        PutResponseToBuffer(8, &txData[0]);
+        buf_room--;
+
+        sub->last_value = value;
+        sub->elapsed = 0;
+    }
+}
+
 /////////////////////////////////////////////////////////////////////////					  
 // GetEthernetResetEnable 																		  
 // return reset status														    
@@ -4,7 +4,7 @@
 
 
 #define TCP_CAN_INPUT_BUFFER_SIZE   16
-#define TCP_CAN_OUTPUT_BUFFER_SIZE  16
+#define TCP_CAN_OUTPUT_BUFFER_SIZE  32   /* power of 2, holds a whole segmented upload */
 
 #define TCP_BUS_TIMEOUT             100   /* in 10ms, timeout in 1s */
 
@@ -68,6 +68,38 @@
 
 #define SDO_IDX_GD_CTRL_STATE   0x007000 /* read control state, internal to ETM */
 
+// records, uploaded segmented: 0x41 initiate with byte count, then 7 byte segments
+#define SDO_IDX_REC_MONITORS    0x609000 /* EF, IF, EC, EG, EK, IKP reads and HTD remain, 4 bytes each */
+#define SDO_IDX_REC_STATUS      0x609100 /* state, fault/warning, commands and references, 4 bytes each */
+#define SDO_IDX_REC_IDENTITY    0x609200 /* device/fw names and versions, 4 bytes each */
+#define SDO_IDX_REC_LOG_DATA    0x609300 /* 16 log data words followed by fault and warning registers */
+#define SDO_IDX_REC_TICK        0x609400 /* 10ms tick period min/max, latency and overruns, 4 bytes each */
+#define SDO_IDX_REC_LIST        0x609F00 /* download appends an index (0 clears), upload reads them all */
+
+#define SDO_REC_LIST_SIZE       16
+#define SDO_REC_MAX_PAYLOAD     (SDO_REC_LIST_SIZE * 4)
+#define SDO_REC_MAX_FRAMES      (1 + (SDO_REC_MAX_PAYLOAD + 6) / 7)  /* initiate and segments of the largest record, the longest response */
+
+// subscriptions, pushed as 0x43 upload frames from the 10ms block
+#define SDO_IDX_SUB_CONFIG      0x609C00 /* bytes 4-5 min period in 10ms, bytes 6-7 deadband per 16 bit word (state and fault indexes push every change), used by the next add */
+#define SDO_IDX_SUB_ADD         0x609D00 /* download subscribes an index (0 clears), upload: count, deferred pushes */
+
+// profiler, times in timestamp counts (100nS), the subindex selects the probe, see Profiler.h
+#define SDO_IDX_PROF_LOOPS      0x60A000 /* main loop passes in the last second */
+#define SDO_IDX_PROF_RESET      0x60A001 /* download clears every probe, the loop rate and the tick timing */
+#define SDO_IDX_PROF_MAX        0x60A100 /* longest time of the probe */
+#define SDO_IDX_PROF_MEAN       0x60A200 /* mean time of the probe */
+#define SDO_IDX_PROF_PROBE      0x60A300 /* record: min, max, mean, samples, 4 bytes each, then the histogram words */
+
+// 10ms control tick timing, in timestamp counts (100nS)
+#define SDO_IDX_TICK_PERIOD_MIN 0x60A400 /* shortest time between the start of two ticks */
+#define SDO_IDX_TICK_PERIOD_MAX 0x60A401 /* longest time between the start of two ticks */
+#define SDO_IDX_TICK_LATENCY    0x60A402 /* longest time from the Timer2 period match to the start of a tick */
+#define SDO_IDX_TICK_OVERRUNS   0x60A403 /* bytes 0-1 late ticks, bytes 2-3 ticks whose background part has not run yet */
+
+#define TCP_CAN_SUB_SIZE          8
+#define TCP_CAN_SUB_REFRESH_TIME  100   /* in 10ms, push unchanged values every 1s */
+
 
 typedef struct {
   unsigned int  length;
@@ -75,15 +107,26 @@ typedef struct {
   // add time stamp?
 } CANMSG;
 
+typedef struct {
+  unsigned long index;
+  unsigned long last_value;             // value sent with the last push
+  unsigned int  min_period;             // in 10ms
+  unsigned int  deadband;
+  unsigned int  elapsed;                // in 10ms since the last push
+} TCP_CAN_SUBSCRIPTION;
+
 
 extern void DoTcpCanCommand(void);
 
 extern void InitTcpCan(void);
 extern int  TcpCanGotCommand(void); // check whether there is a command in input buffer
 //extern signed char CanBufferFull(unsigned char input);  // check whether input or output buffer is full
-extern void PutResponseToBuffer(unsigned char length, unsigned char * data);
+extern unsigned char PutResponseToBuffer(unsigned char length, unsigned char * data);  // 0 if the output buffer is full
+
+extern void SdoReadIndex(unsigned long sdo_index, unsigned char * value);
 
 extern void GenericTCPServer(unsigned int resetTCP);
+extern void TcpCanSubscriptionTask(void);
 
 extern unsigned int GetEthernetResetEnable(void);
 
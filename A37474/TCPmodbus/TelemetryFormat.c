@@ -0,0 +1,192 @@
+/*********************************************************************
+ *
+ *  Delta encoded telemetry records
+ *
+ *********************************************************************
+ * FileName:        TelemetryFormat.c
+ * Dependencies:    None
+ *
+ * Encodes the 10ms telemetry snapshot as the changed fields only, see
+ * TelemetryFormat.h for the record layout.  Plain C so the decoder can
+ * be built on a host with TELEMETRY_FORMAT_DECODER.
+ *
+ ********************************************************************/
+#define __TELEMETRYFORMAT_C
+
+#include "TelemetryFormat.h"
+
+
+
+//////////////////////////////////////////////////////////////////////////
+// TelemetryFormatReset
+// next record is a keyframe, a decoder waits for one
+//
+void TelemetryFormatReset(TELEMETRY_FORMAT* format)
+{
+  unsigned int n;
+
+  for (n = 0; n < TELEMETRY_FIELDS; n++) {
+    format->last[n] = 0;
+  }
+  format->records_to_keyframe = 0;
+  format->sequence = 0;
+  format->synced = 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// PutDelta
+// zig-zag varint of the 16 bit difference, returns the bytes written
+//
+static unsigned char PutDelta(unsigned char* record, unsigned int value, unsigned int last)
+{
+  unsigned int delta;
+  unsigned char length = 0;
+
+  delta = (value - last) & 0xFFFF;
+  if (delta & 0x8000) {
+    delta = (((~delta) & 0x7FFF) << 1) | 1;
+  } else {
+    delta <<= 1;
+  }
+
+  while (delta >= 0x80) {
+    record[length++] = (delta & 0x7F) | 0x80;
+    delta >>= 7;
+  }
+  record[length++] = delta;
+
+  return length;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// TelemetryEncode
+// keyframe every TELEMETRY_KEYFRAME_INTERVAL records, else bitmap + deltas
+//
+unsigned int TelemetryEncode(TELEMETRY_FORMAT* format, const unsigned int* fields, unsigned char* record)
+{
+  unsigned int  n;
+  unsigned int  length;
+  unsigned char keyframe;
+
+  keyframe = (format->records_to_keyframe == 0);
+  if (keyframe) {
+    format->records_to_keyframe = TELEMETRY_KEYFRAME_INTERVAL;
+  }
+  format->records_to_keyframe--;
+
+  record[0] = keyframe ? TELEMETRY_FLAG_KEYFRAME : 0;
+  record[1] = format->sequence++;
+  length = 2;
+
+  if (keyframe) {
+    for (n = 0; n < TELEMETRY_FIELDS; n++) {
+      length += PutDelta(&record[length], fields[n], 0);
+      format->last[n] = fields[n];
+    }
+    return length;
+  }
+
+  for (n = 0; n < TELEMETRY_BITMAP_SIZE; n++) {
+    record[2 + n] = 0;
+  }
+  length += TELEMETRY_BITMAP_SIZE;
+
+  for (n = 0; n < TELEMETRY_FIELDS; n++) {
+    if (((fields[n] ^ format->last[n]) & 0xFFFF) == 0) {
+      continue;
+    }
+    record[2 + (n >> 3)] |= 1 << (n & 7);
+    length += PutDelta(&record[length], fields[n], format->last[n]);
+    format->last[n] = fields[n];
+  }
+
+  return length;
+}
+
+
+#ifdef TELEMETRY_FORMAT_DECODER
+//////////////////////////////////////////////////////////////////////////
+// GetDelta
+// reads one zig-zag varint and applies it to last, returns the bytes used
+// or 0 if the varint runs past the record or 16 bits
+//
+static unsigned int GetDelta(const unsigned char* record, unsigned int length, unsigned int last, unsigned int* value)
+{
+  unsigned int  delta = 0;
+  unsigned int  used = 0;
+  unsigned char shift = 0;
+
+  do {
+    if ((used >= length) || (shift > 14)) {
+      return 0;
+    }
+    delta |= (unsigned int)(record[used] & 0x7F) << shift;
+    shift += 7;
+  } while (record[used++] & 0x80);
+
+  if (delta & 1) {
+    delta = (~(delta >> 1)) & 0xFFFF;
+  } else {
+    delta >>= 1;
+  }
+  *value = (last + delta) & 0xFFFF;
+
+  return used;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// TelemetryDecode
+// host side, decodes one record into fields
+//
+unsigned int TelemetryDecode(TELEMETRY_FORMAT* format, const unsigned char* record, unsigned int length, unsigned int* fields)
+{
+  unsigned int  n;
+  unsigned int  used;
+  unsigned int  size;
+  unsigned int  value[TELEMETRY_FIELDS];
+  unsigned char keyframe;
+
+  if (length < 2) {
+    return 0;
+  }
+
+  keyframe = (record[0] & TELEMETRY_FLAG_KEYFRAME) != 0;
+  if (!keyframe && (!format->synced || (record[1] != format->sequence))) {
+    format->synced = 0;
+    return 0;
+  }
+
+  used = 2;
+  if (!keyframe) {
+    used += TELEMETRY_BITMAP_SIZE;
+    if (used > length) {
+      return 0;
+    }
+  }
+
+  for (n = 0; n < TELEMETRY_FIELDS; n++) {
+    if (keyframe) {
+      size = GetDelta(&record[used], length - used, 0, &value[n]);
+    } else if (record[2 + (n >> 3)] & (1 << (n & 7))) {
+      size = GetDelta(&record[used], length - used, format->last[n], &value[n]);
+    } else {
+      value[n] = format->last[n];
+      continue;
+    }
+    if (size == 0) {
+      format->synced = 0;
+      return 0;
+    }
+    used += size;
+  }
+
+  for (n = 0; n < TELEMETRY_FIELDS; n++) {
+    format->last[n] = value[n];
+    fields[n] = value[n];
+  }
+  format->sequence = (record[1] + 1) & 0xFF;
+  format->synced = 1;
+
+  return used;
+}
+#endif
@@ -0,0 +1,64 @@
+#ifndef __TELEMETRYFORMAT_H
+#define __TELEMETRYFORMAT_H
+
+#include "TCPmodbus.h"
+
+/*
+  Delta encoded telemetry record
+
+  byte 0      flags, TELEMETRY_FLAG_KEYFRAME set on a keyframe
+  byte 1      sequence, advances by one on every record
+  keyframe:   every field follows, encoded against 0
+  delta:      a bitmap of TELEMETRY_BITMAP_SIZE bytes, bit n (byte n/8, bit n%8)
+              set when field n changed, then only the changed fields follow
+
+  Each field is the 16 bit difference to the last record, zig-zag mapped
+  (0, -1, 1, -2 ... become 0, 1, 2, 3 ...) and written as a varint, 7 bits
+  per byte, low bits first, bit 7 set when another byte follows.
+
+  A decoder that sees a sequence gap drops delta records until the next
+  keyframe, which comes every TELEMETRY_KEYFRAME_INTERVAL records.
+
+  The same file builds on a host, with TELEMETRY_FORMAT_DECODER defined, to
+  decode recorded streams.  Only 16 bits of each unsigned int are used.
+  test/ has a host round trip test, a benchmark that also runs on the
+  traces in test/traces, and telemetry_capture, which writes a trace from
+  the datagrams of a board.  Run make there.
+*/
+
+#define TELEMETRY_KEYFRAME_INTERVAL   100   /* records, 1s of 10ms snapshots */
+
+#define TELEMETRY_FLAG_KEYFRAME       0x80
+
+#define TELEMETRY_BITMAP_SIZE         ((TELEMETRY_FIELDS + 7) / 8)
+#define TELEMETRY_MAX_RECORD          (2 + TELEMETRY_BITMAP_SIZE + TELEMETRY_FIELDS * 3)
+
+typedef struct {
+  unsigned int  last[TELEMETRY_FIELDS];   // fields of the last record encoded / decoded
+  unsigned int  records_to_keyframe;      // 0 makes the next record a keyframe
+  unsigned char sequence;                 // sequence of the next record
+  unsigned char synced;                   // decoder only, last holds a valid record
+} TELEMETRY_FORMAT;
+
+
+void TelemetryFormatReset(TELEMETRY_FORMAT* format);
+/*
+  Starts a new stream, the next record encoded is a keyframe
+*/
+
+unsigned int TelemetryEncode(TELEMETRY_FORMAT* format, const unsigned int* fields, unsigned char* record);
+/*
+  Encodes TELEMETRY_FIELDS words into record, which must hold TELEMETRY_MAX_RECORD bytes
+  Returns the record length
+*/
+
+#ifdef TELEMETRY_FORMAT_DECODER
+unsigned int TelemetryDecode(TELEMETRY_FORMAT* format, const unsigned char* record, unsigned int length, unsigned int* fields);
+/*
+  Decodes one record into TELEMETRY_FIELDS words
+  Returns the bytes used, or 0 if the record is malformed or the decoder is
+  waiting for a keyframe.  fields is only written when a record is returned.
+*/
+#endif
+
+#endif
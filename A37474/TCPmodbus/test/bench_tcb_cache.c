@@ -0,0 +1,183 @@
+/*********************************************************************
+ *
+ *  TCB cache benchmark
+ *
+ *********************************************************************
+ * FileName:        bench_tcb_cache.c
+ * Dependencies:    TCPIPStack/TCP.c, sim_stack.c
+ *
+ * Host benchmark, see Makefile.  Runs the real TCP.c with the sockets
+ * of TCPIPENC28.h under alternating traffic on the two servers: a
+ * TCP-CAN client polling every 10ms, answered in the same pass and
+ * flushed like GenericTCPServer(), and a pulse log client taking one
+ * buffer every 200ms, written like PulseLogServer().  Reports the TCB
+ * cache counters, built once with TCP_TCB_CACHE_SIZE from the config
+ * and once with a single entry, which is the old single MyTCB.
+ *
+ ********************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim_stack.h"
+
+
+#define CAN_PORT            9760u
+#define PULSE_LOG_PORT      9761u
+#define BENCH_SECONDS       60u
+#define PASS_TIME           1500u    // uS, one main loop pass
+#define CAN_INTERVAL        10000u   // uS between TCP-CAN requests
+#define PULSE_LOG_INTERVAL  200000u  // uS to fill one pulse log buffer
+#define CAN_FRAME_SIZE      8u
+#define PULSE_LOG_SIZE      (8u + 640u)   // PULSE_LOG_WRITE_SIZE
+#define TARGET_TCB_SIZE     42u      // sizeof(TCB) on the dsPIC, see TCP.h
+
+static TCP_SOCKET can_socket;
+static TCP_SOCKET pulse_socket;
+static SIM_PEER can_client;
+static SIM_PEER pulse_client;
+
+static unsigned long long next_request;
+static unsigned long long next_buffer;
+static int pulse_ack_due;
+static unsigned long requests;
+static unsigned long answers;
+static unsigned long buffers;
+static unsigned long pulse_bytes;
+
+
+//////////////////////////////////////////////////////////////////////////
+// CanServer
+// GenericTCPServer(): answer every whole request, flush once
+//
+static void CanServer(void)
+{
+  BYTE frame[CAN_FRAME_SIZE];
+  int put = 0;
+
+  while (TCPIsGetReady(can_socket) >= CAN_FRAME_SIZE && TCPIsPutReady(can_socket) >= CAN_FRAME_SIZE) {
+    TCPGetArray(can_socket, frame, CAN_FRAME_SIZE);
+    frame[0] = 0x43;
+    TCPPutArray(can_socket, frame, CAN_FRAME_SIZE);
+    put = 1;
+  }
+  if (put)
+    TCPFlush(can_socket);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// PulseLogServer
+// PulseLogServer(): one whole buffer when it is full and fits
+//
+static void PulseLogServer(void)
+{
+  static BYTE buffer[PULSE_LOG_SIZE];
+
+  if (sim_now_us < next_buffer)
+    return;
+  if (TCPIsPutReady(pulse_socket) < PULSE_LOG_SIZE)
+    return;
+  TCPPutArray(pulse_socket, buffer, PULSE_LOG_SIZE);
+  TCPFlush(pulse_socket);
+  buffers++;
+  next_buffer += PULSE_LOG_INTERVAL;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// ClientsReceive
+// the TCP-CAN client ACKs with its next request, the pulse log client
+// ACKs in the next pass
+//
+static void ClientsReceive(void)
+{
+  SIM_SEGMENT segment;
+
+  while (SimTakeSegment(&segment)) {
+    if (segment.local_port == CAN_PORT) {
+      SimPeerReceived(&can_client, &segment);
+      answers += segment.len / CAN_FRAME_SIZE;
+    } else {
+      SimPeerReceived(&pulse_client, &segment);
+      pulse_bytes += segment.len;
+      if (segment.len)
+        pulse_ack_due = 1;
+    }
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Pass
+// StackTask() runs TCPTick() and takes in what the MAC received, then
+// the servers run in the order of the main loop
+//
+static void Pass(void)
+{
+  static const BYTE request[CAN_FRAME_SIZE] = {0x40};
+
+  TCPTick();
+  if (sim_now_us >= next_request) {
+    SimPeerSend(&can_client, PSH | ACK, request, sizeof(request));
+    requests++;
+    next_request += CAN_INTERVAL;
+  }
+  if (pulse_ack_due) {
+    SimPeerSend(&pulse_client, ACK, NULL, 0);
+    pulse_ack_due = 0;
+  }
+  CanServer();
+  PulseLogServer();
+  ClientsReceive();
+  sim_now_us += PASS_TIME;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Connect
+//
+static void Connect(SIM_PEER* client, BYTE ip, WORD port)
+{
+  SimPeerInit(client, ip, 40000u, port);
+  SimPeerSend(client, SYN, NULL, 0);
+  ClientsReceive();
+  SimPeerSend(client, ACK, NULL, 0);
+}
+
+
+int main(void)
+{
+  unsigned long long end;
+
+  SimInit();
+  can_socket = TCPOpen(0, TCP_OPEN_SERVER, CAN_PORT, TCP_PURPOSE_GENERIC_TCP_SERVER);
+  pulse_socket = TCPOpen(0, TCP_OPEN_SERVER, PULSE_LOG_PORT, TCP_PURPOSE_PULSE_LOG_SERVER);
+  TCPSetOptions(can_socket, TCP_OPTION_NODELAY | TCP_OPTION_QUICKACK);
+
+  next_request = (unsigned long long)-1;
+  next_buffer = (unsigned long long)-1;
+  Connect(&can_client, 20, CAN_PORT);
+  Connect(&pulse_client, 21, PULSE_LOG_PORT);
+  Pass();
+
+  TCBCacheHits = 0;
+  TCBCacheMisses = 0;
+  TCBCacheBytesSaved = 0;
+  next_request = sim_now_us + CAN_INTERVAL;
+  next_buffer = sim_now_us + PULSE_LOG_INTERVAL;
+  end = sim_now_us + BENCH_SECONDS * 1000000ull;
+  while (sim_now_us < end)
+    Pass();
+
+  printf("TCP_TCB_CACHE_SIZE %u, %u s of traffic: %lu TCP-CAN requests, %lu answered, %lu pulse log buffers, %lu bytes\n",
+         (unsigned int)TCP_TCB_CACHE_SIZE, BENCH_SECONDS,
+         requests, answers, buffers, pulse_bytes);
+  printf("  TCBCacheHits %lu, TCBCacheMisses %lu, hit rate %.1f%%\n",
+         (unsigned long)TCBCacheHits, (unsigned long)TCBCacheMisses,
+         100.0 * TCBCacheHits / (TCBCacheHits + TCBCacheMisses));
+  printf("  TCBCacheBytesSaved %lu with the %u byte host TCB, %lu with the %u byte dsPIC TCB, %.0f bytes/s\n",
+         (unsigned long)TCBCacheBytesSaved, (unsigned int)sizeof(TCB),
+         (unsigned long)(TCBCacheHits * 2u * TARGET_TCB_SIZE), TARGET_TCB_SIZE,
+         (double)TCBCacheHits * 2u * TARGET_TCB_SIZE / BENCH_SECONDS);
+  printf("  TCB bytes moved over SPI %lu with the dsPIC TCB, %.0f bytes/s\n",
+         (unsigned long)(TCBCacheMisses * 2u * TARGET_TCB_SIZE),
+         (double)TCBCacheMisses * 2u * TARGET_TCB_SIZE / BENCH_SECONDS);
+  return 0;
+}
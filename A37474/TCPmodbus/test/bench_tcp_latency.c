@@ -0,0 +1,240 @@
+/*********************************************************************
+ *
+ *  TCP-CAN request to response latency benchmark
+ *
+ *********************************************************************
+ * FileName:        bench_tcp_latency.c
+ * Dependencies:    TCPIPStack/TCP.c, sim_stack.c
+ *
+ * Host benchmark, see Makefile.  A client sends one 8 byte TCP-CAN
+ * request every 20ms to the real TCP.c, and a server written like
+ * GenericTCPServer() in TcpServerCanFormat.c answers each with one 8
+ * byte frame.  Each main loop pass runs StackTask(), which calls
+ * TCPTick() before it takes in received segments, then the server.
+ *
+ * Reports, with TCP_OPTION_NODELAY | TCP_OPTION_QUICKACK on and off,
+ * with and without the TCPFlush() at the end of a server pass, and for
+ * answers put in the pass that took the request or in the next one:
+ *   server   the time tcp_response_latency_max measures, from taking
+ *            the request out of the socket to putting the answer
+ *   wire     from the request reaching the MAC to the answer leaving it
+ *   ack      from the request reaching the MAC to a segment ACKing it
+ *   segs     segments sent per request, pure ACKs included
+ *
+ ********************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim_stack.h"
+
+
+#define BENCH_PORT          9760u
+#define BENCH_REQUESTS      2000u
+#define REQUEST_INTERVAL    20000u   // uS
+#define PASS_TIME           1500u    // uS, one main loop pass without the tick
+#define COMMAND_TIME        150u     // uS, CanProcessCommand()
+#define FRAME_SIZE          8u
+
+#define OPTIONS             (TCP_OPTION_NODELAY | TCP_OPTION_QUICKACK)
+
+typedef struct {
+  const char* name;
+  BYTE options;
+  int  flush;                        // TCPFlush() at the end of a pass that put frames
+  int  defer;                        // the answer is put one pass after the request is taken
+} BENCH_CASE;
+
+static const BENCH_CASE cases[] = {
+  {"off, no flush",              0,        0, 0},
+  {"on,  no flush",              OPTIONS,  0, 0},
+  {"off, flush",                 0,        1, 0},
+  {"on,  flush",                 OPTIONS,  1, 0},
+  {"off, no flush, next pass",   0,        0, 1},
+  {"on,  no flush, next pass",   OPTIONS,  0, 1},
+  {"off, flush, next pass",      0,        1, 1},
+  {"on,  flush, next pass",      OPTIONS,  1, 1},
+};
+
+typedef struct {
+  unsigned long long sum;
+  unsigned long long max;
+  unsigned long count;
+} BENCH_STAT;
+
+static TCP_SOCKET server;
+static SIM_PEER client;
+
+static unsigned long long request_time[BENCH_REQUESTS];   // request reached the MAC
+static unsigned long long next_request;
+static unsigned long requests;
+static unsigned long answered;
+static unsigned long acked;
+static DWORD request_base;                       // client snd_nxt before the first request
+static DWORD answer_base;                        // client rcv_nxt before the first answer
+
+static unsigned long long taken_time;            // request taken out of the socket
+static unsigned int deferred;                    // answers to put next pass
+
+static BENCH_STAT server_latency;
+static BENCH_STAT wire_latency;
+static BENCH_STAT ack_latency;
+
+
+//////////////////////////////////////////////////////////////////////////
+// Add
+//
+static void Add(BENCH_STAT* stat, unsigned long long value)
+{
+  stat->sum += value;
+  stat->count++;
+  if (value > stat->max)
+    stat->max = value;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Average
+//
+static double Average(const BENCH_STAT* stat)
+{
+  return stat->count ? (double)stat->sum / stat->count : 0.0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Server
+// GenericTCPServer() for one request per frame.  The answer is put as
+// soon as the request is taken, or in the next pass like one that waits
+// for the CAN bus.
+//
+static void Server(const BENCH_CASE* bench)
+{
+  BYTE frame[FRAME_SIZE] = {0x43};
+  int put = 0;
+
+  for (; deferred; deferred--) {
+    TCPPutArray(server, frame, FRAME_SIZE);
+    Add(&server_latency, sim_now_us - taken_time);
+    put = 1;
+  }
+
+  while (TCPIsGetReady(server) >= FRAME_SIZE && TCPIsPutReady(server) >= FRAME_SIZE) {
+    TCPGetArray(server, frame, FRAME_SIZE);
+    taken_time = sim_now_us;
+    sim_now_us += COMMAND_TIME;
+    frame[0] = 0x43;
+    if (bench->defer) {
+      deferred++;
+      continue;
+    }
+    TCPPutArray(server, frame, FRAME_SIZE);
+    Add(&server_latency, sim_now_us - taken_time);
+    put = 1;
+  }
+
+  if (put && bench->flush)
+    TCPFlush(server);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// ClientReceive
+// the client takes in what the server sent, and only ACKs with its next
+// request like a client waiting for an answer
+//
+static void ClientReceive(void)
+{
+  SIM_SEGMENT segment;
+
+  while (SimTakeSegment(&segment)) {
+    SimPeerReceived(&client, &segment);
+    while (acked < requests && (segment.flags & ACK) &&
+           segment.ack >= request_base + FRAME_SIZE * (acked + 1)) {
+      Add(&ack_latency, segment.time_us - request_time[acked]);
+      acked++;
+    }
+    while (answered < requests && client.rcv_nxt >= answer_base + FRAME_SIZE * (answered + 1)) {
+      Add(&wire_latency, segment.time_us - request_time[answered]);
+      answered++;
+    }
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Pass
+//
+static void Pass(const BENCH_CASE* bench)
+{
+  static const BYTE request[FRAME_SIZE] = {0x40};
+
+  TCPTick();
+  if (requests < BENCH_REQUESTS && sim_now_us >= next_request) {
+    // the request reached the MAC somewhere in the pass before
+    request_time[requests++] = sim_now_us - (rand() % PASS_TIME);
+    SimPeerSend(&client, PSH | ACK, request, sizeof(request));
+    next_request += REQUEST_INTERVAL;
+  }
+  Server(bench);
+  ClientReceive();
+  sim_now_us += PASS_TIME;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// RunCase
+//
+static void RunCase(const BENCH_CASE* bench)
+{
+  unsigned long sent_before;
+
+  SimInit();
+  memset(&server_latency, 0, sizeof(server_latency));
+  memset(&wire_latency, 0, sizeof(wire_latency));
+  memset(&ack_latency, 0, sizeof(ack_latency));
+  requests = 0;
+  answered = 0;
+  acked = 0;
+  deferred = 0;
+  next_request = (unsigned long long)-1;
+
+  server = TCPOpen(0, TCP_OPEN_SERVER, BENCH_PORT, TCP_PURPOSE_GENERIC_TCP_SERVER);
+  TCPSetOptions(server, bench->options);
+
+  SimPeerInit(&client, 20, 40000u, BENCH_PORT);
+  SimPeerSend(&client, SYN, NULL, 0);
+  ClientReceive();
+  SimPeerSend(&client, ACK, NULL, 0);
+  Pass(bench);
+  request_base = client.snd_nxt;
+  answer_base = client.rcv_nxt;
+
+  srand(1);
+  sent_before = sim_segments_sent;
+  next_request = sim_now_us + REQUEST_INTERVAL;
+
+  // up to five more intervals for the last answer, past the auto-transmit timeout
+  while (requests < BENCH_REQUESTS ||
+         (answered < BENCH_REQUESTS && sim_now_us < next_request + 4u * REQUEST_INTERVAL))
+    Pass(bench);
+
+  printf("%-26s %8.0f %8llu %8.0f %8llu %8.0f %8llu %6.2f",
+         bench->name,
+         Average(&server_latency), server_latency.max,
+         Average(&wire_latency), wire_latency.max,
+         Average(&ack_latency), ack_latency.max,
+         (double)(sim_segments_sent - sent_before) / BENCH_REQUESTS);
+  if (answered < BENCH_REQUESTS)
+    printf("  %lu not answered", BENCH_REQUESTS - answered);
+  printf("\n");
+}
+
+
+int main(void)
+{
+  unsigned int c;
+
+  printf("TCP-CAN latency, %u requests every %u uS, %u uS main loop pass, times in uS\n\n",
+         BENCH_REQUESTS, REQUEST_INTERVAL, PASS_TIME);
+  printf("%-26s %8s %8s %8s %8s %8s %8s %6s\n",
+         "options", "server", "max", "wire", "max", "ack", "max", "segs");
+  for (c = 0; c < sizeof(cases) / sizeof(cases[0]); c++)
+    RunCase(&cases[c]);
+  return 0;
+}
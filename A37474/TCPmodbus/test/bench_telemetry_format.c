@@ -0,0 +1,185 @@
+/*********************************************************************
+ *
+ *  Telemetry format benchmark
+ *
+ *********************************************************************
+ * FileName:        bench_telemetry_format.c
+ * Dependencies:    TelemetryFormat.c built with TELEMETRY_FORMAT_DECODER,
+ *                  telemetry_trace.c
+ *
+ * Host benchmark, see Makefile.  Reports the average record size and
+ * the bytes per second on the wire at the 10ms snapshot rate against
+ * sending the raw record, and the host encode and decode speed, for a
+ * quiet, a busy and a noise stream and for each trace file given on the
+ * command line (telemetry_trace.h).  Sizes are over one pass of a trace,
+ * the speed over the trace repeated to BENCH_RECORDS.  Every record of a
+ * trace must decode back to the record encoded.
+ *
+ ********************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "telemetry_trace.h"
+
+
+#define BENCH_RECORDS         200000u
+#define SNAPSHOTS_PER_SECOND  100u      /* 10ms tick */
+
+typedef struct {
+  const char*  name;
+  unsigned int changes;                 // fields changed per record, besides the timestamp
+  unsigned int step;                    // largest change
+} BENCH_STREAM;
+
+static unsigned char records[BENCH_RECORDS][TELEMETRY_MAX_RECORD];
+static unsigned int  lengths[BENCH_RECORDS];
+static unsigned int  snapshots[BENCH_RECORDS][TELEMETRY_FIELDS];
+
+static const BENCH_STREAM streams[] = {
+  {"quiet (2 fields +-8)",    2,    8},
+  {"busy (12 fields +-64)",  12,   64},
+  {"noise (all fields)",      TELEMETRY_FIELDS, 0x8000},
+};
+
+
+//////////////////////////////////////////////////////////////////////////
+// NextSnapshot
+//
+static void NextSnapshot(const BENCH_STREAM* stream, unsigned int* fields)
+{
+  unsigned int n;
+  unsigned int field;
+
+  for (n = 0; n < stream->changes; n++) {
+    field = rand() % TELEMETRY_FIELDS;
+    fields[field] = (fields[field] + (rand() % (2 * stream->step)) - stream->step) & 0xFFFF;
+  }
+  fields[TELEMETRY_FIELDS - 2] = (fields[TELEMETRY_FIELDS - 2] + 100000) & 0xFFFF;   // timestamp_low
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Seconds
+//
+static double Seconds(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+// Bench
+// snapshots holds BENCH_RECORDS records, the first unique of them one pass
+// of the stream.  Returns 0 if a record does not decode back.
+//
+static int Bench(const char* name, unsigned long unique)
+{
+  TELEMETRY_FORMAT     encoder;
+  TELEMETRY_FORMAT     decoder;
+  unsigned int         fields[TELEMETRY_FIELDS];
+  unsigned int         raw;
+  unsigned long        pass_total;
+  unsigned long        r;
+  double               start;
+  double               encode_time;
+  double               decode_time;
+
+  raw = TELEMETRY_FIELDS * 2;
+
+  TelemetryFormatReset(&encoder);
+  pass_total = 0;
+  start = Seconds();
+  for (r = 0; r < BENCH_RECORDS; r++) {
+    lengths[r] = TelemetryEncode(&encoder, snapshots[r], records[r]);
+    if (r < unique)
+      pass_total += lengths[r];
+  }
+  encode_time = Seconds() - start;
+
+  TelemetryFormatReset(&decoder);
+  start = Seconds();
+  for (r = 0; r < BENCH_RECORDS; r++) {
+    if (TelemetryDecode(&decoder, records[r], lengths[r], fields) != lengths[r]) {
+      printf("%s: record %lu not decoded\n", name, r);
+      return 0;
+    }
+  }
+  decode_time = Seconds() - start;
+
+  TelemetryFormatReset(&decoder);
+  for (r = 0; r < unique; r++) {
+    if (TelemetryDecode(&decoder, records[r], lengths[r], fields) != lengths[r] ||
+        memcmp(fields, snapshots[r], sizeof(fields)) != 0) {
+      printf("%s: record %lu decoded to a different record\n", name, r);
+      return 0;
+    }
+  }
+
+  printf("%-24s %10.1f %12.0f %7.1f%% %14.1f %14.1f\n",
+         name,
+         (double)pass_total / unique,
+         (double)pass_total / unique * SNAPSHOTS_PER_SECOND,
+         100.0 * pass_total / ((double)raw * unique),
+         (double)raw * BENCH_RECORDS / encode_time / 1e6,
+         (double)raw * BENCH_RECORDS / decode_time / 1e6);
+  return 1;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// BenchTrace
+//
+static int BenchTrace(const char* path)
+{
+  unsigned int (*trace)[TELEMETRY_FIELDS];
+  const char*  name;
+  unsigned long count;
+  unsigned long r;
+
+  count = TraceLoad(path, &trace);
+  if (count == 0)
+    return 0;
+  if (count > BENCH_RECORDS)
+    count = BENCH_RECORDS;
+  for (r = 0; r < BENCH_RECORDS; r++)
+    memcpy(snapshots[r], trace[r % count], sizeof(snapshots[r]));
+  free(trace);
+
+  name = strrchr(path, '/') ? strrchr(path, '/') + 1 : path;
+  return Bench(name, count);
+}
+
+
+int main(int argc, char** argv)
+{
+  unsigned int fields[TELEMETRY_FIELDS];
+  unsigned int s;
+  unsigned int r;
+  int          a;
+  int          result = 0;
+
+  printf("TelemetryFormat, %u fields, raw record %u bytes, %u records/s\n\n",
+         (unsigned int)TELEMETRY_FIELDS, (unsigned int)TELEMETRY_FIELDS * 2, SNAPSHOTS_PER_SECOND);
+  printf("%-24s %10s %12s %8s %14s %14s\n", "stream", "bytes/rec", "wire B/s", "ratio", "encode MB/s", "decode MB/s");
+
+  for (s = 0; s < sizeof(streams) / sizeof(streams[0]); s++) {
+    srand(s + 1);
+    memset(fields, 0, sizeof(fields));
+    for (r = 0; r < BENCH_RECORDS; r++) {
+      NextSnapshot(&streams[s], fields);
+      memcpy(snapshots[r], fields, sizeof(fields));
+    }
+    if (!Bench(streams[s].name, BENCH_RECORDS))
+      result = 1;
+  }
+
+  for (a = 1; a < argc; a++)
+    if (!BenchTrace(argv[a]))
+      result = 1;
+
+  printf("\nencode/decode speed is raw record bytes per second on this host\n");
+  return result;
+}
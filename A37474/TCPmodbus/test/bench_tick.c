@@ -0,0 +1,204 @@
+/*********************************************************************
+ *
+ *  Tick read benchmark
+ *
+ *********************************************************************
+ * FileName:        bench_tick.c
+ * Dependencies:    TCPIPStack/Tick.c
+ *
+ * Host benchmark, see Makefile.  Builds the real Tick.c against the
+ * Timer1 registers of host/p30F6014a.h and counts host cycles per read
+ * for TickGet(), TickGetDiv256() and TickGetDiv256Word(), next to the
+ * old GetTickCopy() that toggled T1IE around the read, copied below.
+ * First checks that TickGetDiv256Word() matches TickGetDiv256() around
+ * the TMR1 rollover.
+ *
+ * The counts are x86 cycles, not dsPIC instruction cycles.  They show
+ * the relative cost of the paths, the 48-bit copy against the 16-bit
+ * fast path, not the time on the board.
+ *
+ ********************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <x86intrin.h>
+
+#include "TCPIPStack/TCPIP.h"
+
+
+#define BENCH_READS     10000000u
+#define BENCH_RUNS      20u
+
+volatile unsigned short TMR1;
+volatile unsigned short PR1;
+volatile T1CONBITS T1CONbits;
+volatile IPC0BITS IPC0bits;
+volatile IFS0BITS IFS0bits;
+volatile IEC0BITS IEC0bits;
+
+void _T1Interrupt(void);
+
+static unsigned int failures;
+
+#define CHECK(condition, ...)                     \
+  do {                                            \
+    if (!(condition)) {                           \
+      failures++;                                 \
+      printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+      printf(__VA_ARGS__);                        \
+      printf("\n");                               \
+    }                                             \
+  } while (0)
+
+
+//////////////////////////////////////////////////////////////////////////
+// the T1IE toggle read GetTickCopy() used before the lock-free read,
+// on a counter of its own
+//
+static volatile DWORD dwOldTicks;
+static volatile BYTE vOldReading[6] __attribute__ ((aligned));
+
+static __attribute__((noinline)) void OldGetTickCopy(void)
+{
+	do
+	{
+		DWORD dwTempTicks;
+        WORD_VAL wTemp;
+
+		IEC0bits.T1IE = 1;			// Enable interrupt
+		Nop();
+		IEC0bits.T1IE = 0;			// Disable interrupt
+
+		// Get low 2 bytes
+        wTemp.Val = TMR1;
+        vOldReading[0] = wTemp.v[0];
+        vOldReading[1] = wTemp.v[1];
+
+		// Correct corner case where interrupt increments byte[4+] but
+		// TMR1 hasn't rolled over to 0x0000 yet
+		dwTempTicks = dwOldTicks;
+        if(wTemp.Val == 0xFFFFu)
+			dwTempTicks--;
+
+		// Get high 4 bytes
+		vOldReading[2] = ((BYTE*)&dwTempTicks)[0];
+		vOldReading[3] = ((BYTE*)&dwTempTicks)[1];
+		vOldReading[4] = ((BYTE*)&dwTempTicks)[2];
+		vOldReading[5] = ((BYTE*)&dwTempTicks)[3];
+	} while(IFS0bits.T1IF);
+	IEC0bits.T1IE = 1;				// Enable interrupt
+}
+
+static __attribute__((noinline)) DWORD OldTickGet(void)
+{
+  DWORD dw;
+
+  OldGetTickCopy();
+  ((BYTE*)&dw)[0] = vOldReading[0];
+  ((BYTE*)&dw)[1] = vOldReading[1];
+  ((BYTE*)&dw)[2] = vOldReading[2];
+  ((BYTE*)&dw)[3] = vOldReading[3];
+  return dw & 0xFFFFFFFFul;
+}
+
+static __attribute__((noinline)) DWORD OldTickGetDiv256(void)
+{
+  DWORD dw;
+
+  OldGetTickCopy();
+  ((BYTE*)&dw)[0] = vOldReading[1];
+  ((BYTE*)&dw)[1] = vOldReading[2];
+  ((BYTE*)&dw)[2] = vOldReading[3];
+  ((BYTE*)&dw)[3] = vOldReading[4];
+  return dw & 0xFFFFFFFFul;
+}
+
+static DWORD OldDiv256Word(void)    { return (WORD)OldTickGetDiv256(); }
+static DWORD NewTickGet(void)       { return TickGet(); }
+static DWORD NewTickGetDiv256(void) { return TickGetDiv256(); }
+static DWORD NewDiv256Word(void)    { return TickGetDiv256Word(); }
+
+typedef struct {
+  const char* name;
+  DWORD (*read)(void);
+} BENCH_READ;
+
+static const BENCH_READ reads[] = {
+  {"TickGet, T1IE toggle",                     OldTickGet},
+  {"TickGet, lock-free",                       NewTickGet},
+  {"TickGetDiv256, T1IE toggle",               OldTickGetDiv256},
+  {"TickGetDiv256, lock-free",                 NewTickGetDiv256},
+  {"(WORD)TickGetDiv256, T1IE toggle",         OldDiv256Word},
+  {"TickGetDiv256Word",                        NewDiv256Word},
+};
+
+
+//////////////////////////////////////////////////////////////////////////
+// CheckDiv256Word
+// the fast path against the full read around the TMR1 rollover, the
+// interrupt is taken after TMR1 wraps like on the board
+//
+static void CheckDiv256Word(void)
+{
+  unsigned long n;
+  unsigned int timer;
+
+  for (n = 0; n < 70000ul; n++) {
+    timer = (n * 7u) & 0xFFFFu;
+    if (timer < (((n - 1) * 7u) & 0xFFFFu))
+      _T1Interrupt();
+    TMR1 = timer;
+    CHECK(TickGetDiv256Word() == (WORD)TickGetDiv256(), "TMR1 0x%04X: 0x%04X, expected 0x%04X",
+          timer, TickGetDiv256Word(), (WORD)TickGetDiv256());
+  }
+
+  // interrupt not taken yet at 0xFFFF, the counter is one ahead
+  TMR1 = 0xFFFF;
+  _T1Interrupt();
+  CHECK(TickGetDiv256Word() == (WORD)TickGetDiv256(), "TMR1 0xFFFF after the interrupt: 0x%04X, expected 0x%04X",
+        TickGetDiv256Word(), (WORD)TickGetDiv256());
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Cycles
+// least host cycles per read over BENCH_RUNS runs
+//
+static double Cycles(const BENCH_READ* read)
+{
+  volatile DWORD sink;
+  unsigned long long start;
+  unsigned long long best = ~0ull;
+  unsigned int run;
+  unsigned int n;
+
+  for (run = 0; run < BENCH_RUNS; run++) {
+    start = __rdtsc();
+    for (n = 0; n < BENCH_READS; n++)
+      sink = read->read();
+    start = __rdtsc() - start;
+    if (start < best)
+      best = start;
+  }
+  (void)sink;
+  return (double)best / BENCH_READS;
+}
+
+
+int main(void)
+{
+  unsigned int r;
+
+  TickInit();
+  CheckDiv256Word();
+
+  printf("Tick reads, %u reads, least of %u runs, host TSC cycles per read\n\n", BENCH_READS, BENCH_RUNS);
+  TMR1 = 0x1234;
+  for (r = 0; r < sizeof(reads) / sizeof(reads[0]); r++)
+    printf("%-36s %8.1f\n", reads[r].name, Cycles(&reads[r]));
+
+  if (failures) {
+    printf("%u checks failed\n", failures);
+    return 1;
+  }
+  printf("\nall checks passed\n");
+  return 0;
+}
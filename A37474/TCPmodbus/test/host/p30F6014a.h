@@ -0,0 +1,32 @@
+/*
+ * Host stand-in for the dsPIC30F6014A header included by Compiler.h,
+ * see ../Makefile.  Only the Timer1 registers Tick.c uses are declared,
+ * as variables a host test that builds Tick.c defines.  The other stack
+ * sources built on the host do not touch any SFR.
+ */
+#ifndef HOST_P30F6014A_H
+#define HOST_P30F6014A_H
+
+#define _ISR
+#define Nop()   __asm__ volatile ("nop")
+
+typedef struct {
+  unsigned TCS:1;
+  unsigned TSYNC:1;
+  unsigned TCKPS:2;
+  unsigned TGATE:1;
+  unsigned TON:1;
+} T1CONBITS;
+
+typedef struct { unsigned T1IP:3; } IPC0BITS;
+typedef struct { unsigned T1IF:1; } IFS0BITS;
+typedef struct { unsigned T1IE:1; } IEC0BITS;
+
+extern volatile unsigned short TMR1;
+extern volatile unsigned short PR1;
+extern volatile T1CONBITS T1CONbits;
+extern volatile IPC0BITS IPC0bits;
+extern volatile IFS0BITS IFS0bits;
+extern volatile IEC0BITS IEC0bits;
+
+#endif
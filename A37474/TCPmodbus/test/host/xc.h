@@ -0,0 +1,4 @@
+/*
+ * Host stand-in for the XC16 device header, see ../Makefile.  The stack
+ * sources built on the host do not touch any SFR.
+ */
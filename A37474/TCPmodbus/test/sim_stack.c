@@ -0,0 +1,346 @@
+/*********************************************************************
+ *
+ *  Host simulation of the layers under TCP.c
+ *
+ *********************************************************************
+ * FileName:        sim_stack.c
+ * Dependencies:    TCPIPStack/TCP.c
+ *
+ * See sim_stack.h.  Segments from a peer are written into the
+ * simulated RX buffer and handed to TCPProcess() the way StackTask()
+ * does.  Segments TCP.c sends are read back out of the TX buffer at
+ * MACFlush().
+ *
+ ********************************************************************/
+#include <stdio.h>
+#include <string.h>
+
+#include "sim_stack.h"
+
+
+#define SIM_RX_SEGMENT  (RXSTART + 64u)      // where a received TCP header starts
+#define SIM_TX_SEGMENT  (BASE_TX_ADDR + sizeof(ETHER_HEADER) + sizeof(IP_HEADER))
+#define SIM_SERVER_IP   0x0A0A0A0Aul         // 10.10.10.10
+
+// Same layout as TCP_HEADER in TCP.c, which does not export it.  The host
+// build has 64 bit DWORDs, both ends of the simulation use this layout.
+typedef struct
+{
+  WORD  SourcePort;
+  WORD  DestPort;
+  DWORD SeqNumber;
+  DWORD AckNumber;
+  struct
+  {
+    unsigned char Reserved3 : 4;
+    unsigned char Val       : 4;
+  } DataOffset;
+  BYTE  Flags;
+  WORD  Window;
+  WORD  Checksum;
+  WORD  UrgentPointer;
+} SIM_TCP_HEADER;
+
+unsigned long long sim_now_us;
+unsigned long sim_segments_sent;
+
+APP_CONFIG AppConfig;
+
+static BYTE sim_ram[RAMSIZE];                // ENC28J60 buffer memory
+static PTR_BASE read_ptr;
+static PTR_BASE write_ptr;
+static NODE_INFO tx_remote;
+static WORD tx_len;
+
+static SIM_SEGMENT segments[SIM_SEGMENTS];
+static unsigned int segment_put;
+static unsigned int segment_get;
+static WORD random_seed = 1;
+
+
+//////////////////////////////////////////////////////////////////////////
+// tick, 25.6uS per count like Timer1 at 1:256
+//
+DWORD TickGet(void)
+{
+  return (DWORD)(sim_now_us * TICK_SECOND / 1000000ull);
+}
+
+DWORD TickGetDiv256(void)
+{
+  return TickGet() >> 8;
+}
+
+WORD TickGetDiv256Word(void)
+{
+  return (WORD)(TickGet() >> 8);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// helpers
+//
+WORD swaps(WORD v)
+{
+  return (WORD)((v << 8) | (v >> 8));
+}
+
+DWORD swapl(DWORD v)
+{
+  return ((v & 0xFFul) << 24) | ((v & 0xFF00ul) << 8) | ((v >> 8) & 0xFF00ul) | ((v >> 24) & 0xFFul);
+}
+
+WORD CalcIPChecksum(BYTE* buffer, WORD len)
+{
+  (void)buffer;
+  (void)len;
+  return 0xFFFF;          // TCPProcess() compares its complement with CalcIPBufferChecksum()
+}
+
+WORD CalcIPBufferChecksum(WORD len)
+{
+  (void)len;
+  return 0x0000;
+}
+
+// SendTCP() writes the checksum at byte 16, where it sits in a 32 bit
+// header.  In the host layout that is inside AckNumber, so hand back the
+// bytes already there and the write changes nothing.
+WORD MACCalcTxChecksum(WORD len)
+{
+  WORD bytes;
+
+  (void)len;
+  memcpy(&bytes, &sim_ram[SIM_TX_SEGMENT + 16u], sizeof(bytes));
+  return bytes;
+}
+
+WORD LFSRRand(void)
+{
+  random_seed = random_seed * 25173u + 13849u;
+  return random_seed;
+}
+
+DWORD GenerateRandomDWORD(void)
+{
+  return 1000;            // small sequence numbers never wrap the 64 bit host DWORD
+}
+
+//////////////////////////////////////////////////////////////////////////
+// ARP, every peer is on the local segment and resolved
+//
+void ARPResolve(IP_ADDR* IPAddr)
+{
+  (void)IPAddr;
+}
+
+BOOL ARPIsResolved(IP_ADDR* IPAddr, MAC_ADDR* MACAddr)
+{
+  (void)IPAddr;
+  memset(MACAddr, 0x02, sizeof(*MACAddr));
+  return TRUE;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// MAC buffer memory
+//
+PTR_BASE MACSetWritePtr(PTR_BASE address)
+{
+  PTR_BASE old = write_ptr;
+
+  write_ptr = address;
+  return old;
+}
+
+PTR_BASE MACSetReadPtr(PTR_BASE address)
+{
+  PTR_BASE old = read_ptr;
+
+  read_ptr = address;
+  return old;
+}
+
+BYTE MACGet(void)
+{
+  return sim_ram[read_ptr++];
+}
+
+WORD MACGetArray(BYTE* val, WORD len)
+{
+  if (val)
+    memcpy(val, &sim_ram[read_ptr], len);
+  read_ptr += len;
+  return len;
+}
+
+void MACPutArray(BYTE* val, WORD len)
+{
+  memcpy(&sim_ram[write_ptr], val, len);
+  write_ptr += len;
+}
+
+void MACMemCopyAsync(PTR_BASE destAddr, PTR_BASE sourceAddr, WORD len)
+{
+  PTR_BASE dest = destAddr == (PTR_BASE)-1 ? write_ptr : destAddr;
+  PTR_BASE source = sourceAddr == (PTR_BASE)-1 ? read_ptr : sourceAddr;
+
+  memmove(&sim_ram[dest], &sim_ram[source], len);
+  if (destAddr == (PTR_BASE)-1)
+    write_ptr += len;
+  if (sourceAddr == (PTR_BASE)-1)
+    read_ptr += len;
+}
+
+BOOL MACIsMemCopyDone(void)
+{
+  return TRUE;
+}
+
+BOOL MACIsTxReady(void)
+{
+  return TRUE;
+}
+
+WORD MACGetFreeRxSize(void)
+{
+  return RXSIZE;
+}
+
+void MACDiscardRx(void)
+{
+}
+
+//////////////////////////////////////////////////////////////////////////
+// IP
+//
+WORD IPPutHeader(NODE_INFO* remote, BYTE protocol, WORD len)
+{
+  (void)protocol;
+  tx_remote = *remote;
+  tx_len = len;
+  write_ptr = SIM_TX_SEGMENT;
+  return 0;
+}
+
+void IPSetRxBuffer(WORD Offset)
+{
+  read_ptr = SIM_RX_SEGMENT + Offset;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// MACFlush
+// the segment in the TX buffer leaves now, keep it for the test
+//
+void MACFlush(void)
+{
+  SIM_TCP_HEADER header;
+  SIM_SEGMENT* segment;
+  WORD header_len;
+
+  memcpy(&header, &sim_ram[SIM_TX_SEGMENT], sizeof(header));
+  header_len = header.DataOffset.Val << 2;
+  sim_segments_sent++;
+
+  if (((segment_put + 1) % SIM_SEGMENTS) == segment_get) {
+    printf("sim: more than %u segments not taken\n", SIM_SEGMENTS);
+    return;
+  }
+  segment = &segments[segment_put];
+  segment->time_us = sim_now_us;
+  segment->remote_ip = tx_remote.IPAddr.Val;
+  segment->local_port = swaps(header.SourcePort);
+  segment->remote_port = swaps(header.DestPort);
+  segment->seq = swapl(header.SeqNumber);
+  segment->ack = swapl(header.AckNumber);
+  segment->flags = header.Flags;
+  segment->window = swaps(header.Window);
+  segment->len = tx_len - header_len;
+  if (segment->len > SIM_SEGMENT_DATA)
+    segment->len = SIM_SEGMENT_DATA;
+  memcpy(segment->data, &sim_ram[SIM_TX_SEGMENT + header_len], segment->len);
+  segment_put = (segment_put + 1) % SIM_SEGMENTS;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// SimTakeSegment
+// oldest segment TCP.c sent, 0 when there is none
+//
+int SimTakeSegment(SIM_SEGMENT* segment)
+{
+  if (segment_get == segment_put)
+    return 0;
+  *segment = segments[segment_get];
+  segment_get = (segment_get + 1) % SIM_SEGMENTS;
+  return 1;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// SimInit
+//
+void SimInit(void)
+{
+  memset(sim_ram, 0, sizeof(sim_ram));
+  memset(&AppConfig, 0, sizeof(AppConfig));
+  AppConfig.MyIPAddr.Val = SIM_SERVER_IP;
+  AppConfig.MyMask.Val = 0x00FFFFFFul;
+  segment_put = 0;
+  segment_get = 0;
+  sim_segments_sent = 0;
+  sim_now_us = 0;
+  TCPInit();
+}
+
+//////////////////////////////////////////////////////////////////////////
+// SimPeerInit
+//
+void SimPeerInit(SIM_PEER* peer, BYTE ip, WORD port, WORD server_port)
+{
+  memset(peer, 0, sizeof(*peer));
+  peer->node.IPAddr.Val = (SIM_SERVER_IP & 0x00FFFFFFul) | ((DWORD)ip << 24);
+  memset(&peer->node.MACAddr, 0x02, sizeof(peer->node.MACAddr));
+  peer->node.MACAddr.v[5] = ip;
+  peer->port = port;
+  peer->server_port = server_port;
+  peer->snd_nxt = 5000ul * ip;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// SimPeerSend
+// one segment from the peer, processed at once like StackTask() would
+//
+void SimPeerSend(SIM_PEER* peer, BYTE flags, const BYTE* data, WORD len)
+{
+  SIM_TCP_HEADER header;
+  IP_ADDR local;
+
+  memset(&header, 0, sizeof(header));
+  header.SourcePort = swaps(peer->port);
+  header.DestPort = swaps(peer->server_port);
+  header.SeqNumber = swapl(peer->snd_nxt);
+  header.AckNumber = swapl(peer->rcv_nxt);
+  header.DataOffset.Val = sizeof(header) >> 2;
+  header.Flags = flags;
+  header.Window = swaps(4096);
+
+  memcpy(&sim_ram[SIM_RX_SEGMENT], &header, sizeof(header));
+  if (len)
+    memcpy(&sim_ram[SIM_RX_SEGMENT + sizeof(header)], data, len);
+
+  peer->snd_nxt += len;
+  if (flags & (SYN | FIN))
+    peer->snd_nxt++;
+
+  local.Val = AppConfig.MyIPAddr.Val;
+  TCPProcess(&peer->node, &local, sizeof(header) + len);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// SimPeerReceived
+// the peer takes in a segment TCP.c sent to it
+//
+void SimPeerReceived(SIM_PEER* peer, const SIM_SEGMENT* segment)
+{
+  if (segment->flags & SYN)
+    peer->rcv_nxt = segment->seq + 1;
+  else if (segment->seq == peer->rcv_nxt)
+    peer->rcv_nxt += segment->len + ((segment->flags & FIN) ? 1 : 0);
+}
@@ -0,0 +1,64 @@
+/*********************************************************************
+ *
+ *  Host simulation of the layers under TCP.c
+ *
+ *********************************************************************
+ * FileName:        sim_stack.h
+ * Dependencies:    TCPIPStack/TCP.c
+ *
+ * The ENC28J60 buffer memory, the IP layer and the tick on the host,
+ * so the real TCP.c can be driven segment by segment, see Makefile.
+ * Checksums are not simulated.  Time only moves when the test moves
+ * sim_now_us.
+ *
+ ********************************************************************/
+#ifndef SIM_STACK_H
+#define SIM_STACK_H
+
+#include "TCPIPStack/TCPIP.h"
+
+
+#define SIM_SEGMENT_DATA    600u     // more than the 536 byte default MSS
+#define SIM_SEGMENTS        64u      // sent segments held until the test takes them
+
+// TCP flags, private to TCP.c
+#define FIN     (0x01)
+#define SYN     (0x02)
+#define RST     (0x04)
+#define PSH     (0x08)
+#define ACK     (0x10)
+
+// one segment TCP.c sent, host byte order
+typedef struct {
+  unsigned long long time_us;        // sim_now_us at MACFlush()
+  DWORD remote_ip;
+  WORD  local_port;
+  WORD  remote_port;
+  DWORD seq;
+  DWORD ack;
+  BYTE  flags;
+  WORD  window;
+  WORD  len;
+  BYTE  data[SIM_SEGMENT_DATA];
+} SIM_SEGMENT;
+
+// the far end of a connection
+typedef struct {
+  NODE_INFO node;
+  WORD  port;
+  WORD  server_port;
+  DWORD snd_nxt;
+  DWORD rcv_nxt;
+} SIM_PEER;
+
+extern unsigned long long sim_now_us;
+extern unsigned long sim_segments_sent;
+
+void SimInit(void);
+int  SimTakeSegment(SIM_SEGMENT* segment);
+
+void SimPeerInit(SIM_PEER* peer, BYTE ip, WORD port, WORD server_port);
+void SimPeerSend(SIM_PEER* peer, BYTE flags, const BYTE* data, WORD len);
+void SimPeerReceived(SIM_PEER* peer, const SIM_SEGMENT* segment);
+
+#endif
@@ -0,0 +1,364 @@
+/*********************************************************************
+ *
+ *  Telemetry capture tool
+ *
+ *********************************************************************
+ * FileName:        telemetry_capture.c
+ * Dependencies:    TelemetryFormat.c built with TELEMETRY_FORMAT_DECODER,
+ *                  telemetry_trace.c
+ *
+ * Host tool, see Makefile.
+ *
+ *   telemetry_capture capture [-p port] [-g group] [-n records] out.trace
+ *       takes the datagrams TelemetryPublisher() sends to UDP_TELEMETRY_PORT,
+ *       decodes them and writes one line per record to out.trace, until
+ *       records were written or ^C.  Sequence gaps and records the decoder
+ *       dropped waiting for a keyframe are written as comments.  -g joins
+ *       the UDP_TELEMETRY_GROUP multicast group.
+ *
+ *   telemetry_capture replay [-p port] host in.trace
+ *       sends in.trace to host every 10ms the way TelemetryPublisher()
+ *       does, a keyframe first.  Replayed into capture it checks the whole
+ *       path without a board.
+ *
+ *   telemetry_capture synthesize [-n records] out.trace
+ *       writes a made up standby stream, see Synthesize().  For the
+ *       benchmark until there is a trace captured on a board, the file
+ *       says it is synthetic.
+ *
+ ********************************************************************/
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "telemetry_trace.h"
+
+
+#define UDP_TELEMETRY_PORT  9762u       // TCPmodbus.c
+#define SNAPSHOT_PERIOD_NS  10000000l   // 10ms
+#define TICK_COUNTS         100008ul    // A37474_TICK_PERIOD, TimestampGet() counts per 10ms
+
+static volatile sig_atomic_t stop;
+
+
+//////////////////////////////////////////////////////////////////////////
+// Usage
+//
+static int Usage(void)
+{
+  fprintf(stderr,
+          "usage: telemetry_capture capture [-p port] [-g group] [-n records] out.trace\n"
+          "       telemetry_capture replay [-p port] host in.trace\n"
+          "       telemetry_capture synthesize [-n records] out.trace\n");
+  return 2;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Stop
+//
+static void Stop(int signal)
+{
+  (void)signal;
+  stop = 1;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Capture
+//
+static int Capture(unsigned int port, const char* group, unsigned long records, const char* path)
+{
+  unsigned char datagram[1 + TELEMETRY_MAX_RECORD + 16];
+  unsigned int fields[TELEMETRY_FIELDS];
+  TELEMETRY_FORMAT decoder;
+  struct sockaddr_in local;
+  struct sockaddr_in remote;
+  struct sigaction action;
+  struct ip_mreq membership;
+  socklen_t remote_size;
+  unsigned char sequence = 0;
+  int have_sequence = 0;
+  unsigned long written = 0;
+  unsigned long waiting = 0;
+  unsigned long gaps = 0;
+  unsigned long ignored = 0;
+  char source[128];
+  ssize_t length;
+  FILE* file;
+  int on = 1;
+  int s;
+
+  s = socket(AF_INET, SOCK_DGRAM, 0);
+  if (s < 0) {
+    perror("socket");
+    return 1;
+  }
+  setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  memset(&local, 0, sizeof(local));
+  local.sin_family = AF_INET;
+  local.sin_port = htons(port);
+  local.sin_addr.s_addr = htonl(INADDR_ANY);
+  if (bind(s, (struct sockaddr*)&local, sizeof(local)) < 0) {
+    perror("bind");
+    return 1;
+  }
+  if (group) {
+    memset(&membership, 0, sizeof(membership));
+    if (inet_pton(AF_INET, group, &membership.imr_multiaddr) != 1) {
+      fprintf(stderr, "%s: not an IPv4 address\n", group);
+      return 1;
+    }
+    membership.imr_interface.s_addr = htonl(INADDR_ANY);
+    if (setsockopt(s, IPPROTO_IP, IP_ADD_MEMBERSHIP, &membership, sizeof(membership)) < 0) {
+      perror("IP_ADD_MEMBERSHIP");
+      return 1;
+    }
+  }
+
+  file = fopen(path, "w");
+  if (!file) {
+    perror(path);
+    return 1;
+  }
+
+  // no SA_RESTART, ^C ends the recvfrom()
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = Stop;
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+
+  TelemetryFormatReset(&decoder);
+  while (!stop && (records == 0 || written < records)) {
+    remote_size = sizeof(remote);
+    length = recvfrom(s, datagram, sizeof(datagram), 0, (struct sockaddr*)&remote, &remote_size);
+    if (length < 0) {
+      if (errno == EINTR)
+        continue;
+      perror("recvfrom");
+      break;
+    }
+    if (length < 3 || datagram[0] != MODBUS_WR_TELEMETRY) {
+      ignored++;
+      continue;
+    }
+
+    if (written == 0 && waiting == 0) {
+      snprintf(source, sizeof(source), "captured from %s:%u to UDP port %u",
+               inet_ntoa(remote.sin_addr), ntohs(remote.sin_port), port);
+      TraceWriteHeader(file, source);
+    }
+
+    if (have_sequence && datagram[2] != sequence) {
+      fprintf(file, "# sequence gap, expected %u, got %u\n", sequence, datagram[2]);
+      gaps++;
+    }
+    sequence = datagram[2] + 1;
+    have_sequence = 1;
+
+    if (TelemetryDecode(&decoder, &datagram[1], length - 1, fields) != (unsigned int)(length - 1)) {
+      waiting++;
+      continue;
+    }
+    if (waiting) {
+      fprintf(file, "# %lu records not decoded, waiting for a keyframe\n", waiting);
+      waiting = 0;
+    }
+    TraceWriteRecord(file, fields);
+    written++;
+  }
+
+  if (waiting)
+    fprintf(file, "# %lu records not decoded, waiting for a keyframe\n", waiting);
+  fclose(file);
+  close(s);
+  printf("%s: %lu records, %lu sequence gaps, %lu other datagrams ignored\n", path, written, gaps, ignored);
+  return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Replay
+//
+static int Replay(unsigned int port, const char* host, const char* path)
+{
+  unsigned char datagram[1 + TELEMETRY_MAX_RECORD];
+  unsigned int (*snapshots)[TELEMETRY_FIELDS];
+  TELEMETRY_FORMAT encoder;
+  struct sockaddr_in remote;
+  struct timespec next;
+  unsigned long count;
+  unsigned long r;
+  unsigned int length;
+  int s;
+
+  memset(&remote, 0, sizeof(remote));
+  remote.sin_family = AF_INET;
+  remote.sin_port = htons(port);
+  if (inet_pton(AF_INET, host, &remote.sin_addr) != 1) {
+    fprintf(stderr, "%s: not an IPv4 address\n", host);
+    return 1;
+  }
+
+  count = TraceLoad(path, &snapshots);
+  if (count == 0)
+    return 1;
+
+  s = socket(AF_INET, SOCK_DGRAM, 0);
+  if (s < 0) {
+    perror("socket");
+    return 1;
+  }
+
+  TelemetryFormatReset(&encoder);
+  clock_gettime(CLOCK_MONOTONIC, &next);
+  for (r = 0; r < count; r++) {
+    datagram[0] = MODBUS_WR_TELEMETRY;
+    length = 1 + TelemetryEncode(&encoder, snapshots[r], &datagram[1]);
+    if (sendto(s, datagram, length, 0, (struct sockaddr*)&remote, sizeof(remote)) < 0) {
+      perror("sendto");
+      break;
+    }
+
+    next.tv_nsec += SNAPSHOT_PERIOD_NS;
+    if (next.tv_nsec >= 1000000000l) {
+      next.tv_nsec -= 1000000000l;
+      next.tv_sec++;
+    }
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+  }
+
+  close(s);
+  free(snapshots);
+  printf("%s: %lu records sent to %s:%u\n", path, r, host, port);
+  return r == count ? 0 : 1;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Noise
+// around +-counts, not below 0 like a reading.  The same stream on every
+// host, rand() differs between C libraries.
+//
+static unsigned long noise_seed = 1;
+
+static unsigned int Noise(unsigned int around, unsigned int counts)
+{
+  long value;
+
+  noise_seed = (noise_seed * 1103515245ul + 12345ul) & 0xFFFFFFFFul;
+  value = (long)around + (long)((noise_seed >> 16) % (2 * counts + 1)) - (long)counts;
+  return value < 0 ? 0 : (unsigned int)value;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Synthesize
+// A unit in STATE_HEATER_WARM_UP_DONE with no faults: constant state,
+// set points and FPGA word, readings and MAX1230 words with a few counts
+// of noise on every record, the timestamp one tick apart.  The levels are
+// round numbers, not readings of a board.
+//
+static int Synthesize(unsigned long records, const char* path)
+{
+  static const unsigned int adc_levels[TELEMETRY_ADC_WORDS] = {
+    2010, 1480, 35, 40, 2730, 1210, 3100, 20, 1650,
+    2048, 2048, 900, 60, 25, 1990, 3300, 2500,
+  };
+  unsigned int fields[TELEMETRY_FIELDS];
+  ETMTelemetryRecord* record = (ETMTelemetryRecord*)fields;
+  unsigned long timestamp = 0x00120000ul;
+  unsigned long r;
+  unsigned int n;
+  FILE* file;
+
+  file = fopen(path, "w");
+  if (!file) {
+    perror(path);
+    return 1;
+  }
+  TraceWriteHeader(file, "SYNTHETIC, not captured on a board: telemetry_capture synthesize");
+  fprintf(file, "# standby model, STATE_HEATER_WARM_UP_DONE, no faults or warnings, readings\n"
+                "# and MAX1230 words with a few counts of noise, timestamp +%lu a record.\n"
+                "# Replace with a capture from a board when one is available.\n", TICK_COUNTS);
+
+  memset(fields, 0, sizeof(fields));
+  for (r = 0; r < records; r++) {
+    record->log_data[0] = Noise(0, 1);                  // gun_i_peak, no pulses
+    record->log_data[1] = Noise(0, 2);                  // hv_v_mon, HV off
+    record->log_data[2] = Noise(0, 2);                  // top_v_mon
+    record->log_data[3] = record->log_data[2];
+    record->log_data[4] = Noise(3150, 1);               // temperature_mon
+    record->log_data[5] = 0;                            // heater_warm_up_time_remaining
+    record->log_data[6] = Noise(1420, 3);               // htr_i_mon
+    record->log_data[7] = Noise(6290, 3);               // htr_v_mon
+    record->log_data[8] = 0;                            // high_voltage set point
+    record->log_data[9] = 6300;                         // heater_voltage_target
+    record->log_data[10] = 0;                           // top_voltage set point
+    record->log_data[11] = 0;
+    record->log_data[12] = Noise(15000, 4);             // bias_v_mon
+    record->log_data[13] = 100;                         // STATE_HEATER_WARM_UP_DONE
+    record->log_data[14] = 0;                           // adc_read_error_count
+    record->log_data[15] = 0;
+    record->state_message = 0x000B;                     // STATE_MESSAGE_HEATER_WARM_UP_DONE
+    record->control_state = 100;
+    record->fault_register = 0;
+    record->warning_register = 0;
+    record->fpga_raw_high = 0x0012;
+    record->fpga_raw_low = 0x3C00;
+    for (n = 0; n < TELEMETRY_ADC_WORDS; n++)
+      record->adc_raw[n] = Noise(adc_levels[n], 3);
+    record->timestamp_high = (timestamp >> 16) & 0xFFFF;
+    record->timestamp_low = timestamp & 0xFFFF;
+    record->skipped = 0;
+    timestamp += TICK_COUNTS;
+    TraceWriteRecord(file, fields);
+  }
+  fclose(file);
+  printf("%s: %lu synthetic records\n", path, records);
+  return 0;
+}
+
+
+int main(int argc, char** argv)
+{
+  const char* command;
+  const char* group = NULL;
+  unsigned int port = UDP_TELEMETRY_PORT;
+  unsigned long records = 0;
+  int option;
+
+  if (argc < 2)
+    return Usage();
+  command = argv[1];
+  argv++;
+  argc--;
+
+  while ((option = getopt(argc, argv, "p:g:n:")) != -1) {
+    switch (option) {
+    case 'p':
+      port = strtoul(optarg, NULL, 0);
+      break;
+    case 'g':
+      group = optarg;
+      break;
+    case 'n':
+      records = strtoul(optarg, NULL, 0);
+      break;
+    default:
+      return Usage();
+    }
+  }
+  argc -= optind;
+  argv += optind;
+
+  if (strcmp(command, "capture") == 0 && argc == 1)
+    return Capture(port, group, records, argv[0]);
+  if (strcmp(command, "replay") == 0 && argc == 2)
+    return Replay(port, argv[0], argv[1]);
+  if (strcmp(command, "synthesize") == 0 && argc == 1 && records)
+    return Synthesize(records, argv[0]);
+  return Usage();
+}
@@ -0,0 +1,138 @@
+/*********************************************************************
+ *
+ *  Telemetry trace files
+ *
+ *********************************************************************
+ * FileName:        telemetry_trace.c
+ * Dependencies:    TelemetryFormat.h
+ *
+ * See telemetry_trace.h.
+ *
+ ********************************************************************/
+#include <stdlib.h>
+#include <string.h>
+
+#include "telemetry_trace.h"
+
+
+#define TRACE_LINE_SIZE     (TELEMETRY_FIELDS * 5 + 64)
+
+static const char* const field_names[TELEMETRY_FIELDS] = {
+  "log_data[0]", "log_data[1]", "log_data[2]", "log_data[3]",
+  "log_data[4]", "log_data[5]", "log_data[6]", "log_data[7]",
+  "log_data[8]", "log_data[9]", "log_data[10]", "log_data[11]",
+  "log_data[12]", "log_data[13]", "log_data[14]", "log_data[15]",
+  "state_message", "control_state", "fault_register", "warning_register",
+  "fpga_raw_high", "fpga_raw_low",
+  "adc_raw[0]", "adc_raw[1]", "adc_raw[2]", "adc_raw[3]",
+  "adc_raw[4]", "adc_raw[5]", "adc_raw[6]", "adc_raw[7]",
+  "adc_raw[8]", "adc_raw[9]", "adc_raw[10]", "adc_raw[11]",
+  "adc_raw[12]", "adc_raw[13]", "adc_raw[14]", "adc_raw[15]",
+  "adc_raw[16]",
+  "timestamp_high", "timestamp_low", "skipped",
+};
+
+
+//////////////////////////////////////////////////////////////////////////
+// TraceWriteHeader
+//
+void TraceWriteHeader(FILE* file, const char* source)
+{
+  unsigned int n;
+
+  fprintf(file, "# %s\n", source);
+  fprintf(file, "# one telemetry_record per line, %u words in hex:\n#", (unsigned int)TELEMETRY_FIELDS);
+  for (n = 0; n < TELEMETRY_FIELDS; n++)
+    fprintf(file, "%s %s", (n && n % 8 == 0) ? "\n#" : "", field_names[n]);
+  fprintf(file, "\n");
+}
+
+//////////////////////////////////////////////////////////////////////////
+// TraceWriteRecord
+//
+void TraceWriteRecord(FILE* file, const unsigned int* fields)
+{
+  unsigned int n;
+
+  for (n = 0; n < TELEMETRY_FIELDS; n++)
+    fprintf(file, n ? " %04X" : "%04X", fields[n] & 0xFFFF);
+  fprintf(file, "\n");
+}
+
+//////////////////////////////////////////////////////////////////////////
+// TraceReadRecord
+//
+int TraceReadRecord(FILE* file, unsigned int* fields, unsigned long* line)
+{
+  char text[TRACE_LINE_SIZE];
+  char* next;
+  char* end;
+  unsigned long value;
+  unsigned int n;
+
+  while (fgets(text, sizeof(text), file)) {
+    (*line)++;
+    next = text + strspn(text, " \t\r\n");
+    if (*next == '#' || *next == '\0')
+      continue;
+
+    for (n = 0; n < TELEMETRY_FIELDS; n++) {
+      value = strtoul(next, &end, 16);
+      if (end == next || value > 0xFFFF)
+        return -1;
+      fields[n] = value;
+      next = end;
+    }
+    next += strspn(next, " \t\r\n");
+    return *next == '\0' ? 1 : -1;
+  }
+  return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// TraceLoad
+//
+unsigned long TraceLoad(const char* path, unsigned int (**snapshots)[TELEMETRY_FIELDS])
+{
+  unsigned int (*records)[TELEMETRY_FIELDS] = NULL;
+  unsigned int (*grown)[TELEMETRY_FIELDS];
+  unsigned int fields[TELEMETRY_FIELDS];
+  unsigned long count = 0;
+  unsigned long size = 0;
+  unsigned long line = 0;
+  FILE* file;
+  int result;
+
+  file = fopen(path, "r");
+  if (!file) {
+    perror(path);
+    return 0;
+  }
+
+  while ((result = TraceReadRecord(file, fields, &line)) > 0) {
+    if (count == size) {
+      size = size ? size * 2 : 1024;
+      grown = realloc(records, size * sizeof(*records));
+      if (!grown) {
+        printf("%s: out of memory\n", path);
+        fclose(file);
+        free(records);
+        return 0;
+      }
+      records = grown;
+    }
+    memcpy(records[count++], fields, sizeof(fields));
+  }
+  fclose(file);
+
+  if (result < 0 || count == 0) {
+    if (result < 0)
+      printf("%s:%lu: not %u hex words\n", path, line, (unsigned int)TELEMETRY_FIELDS);
+    else
+      printf("%s: no records\n", path);
+    free(records);
+    return 0;
+  }
+  *snapshots = records;
+  return count;
+}
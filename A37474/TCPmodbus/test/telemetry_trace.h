@@ -0,0 +1,41 @@
+/*
+ * Telemetry trace files, see telemetry_trace.c.  Written by
+ * telemetry_capture and read by bench_telemetry_format.
+ *
+ * A trace is text.  Lines starting with # are comments, every other line
+ * is one telemetry_record: TELEMETRY_FIELDS words in hex, in the order of
+ * ETMTelemetryRecord in TCPmodbus.h, separated by spaces.
+ */
+#ifndef TELEMETRY_TRACE_H
+#define TELEMETRY_TRACE_H
+
+#include <stdio.h>
+
+#include "TelemetryFormat.h"
+
+
+void TraceWriteHeader(FILE* file, const char* source);
+/*
+  Writes source as a comment, then the field names as a comment
+*/
+
+void TraceWriteRecord(FILE* file, const unsigned int* fields);
+/*
+  Writes TELEMETRY_FIELDS words as one line
+*/
+
+int TraceReadRecord(FILE* file, unsigned int* fields, unsigned long* line);
+/*
+  Reads the next record into TELEMETRY_FIELDS words, skipping comments
+  and blank lines.  line counts the lines read, for messages.
+  Returns 1 for a record, 0 at the end of the file, -1 on a malformed line
+*/
+
+unsigned long TraceLoad(const char* path, unsigned int (**snapshots)[TELEMETRY_FIELDS]);
+/*
+  Reads a whole trace into a malloc()ed array
+  Returns the number of records, 0 if the file can not be read, is empty
+  or has a malformed line, after printing why
+*/
+
+#endif
@@ -0,0 +1,213 @@
+/*********************************************************************
+ *
+ *  StackTask() RX flood test
+ *
+ *********************************************************************
+ * FileName:        test_stack_flood.c
+ * Dependencies:    TCPIPStack/StackTsk.c
+ *
+ * Host test, see Makefile.  Builds the real StackTask() against a
+ * simulated MAC that never runs out of TCP frames and a simulated
+ * clock, and runs the polled main loop on it: the 10ms tick, one
+ * StackTask() and the rest of the services per pass.  Checks that the
+ * RX budget keeps every tick within the overrun limit, and that
+ * dwBudgetHits only counts stops that left packets behind.
+ *
+ ********************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "TCPIPStack/TCPIP.h"
+
+
+// simulated costs in uS, about what they take on the 10 MIPS dsPIC
+#define COST_MAC_GET_HEADER     40u
+#define COST_IP_GET_HEADER      40u
+#define COST_TCP_PROCESS        400u     // one segment with checksum
+#define COST_TCP_TICK           200u
+#define COST_CONTROL_TASK       3000u    // DoControlTask() and DoControlTaskBackground()
+#define COST_SERVICES           1000u    // CAN, serial and the TCP servers
+
+#define TEST_TICK_PERIOD        10000u   // uS
+#define TEST_JITTER_LIMIT       (TEST_TICK_PERIOD / 2)   // later than this counts as a tick overrun
+#define TEST_SECONDS            10u
+
+static unsigned int failures;
+
+#define CHECK(condition, ...)                     \
+  do {                                            \
+    if (!(condition)) {                           \
+      failures++;                                 \
+      printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+      printf(__VA_ARGS__);                        \
+      printf("\n");                               \
+    }                                             \
+  } while (0)
+
+
+//////////////////////////////////////////////////////////////////////////
+// simulated clock and MAC
+//
+static unsigned long long now_us;
+static unsigned long rx_pending;         // frames waiting in the MAC
+static int rx_flood;                     // never runs out
+static unsigned long rx_taken;
+
+APP_CONFIG AppConfig;
+
+DWORD TickGet(void)
+{
+  return (DWORD)(now_us * TICK_SECOND / 1000000ull);
+}
+
+BOOL MACGetHeader(MAC_ADDR *remote, BYTE* type)
+{
+  (void)remote;
+  now_us += COST_MAC_GET_HEADER;
+  if (!rx_flood) {
+    if (rx_pending == 0)
+      return FALSE;
+    rx_pending--;
+  }
+  rx_taken++;
+  *type = MAC_IP;
+  return TRUE;
+}
+
+BOOL MACIsRxPending(void)
+{
+  return rx_flood || rx_pending;
+}
+
+BOOL IPGetHeader(IP_ADDR *localIP, NODE_INFO *remote, BYTE *protocol, WORD *len)
+{
+  (void)remote;
+  now_us += COST_IP_GET_HEADER;
+  localIP->Val = AppConfig.MyIPAddr.Val;
+  *protocol = IP_PROT_TCP;
+  *len = 20;
+  return TRUE;
+}
+
+BOOL TCPProcess(NODE_INFO* remote, IP_ADDR* localIP, WORD len)
+{
+  (void)remote;
+  (void)localIP;
+  (void)len;
+  now_us += COST_TCP_PROCESS;
+  return TRUE;
+}
+
+void TCPTick(void)
+{
+  now_us += COST_TCP_TICK;
+}
+
+void MACInit(void) {}
+void ARPInit(void) {}
+void ARPTask(void) {}
+BOOL ARPProcess(void) { return TRUE; }
+void ARPRefresh(NODE_INFO* remote) { (void)remote; }
+void ICMPTask(void) {}
+void ICMPProcess(NODE_INFO *remote, WORD len) { (void)remote; (void)len; }
+void TCPInit(void) {}
+void UDPInit(void) {}
+void UDPTask(void) {}
+void UDPDiscard(void) {}
+BOOL UDPProcess(NODE_INFO *remoteNode, IP_ADDR *localIP, WORD len) { (void)remoteNode; (void)localIP; (void)len; return FALSE; }
+DWORD LFSRSeedRand(DWORD dwSeed) { return dwSeed; }
+DWORD GenerateRandomDWORD(void) { return 1; }
+
+
+//////////////////////////////////////////////////////////////////////////
+// TestFlood
+// the polled main loop under a flood, the tick is serviced when the pass
+// that sees it released gets there
+//
+static void TestFlood(void)
+{
+  STACK_TASK_STATS stats;
+  unsigned long long next_tick;
+  unsigned long long late;
+  unsigned long long late_max;
+  unsigned long ticks;
+  unsigned long passes;
+
+  StackInit();
+  now_us = 0;
+  rx_flood = 1;
+  rx_taken = 0;
+  next_tick = TEST_TICK_PERIOD;
+  late_max = 0;
+  ticks = 0;
+  passes = 0;
+
+  while (now_us < TEST_SECONDS * 1000000ull) {
+    StackTask();
+    now_us += COST_SERVICES;
+    if (now_us >= next_tick) {
+      late = now_us - next_tick;
+      if (late > late_max)
+        late_max = late;
+      ticks++;
+      next_tick += TEST_TICK_PERIOD;
+      now_us += COST_CONTROL_TASK;
+    }
+    passes++;
+  }
+
+  StackGetTaskStats(&stats);
+  printf("flood: %lu passes, %lu frames, %lu ticks, latest tick %llu uS, longest StackTask %lu uS, %lu budget stops\n",
+         passes, rx_taken, ticks, late_max,
+         (unsigned long)(stats.dwMaxTicks * 1000000ull / TICK_SECOND), (unsigned long)stats.dwBudgetHits);
+
+  CHECK(ticks >= TEST_SECONDS * 1000000ull / TEST_TICK_PERIOD - 1, "%lu ticks serviced", ticks);
+  CHECK(late_max < TEST_JITTER_LIMIT, "a tick ran %llu uS late", late_max);
+  CHECK(stats.wMaxPackets <= STACK_RX_PACKET_BUDGET, "%u packets in one call", stats.wMaxPackets);
+  CHECK(stats.dwBudgetHits == passes, "%lu budget stops in %lu passes", (unsigned long)stats.dwBudgetHits, passes);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// TestBurst
+// a burst of frames, the budget only counts when the call left some
+//
+static void TestBurst(unsigned long frames, unsigned long hits_expected)
+{
+  STACK_TASK_STATS stats;
+  unsigned int calls;
+
+  StackInit();
+  now_us = 0;
+  rx_flood = 0;
+  rx_pending = frames;
+
+  for (calls = 0; rx_pending && calls < 100; calls++)
+    StackTask();
+  StackTask();   // finds nothing
+
+  StackGetTaskStats(&stats);
+  CHECK(rx_pending == 0, "burst of %lu: %lu frames left", frames, rx_pending);
+  CHECK(stats.dwBudgetHits == hits_expected, "burst of %lu: %lu budget stops, expected %lu",
+        frames, (unsigned long)stats.dwBudgetHits, hits_expected);
+}
+
+
+int main(void)
+{
+  printf("StackTask, RX budget %u packets or %lu ticks\n",
+         (unsigned int)STACK_RX_PACKET_BUDGET, (unsigned long)STACK_RX_TIME_BUDGET);
+
+  // at these costs the time budget stops a call after its second frame
+  TestFlood();
+  TestBurst(1, 0);
+  TestBurst(2, 0);
+  TestBurst(3, 1);
+
+  if (failures) {
+    printf("%u checks failed\n", failures);
+    return 1;
+  }
+  printf("all checks passed\n");
+  return 0;
+}
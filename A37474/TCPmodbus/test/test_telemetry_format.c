@@ -0,0 +1,324 @@
+/*********************************************************************
+ *
+ *  Telemetry format round trip test
+ *
+ *********************************************************************
+ * FileName:        test_telemetry_format.c
+ * Dependencies:    TelemetryFormat.c built with TELEMETRY_FORMAT_DECODER
+ *
+ * Host test, see Makefile.  Encodes streams of snapshots, drops, cuts
+ * and reorders records on the way to the decoder and checks that it
+ * returns exactly the records it was given a keyframe for.
+ *
+ ********************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "TelemetryFormat.h"
+
+
+#define TEST_RECORDS    (10 * TELEMETRY_KEYFRAME_INTERVAL + 37)
+
+static unsigned int failures;
+
+#define CHECK(condition, ...)                     \
+  do {                                            \
+    if (!(condition)) {                           \
+      failures++;                                 \
+      printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+      printf(__VA_ARGS__);                        \
+      printf("\n");                               \
+    }                                             \
+  } while (0)
+
+
+//////////////////////////////////////////////////////////////////////////
+// NextSnapshot
+// random walk that looks like the firmware record: a few noisy ADC
+// words, a timestamp that moves every record and fields that rarely change
+//
+static void NextSnapshot(unsigned int* fields, unsigned int record)
+{
+  unsigned int n;
+
+  for (n = 0; n < TELEMETRY_FIELDS; n++) {
+    if ((rand() % 8) == 0) {
+      fields[n] = (fields[n] + (rand() % 64) - 32) & 0xFFFF;
+    }
+  }
+  if ((record % 50) == 0) {
+    fields[rand() % TELEMETRY_FIELDS] = rand() & 0xFFFF;   // a jump
+  }
+  fields[TELEMETRY_FIELDS - 2] = (fields[TELEMETRY_FIELDS - 2] + 100000) & 0xFFFF;   // timestamp_low
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Encode
+//
+static unsigned int Encode(TELEMETRY_FORMAT* encoder, const unsigned int* fields, unsigned char* record)
+{
+  unsigned int length;
+
+  length = TelemetryEncode(encoder, fields, record);
+  CHECK(length <= TELEMETRY_MAX_RECORD, "record of %u bytes", length);
+  return length;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Matches
+//
+static int Matches(const unsigned int* expected, const unsigned int* fields)
+{
+  unsigned int n;
+
+  for (n = 0; n < TELEMETRY_FIELDS; n++) {
+    if ((expected[n] & 0xFFFF) != fields[n]) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// TestLossless
+// every record comes back as it was encoded
+//
+static void TestLossless(void)
+{
+  TELEMETRY_FORMAT encoder;
+  TELEMETRY_FORMAT decoder;
+  unsigned int     fields[TELEMETRY_FIELDS];
+  unsigned int     decoded[TELEMETRY_FIELDS];
+  unsigned char    record[TELEMETRY_MAX_RECORD];
+  unsigned int     length;
+  unsigned int     used;
+  unsigned int     r;
+
+  srand(1);
+  memset(fields, 0, sizeof(fields));
+  TelemetryFormatReset(&encoder);
+  TelemetryFormatReset(&decoder);
+
+  for (r = 0; r < TEST_RECORDS; r++) {
+    NextSnapshot(fields, r);
+    length = Encode(&encoder, fields, record);
+    CHECK(((record[0] & TELEMETRY_FLAG_KEYFRAME) != 0) == ((r % TELEMETRY_KEYFRAME_INTERVAL) == 0),
+          "record %u keyframe flag 0x%02X", r, record[0]);
+    used = TelemetryDecode(&decoder, record, length, decoded);
+    CHECK(used == length, "record %u decoded %u of %u bytes", r, used, length);
+    CHECK(Matches(fields, decoded), "record %u fields differ", r);
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////
+// TestExtremes
+// full scale steps and 16 bit wrap in both directions
+//
+static void TestExtremes(void)
+{
+  static const unsigned int values[] = {0x0000, 0xFFFF, 0x0000, 0x8000, 0x7FFF, 0x8000, 0x0001, 0xFFFE, 0x1234};
+  TELEMETRY_FORMAT encoder;
+  TELEMETRY_FORMAT decoder;
+  unsigned int     fields[TELEMETRY_FIELDS];
+  unsigned int     decoded[TELEMETRY_FIELDS];
+  unsigned char    record[TELEMETRY_MAX_RECORD];
+  unsigned int     length;
+  unsigned int     r;
+  unsigned int     n;
+
+  TelemetryFormatReset(&encoder);
+  TelemetryFormatReset(&decoder);
+
+  for (r = 0; r < sizeof(values) / sizeof(values[0]); r++) {
+    for (n = 0; n < TELEMETRY_FIELDS; n++) {
+      fields[n] = (n & 1) ? values[r] : (~values[r] & 0xFFFF);
+    }
+    length = Encode(&encoder, fields, record);
+    CHECK(TelemetryDecode(&decoder, record, length, decoded) == length, "step %u not decoded", r);
+    CHECK(Matches(fields, decoded), "step %u fields differ", r);
+  }
+
+  // Only the low 16 bits of a host unsigned int are sent
+  fields[0] = 0x12345;
+  length = Encode(&encoder, fields, record);
+  CHECK(TelemetryDecode(&decoder, record, length, decoded) == length, "wide field not decoded");
+  CHECK(decoded[0] == 0x2345, "wide field decoded as 0x%X", decoded[0]);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// TestLoss
+// after a dropped record every delta is refused until the next keyframe,
+// from which the stream is exact again
+//
+static void TestLoss(unsigned int drop_every, unsigned int seed)
+{
+  TELEMETRY_FORMAT encoder;
+  TELEMETRY_FORMAT decoder;
+  unsigned int     fields[TELEMETRY_FIELDS];
+  unsigned int     decoded[TELEMETRY_FIELDS];
+  unsigned char    record[TELEMETRY_MAX_RECORD];
+  unsigned int     length;
+  unsigned int     used;
+  unsigned int     r;
+  unsigned int     dropped = 0;
+  unsigned int     refused = 0;
+  int              synced = 1;
+
+  srand(seed);
+  memset(fields, 0, sizeof(fields));
+  TelemetryFormatReset(&encoder);
+  TelemetryFormatReset(&decoder);
+
+  for (r = 0; r < TEST_RECORDS; r++) {
+    NextSnapshot(fields, r);
+    length = Encode(&encoder, fields, record);
+
+    if ((rand() % drop_every) == 0) {
+      dropped++;
+      synced = 0;
+      continue;
+    }
+
+    if (record[0] & TELEMETRY_FLAG_KEYFRAME) {
+      synced = 1;
+    }
+
+    memset(decoded, 0xA5, sizeof(decoded));
+    used = TelemetryDecode(&decoder, record, length, decoded);
+    if (synced) {
+      CHECK(used == length, "record %u decoded %u of %u bytes", r, used, length);
+      CHECK(Matches(fields, decoded), "record %u fields differ", r);
+    } else {
+      CHECK(used == 0, "record %u decoded after a gap", r);
+      CHECK(decoded[0] == 0xA5A5A5A5, "record %u written while refused", r);
+      refused++;
+    }
+  }
+
+  CHECK(dropped != 0, "1 in %u loss dropped nothing", drop_every);
+  printf("  1 in %-3u loss: %4u dropped, %5u refused until a keyframe\n", drop_every, dropped, refused);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// TestLateJoin
+// a decoder started mid stream waits for the keyframe
+//
+static void TestLateJoin(void)
+{
+  TELEMETRY_FORMAT encoder;
+  TELEMETRY_FORMAT decoder;
+  unsigned int     fields[TELEMETRY_FIELDS];
+  unsigned int     decoded[TELEMETRY_FIELDS];
+  unsigned char    record[TELEMETRY_MAX_RECORD];
+  unsigned int     length;
+  unsigned int     used;
+  unsigned int     r;
+
+  srand(3);
+  memset(fields, 0, sizeof(fields));
+  TelemetryFormatReset(&encoder);
+  TelemetryFormatReset(&decoder);
+
+  for (r = 0; r < 3 * TELEMETRY_KEYFRAME_INTERVAL; r++) {
+    NextSnapshot(fields, r);
+    length = Encode(&encoder, fields, record);
+    if (r < TELEMETRY_KEYFRAME_INTERVAL / 2) {
+      continue;
+    }
+    used = TelemetryDecode(&decoder, record, length, decoded);
+    if (r < TELEMETRY_KEYFRAME_INTERVAL) {
+      CHECK(used == 0, "record %u decoded before the keyframe", r);
+    } else {
+      CHECK(used == length, "record %u decoded %u of %u bytes", r, used, length);
+      CHECK(Matches(fields, decoded), "record %u fields differ", r);
+    }
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////
+// TestDamaged
+// a cut, repeated or reordered record is refused and drops sync
+//
+static void TestDamaged(void)
+{
+  TELEMETRY_FORMAT encoder;
+  TELEMETRY_FORMAT decoder;
+  unsigned int     fields[TELEMETRY_FIELDS];
+  unsigned int     decoded[TELEMETRY_FIELDS];
+  unsigned char    record[TELEMETRY_MAX_RECORD];
+  unsigned char    previous[TELEMETRY_MAX_RECORD];
+  unsigned int     length;
+  unsigned int     previous_length;
+  unsigned int     cut;
+  unsigned int     n;
+
+  memset(fields, 0, sizeof(fields));
+  TelemetryFormatReset(&encoder);
+
+  // Every cut of a keyframe is refused
+  for (n = 0; n < TELEMETRY_FIELDS; n++) {
+    fields[n] = 0x4000 + n * 0x111;
+  }
+  length = Encode(&encoder, fields, record);
+  for (cut = 0; cut < length; cut++) {
+    TelemetryFormatReset(&decoder);
+    CHECK(TelemetryDecode(&decoder, record, cut, decoded) == 0, "keyframe cut to %u bytes decoded", cut);
+    CHECK(!decoder.synced, "keyframe cut to %u bytes left the decoder synced", cut);
+  }
+  TelemetryFormatReset(&decoder);
+  CHECK(TelemetryDecode(&decoder, record, length, decoded) == length, "keyframe not decoded");
+
+  // A cut delta drops sync, the following delta is refused
+  fields[3] ^= 0x5555;
+  fields[TELEMETRY_FIELDS - 1] += 700;
+  length = Encode(&encoder, fields, record);
+  CHECK(TelemetryDecode(&decoder, record, length - 1, decoded) == 0, "cut delta decoded");
+  CHECK(!decoder.synced, "cut delta left the decoder synced");
+  fields[4]++;
+  length = Encode(&encoder, fields, record);
+  CHECK(TelemetryDecode(&decoder, record, length, decoded) == 0, "delta after a cut decoded");
+
+  // A repeated delta and a delta from the past are refused
+  TelemetryFormatReset(&encoder);
+  TelemetryFormatReset(&decoder);
+  length = Encode(&encoder, fields, record);
+  CHECK(TelemetryDecode(&decoder, record, length, decoded) == length, "keyframe not decoded");
+  fields[5]++;
+  previous_length = Encode(&encoder, fields, previous);
+  CHECK(TelemetryDecode(&decoder, previous, previous_length, decoded) == previous_length, "delta not decoded");
+  CHECK(TelemetryDecode(&decoder, previous, previous_length, decoded) == 0, "repeated delta decoded");
+
+  TelemetryFormatReset(&encoder);
+  TelemetryFormatReset(&decoder);
+  length = Encode(&encoder, fields, record);
+  CHECK(TelemetryDecode(&decoder, record, length, decoded) == length, "keyframe not decoded");
+  fields[6]++;
+  previous_length = Encode(&encoder, fields, previous);
+  fields[7]++;
+  length = Encode(&encoder, fields, record);
+  CHECK(TelemetryDecode(&decoder, record, length, decoded) == 0, "delta decoded ahead of its predecessor");
+  CHECK(TelemetryDecode(&decoder, previous, previous_length, decoded) == 0, "delta decoded after a gap");
+}
+
+
+int main(void)
+{
+  printf("TelemetryFormat, %u fields, keyframe every %u records\n",
+         (unsigned int)TELEMETRY_FIELDS, (unsigned int)TELEMETRY_KEYFRAME_INTERVAL);
+
+  TestLossless();
+  TestExtremes();
+  TestLoss(2, 10);
+  TestLoss(20, 11);
+  TestLoss(200, 12);
+  TestLateJoin();
+  TestDamaged();
+
+  if (failures) {
+    printf("%u checks failed\n", failures);
+    return 1;
+  }
+  printf("all checks passed\n");
+  return 0;
+}